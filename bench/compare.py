@@ -0,0 +1,31 @@
+#!/usr/bin/env python3
+
+"""
+Compares two outputs of bench/kernels, e.g. made before and after a change,
+and prints the relative change of the median time per sample of each
+benchmark. Differences within a few percent are usually noise; run with more
+repetitions to reduce it.
+"""
+
+import sys, json
+
+if len(sys.argv) != 3:
+   sys.exit("usage: %s <old.json> <new.json>" % sys.argv[0])
+
+def load(path):
+   with open(path) as f:
+      return {b["name"]: b for b in json.load(f)["benchmarks"]}
+
+old, new = load(sys.argv[1]), load(sys.argv[2])
+
+print("%-34s %12s %12s %8s" % ("benchmark", "old ns/smp", "new ns/smp", "change"))
+for name, bench in new.items():
+   if name not in old:
+      print("%-34s %12s %12.3f %8s" % (name, "-", bench["ns_per_sample"], "new"))
+      continue
+   before, after = old[name]["ns_per_sample"], bench["ns_per_sample"]
+   change = (after - before) / before * 100. if before else 0.
+   print("%-34s %12.3f %12.3f %+7.1f%%" % (name, before, after, change))
+for name in old:
+   if name not in new:
+      print("%-34s %12.3f %12s %8s" % (name, old[name]["ns_per_sample"], "-", "gone"))
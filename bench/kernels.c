@@ -0,0 +1,382 @@
+/* Microbenchmarks of the column and evaluation kernels, on a synthetic dataset
+   generated in memory. eval.c is included rather than linked, so that its
+   static kernels can be timed on their own; the other modules are linked as
+   built for the program.
+
+   Each benchmark is run a few times to warm up, then timed over a number of
+   repetitions. The median and 95th percentile of the repetitions are written
+   as JSON, along with the time and number of cycles per sample processed.
+   Cycles are read from the time-stamp counter, so they count reference
+   cycles, and are only reported on x86.
+ */
+#define _POSIX_C_SOURCE 200809L
+
+#include "../src/eval.c"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../src/config.h"
+#include "../src/dataset.h"
+#include "../src/column.h"
+#include "../src/measure.h"
+#include "../src/bfss.h"
+#include "../src/common.h"
+#include "../src/cmd.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_CYCLES 1
+static uint64_t cycles(void)
+{
+   return __rdtsc();
+}
+#else
+#define HAVE_CYCLES 0
+static uint64_t cycles(void)
+{
+   return 0;
+}
+#endif
+
+#define NUM_LABELS 4
+
+// Number of feature types of the columns of the dataset.
+static const size_t g_cardinalities[] = {2, 16, 256, 4096, 65536};
+#define NUM_COLUMNS (sizeof g_cardinalities / sizeof *g_cardinalities)
+
+static const char *const g_measures[] = {"accuracy", "precision", "recall", "F1"};
+#define NUM_MEASURES (sizeof g_measures / sizeof *g_measures)
+
+static struct {
+   size_t num_rows;
+   size_t repetitions;
+   size_t warmup;
+   const char *filter;
+} g_options = {
+   .num_rows = 100000,
+   .repetitions = 31,
+   .warmup = 3,
+};
+
+static struct bfss g_bfss;
+static char **g_keys[NUM_COLUMNS];     // Feature value of each sample.
+static struct column g_column;         // Built by column_add().
+static struct column *g_joined;
+static struct eval g_ev;
+static uint32_t *g_freqs;
+static struct conf_mat g_mats[NUM_LABELS];
+static volatile double g_sink;
+
+struct bench {
+   const char *name;
+   size_t arg;
+   size_t samples;                     // Processed by each run.
+   void (*setup)(size_t arg);          // Before each run, untimed.
+   void (*run)(size_t arg);
+   void (*teardown)(size_t arg);       // After each run, untimed.
+};
+
+static uint64_t xorshift(uint64_t *state)
+{
+   uint64_t x = *state;
+   x ^= x << 13;
+   x ^= x >> 7;
+   x ^= x << 17;
+   return *state = x;
+}
+
+// Loads a dataset of uniformly distributed values, through the usual loader.
+static void load_synthetic(void)
+{
+   char *text;
+   size_t size;
+   FILE *out = open_memstream(&text, &size);
+   if (!out)
+      die("can't allocate dataset: %s", strerror(errno));
+
+   for (size_t i = 0; i < NUM_COLUMNS; i++)
+      fprintf(out, "\tf%zu", g_cardinalities[i]);
+   putc('\n', out);
+
+   uint64_t state = 88172645463325252ULL;
+   for (size_t row = 0; row < g_options.num_rows; row++) {
+      fprintf(out, "l%u", (unsigned)(xorshift(&state) % NUM_LABELS));
+      for (size_t i = 0; i < NUM_COLUMNS; i++)
+         fprintf(out, "\tv%u", (unsigned)(xorshift(&state) % g_cardinalities[i]));
+      putc('\n', out);
+   }
+   fclose(out);
+
+   FILE *in = fmemopen(text, size, "r");
+   if (!in)
+      die("can't read dataset: %s", strerror(errno));
+   load_dataset_file(&g_bfss, in);
+   fclose(in);
+   free(text);
+
+   // Same values again, for column_add().
+   for (size_t i = 0; i < NUM_COLUMNS; i++)
+      g_keys[i] = xmalloc(g_bfss.data.num_samples * sizeof *g_keys[i]);
+   state = 88172645463325252ULL;
+   for (size_t row = 0; row < g_bfss.data.num_samples; row++) {
+      xorshift(&state);
+      for (size_t i = 0; i < NUM_COLUMNS; i++) {
+         char key[32];
+         snprintf(key, sizeof key, "v%u", (unsigned)(xorshift(&state) % g_cardinalities[i]));
+         g_keys[i][row] = xstrdup(key);
+      }
+   }
+   save_columns(&g_bfss.data);
+}
+
+static void add_setup(size_t col_no)
+{
+   (void)col_no;
+   column_init(&g_column, &g_bfss.data, "bench", NULL);
+}
+
+static void add_run(size_t col_no)
+{
+   for (size_t i = 0; i < g_bfss.data.num_samples; i++)
+      column_add(&g_column, i, g_keys[col_no][i]);
+}
+
+static void add_teardown(size_t col_no)
+{
+   (void)col_no;
+   column_fini(&g_column);
+}
+
+// Adds values that are all in the table already.
+static void lookup_setup(size_t col_no)
+{
+   add_setup(col_no);
+   add_run(col_no);
+}
+
+static void count_setup(size_t col_no)
+{
+   size_t row_size = COLUMN_ROW_SIZE(g_bfss.data.num_labels);
+   g_freqs = xrealloc(g_freqs, g_bfss.data.columns[col_no].table.num_types * row_size
+                               * sizeof *g_freqs);
+}
+
+static void count_run(size_t col_no)
+{
+   g_sink = column_count(&g_bfss.data.columns[col_no], g_freqs, 0, g_ev.fold_size);
+}
+
+// "arg" is the number of the first column, joined with the following one.
+static void join_run(size_t col_no)
+{
+   column_join(g_joined, &g_bfss.data.columns[col_no], &g_bfss.data.columns[col_no + 1]);
+}
+
+static void merge_setup(size_t col_no)
+{
+   g_bfss.data.columns[col_no].state = COL_ACTIVE;
+}
+
+static void merge_run(size_t col_no)
+{
+   column_merge(&g_bfss.data.columns[col_no], &g_bfss.data.columns[col_no + 1]);
+}
+
+static void merge_teardown(size_t col_no)
+{
+   g_bfss.data.columns[col_no + 1].state = COL_MERGED;
+   restore_columns(&g_bfss.data);
+}
+
+// Trains on the first fold with the given columns, as eval_columns() does.
+static void train_fold(const struct column *const *columns, size_t num_columns)
+{
+   set_columns(&g_ev, columns, num_columns);
+   g_ev.test_start = 0;
+   g_ev.test_end = g_ev.fold_size;
+   train(&g_ev);
+   compute_priors(&g_ev);
+}
+
+static void probs_setup(size_t col_no)
+{
+   static const struct column *column;
+   column = &g_bfss.data.columns[col_no];
+   train_fold(&column, 1);
+}
+
+static void probs_run(size_t col_no)
+{
+   (void)col_no;
+   compute_feat_probs(&g_ev, 0);
+}
+
+static void mat_setup(size_t arg)
+{
+   (void)arg;
+   static const struct column *columns[NUM_COLUMNS];
+   for (size_t i = 0; i < NUM_COLUMNS; i++)
+      columns[i] = &g_bfss.data.columns[i];
+   train_fold(columns, NUM_COLUMNS);
+   for (size_t i = 0; i < NUM_COLUMNS; i++)
+      compute_feat_probs(&g_ev, i);
+   g_ev.conf_mat = g_mats;
+}
+
+static void mat_run(size_t arg)
+{
+   static void (*const funcs[])(struct eval *) = {
+      update_mat_binary, update_mat_micro, update_mat_macro,
+   };
+   funcs[arg](&g_ev);
+}
+
+// "arg" is the number of the measure, times two, plus one for macro-averaging.
+static void measure_setup(size_t arg)
+{
+   g_bfss.config.measure_name = g_measures[arg / 2];
+   g_bfss.config.averaging_mode = arg % 2 ? "macro" : "micro";
+   measure_init(&g_bfss.measure, &g_bfss.config, g_bfss.data.num_labels);
+   for (size_t i = 0; i < NUM_LABELS; i++)
+      g_mats[i] = (struct conf_mat){1000 + i, 3000 - i, 200 + 3 * i, 150 + 7 * i};
+}
+
+static void measure_run(size_t arg)
+{
+   (void)arg;
+   double sum = 0.;
+   for (size_t i = 0; i < 1000; i++)
+      sum += measure_score(&g_bfss.measure, g_mats);
+   g_sink = sum;
+}
+
+static int cmp_doubles(const void *x_, const void *y_)
+{
+   double x = *(const double *)x_, y = *(const double *)y_;
+   return x < y ? -1 : x > y;
+}
+
+static void run_bench(FILE *out, const struct bench *bench, bool first)
+{
+   size_t reps = g_options.repetitions;
+   double times[reps], ticks[reps];
+
+   for (size_t i = 0; i < g_options.warmup + reps; i++) {
+      if (bench->setup)
+         bench->setup(bench->arg);
+      double start = now();
+      uint64_t start_cycles = cycles();
+      bench->run(bench->arg);
+      uint64_t end_cycles = cycles();
+      double end = now();
+      if (bench->teardown)
+         bench->teardown(bench->arg);
+      if (i >= g_options.warmup) {
+         times[i - g_options.warmup] = (end - start) * 1e9;
+         ticks[i - g_options.warmup] = end_cycles - start_cycles;
+      }
+   }
+   qsort(times, reps, sizeof *times, cmp_doubles);
+   qsort(ticks, reps, sizeof *ticks, cmp_doubles);
+
+   double median = times[reps / 2];
+   fprintf(out, "%s      {\"name\": \"%s\", \"samples\": %zu, \"median_ns\": %.0f, "
+           "\"p95_ns\": %.0f, \"ns_per_sample\": %.3f, \"cycles_per_sample\": ",
+           first ? "" : ",\n", bench->name, bench->samples, median,
+           times[(reps * 95 + 99) / 100 - 1], median / bench->samples);
+   if (HAVE_CYCLES)
+      fprintf(out, "%.3f}", ticks[reps / 2] / bench->samples);
+   else
+      fputs("null}", out);
+   fflush(out);
+}
+
+static const char g_help[] =
+"Usage: %s [options]\n"
+"Runs microbenchmarks of the column and evaluation kernels, and writes the\n"
+"results as JSON.\n"
+"\n"
+"   --rows=<integer>             number of samples of the dataset [100000]\n"
+"   --repetitions=<integer>      timed runs of each benchmark [31]\n"
+"   --warmup=<integer>           untimed runs before them [3]\n"
+"   --filter=<string>            only run benchmarks whose name contains this\n"
+"   -h, --help                   display this help screen\n"
+;
+
+int main(int argc, char **argv)
+{
+   struct option options[] = {
+      {'\0', "rows",          OPT_SIZE_T(g_options.num_rows)   },
+      {'\0', "repetitions",   OPT_SIZE_T(g_options.repetitions)},
+      {'\0', "warmup",        OPT_SIZE_T(g_options.warmup)     },
+      {'\0', "filter",        OPT_STR(g_options.filter)        },
+      {'\0', 0,               .z = 0                           },
+   };
+   parse_options(options, g_help, &argc, &argv);
+   if (argc)
+      die("excess arguments");
+   if (!g_options.repetitions)
+      die("--repetitions must be > 0");
+   if (g_options.num_rows < 10)
+      die("--rows must be >= 10");
+
+   config_init(&g_bfss.config);
+   g_bfss.config.dataset_path = "<synthetic>";
+   g_bfss.config.num_folds = 10;
+   load_synthetic();
+   g_bfss.config.positive_label = 0;
+   eval_init(&g_bfss.eval, &g_bfss);
+   g_ev = g_bfss.eval;
+   g_joined = column_alloc_joined(&g_bfss.data);
+
+   struct bench benches[4 * NUM_COLUMNS + 2 * (NUM_COLUMNS - 1) + 3 + 2 * NUM_MEASURES];
+   char names[sizeof benches / sizeof *benches][64];
+   size_t num_benches = 0;
+   size_t num_train = g_bfss.data.num_samples - g_ev.fold_size;
+
+#define ADD(samples_, setup_, run_, teardown_, arg_, ...) do {                 \
+   snprintf(names[num_benches], sizeof *names, __VA_ARGS__);                   \
+   benches[num_benches] = (struct bench){names[num_benches], arg_, samples_,   \
+                                         setup_, run_, teardown_};             \
+   num_benches++;                                                              \
+} while (0)
+
+   for (size_t i = 0; i < NUM_COLUMNS; i++) {
+      size_t types = g_cardinalities[i];
+      ADD(g_bfss.data.num_samples, add_setup, add_run, add_teardown, i,
+          "column_add/types=%zu", types);
+      ADD(g_bfss.data.num_samples, lookup_setup, add_run, add_teardown, i,
+          "column_add_existing/types=%zu", types);
+      ADD(num_train, count_setup, count_run, NULL, i, "column_count/types=%zu", types);
+      ADD(g_ev.fold_size, probs_setup, probs_run, NULL, i,
+          "compute_feat_probs/types=%zu", types);
+   }
+   for (size_t i = 0; i + 1 < NUM_COLUMNS; i++) {
+      size_t types1 = g_cardinalities[i], types2 = g_cardinalities[i + 1];
+      ADD(g_bfss.data.num_samples, NULL, join_run, NULL, i,
+          "column_join/types=%zux%zu", types1, types2);
+      ADD(g_bfss.data.num_samples, merge_setup, merge_run, merge_teardown, i,
+          "column_merge/types=%zux%zu", types1, types2);
+   }
+   ADD(g_ev.fold_size, mat_setup, mat_run, NULL, 0, "update_mat_binary");
+   ADD(g_ev.fold_size, mat_setup, mat_run, NULL, 1, "update_mat_micro");
+   ADD(g_ev.fold_size, mat_setup, mat_run, NULL, 2, "update_mat_macro");
+   for (size_t i = 0; i < 2 * NUM_MEASURES; i++)
+      ADD(1000, measure_setup, measure_run, NULL, i, "measure/%s_%s",
+          g_measures[i / 2], i % 2 ? "macro" : "micro");
+#undef ADD
+
+   printf("{\n   \"rows\": %zu,\n   \"repetitions\": %zu,\n   \"warmup\": %zu,\n"
+          "   \"benchmarks\": [\n", g_bfss.data.num_samples, g_options.repetitions,
+          g_options.warmup);
+   bool first = true;
+   for (size_t i = 0; i < num_benches; i++) {
+      if (g_options.filter && !strstr(benches[i].name, g_options.filter))
+         continue;
+      run_bench(stdout, &benches[i], first);
+      first = false;
+   }
+   printf("\n   ]\n}\n");
+}
@@ -0,0 +1,118 @@
+#!/usr/bin/env python3
+
+"""
+Runs bayes_fss on a grid of synthetic datasets and search modes, and writes
+the measures of each run as a JSON document: load time, evaluations per
+second and peak memory, from --stats and --memory-report. Searches are
+bounded with --max-evals, so that runs do the same amount of work from one
+version to the next.
+"""
+
+import os, sys, json, time, shutil, argparse, platform, statistics, subprocess, tempfile
+
+ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+
+def int_list(arg):
+   return [int(x) for x in arg.split(",")]
+
+def str_list(arg):
+   return arg.split(",")
+
+parser = argparse.ArgumentParser(description=__doc__.strip().splitlines()[0])
+parser.add_argument("--binary", default=os.path.join(ROOT, "bayes_fss"))
+parser.add_argument("--rows", type=int_list, default=[10000, 100000])
+parser.add_argument("--features", type=int_list, default=[20, 50])
+parser.add_argument("--modes", type=str_list,
+                    default=["forward", "backward", "forward-join", "beam"])
+parser.add_argument("--gen-args", default="--labels=2 --cardinality=2-1000 --zipf=1.1",
+                    help="arguments passed to gendata.py")
+parser.add_argument("--max-evals", type=int, default=200)
+parser.add_argument("--threads", type=int, default=1)
+parser.add_argument("--repeat", type=int, default=1,
+                    help="runs per configuration, the median is kept")
+parser.add_argument("--quick", action="store_true", help="small grid, for testing")
+parser.add_argument("-o", "--output", help="defaults to stdout")
+args = parser.parse_args()
+
+if args.quick:
+   args.rows, args.features, args.max_evals = [5000], [10], 50
+
+def log(msg):
+   print(msg, file=sys.stderr, flush=True)
+
+def generate(directory, rows, features):
+   path = os.path.join(directory, "gen-%d-%d.tsv" % (rows, features))
+   if not os.path.exists(path):
+      cmd = [os.path.join(ROOT, "scripts", "gendata.py"), "--rows=%d" % rows,
+             "--features=%d" % features] + args.gen_args.split()
+      with open(path, "w") as out:
+         subprocess.run(cmd, stdout=out, check=True)
+   return path
+
+def run(dataset, mode):
+   cmd = [args.binary, "--compact", "--stats", "--memory-report", "--search=" + mode,
+          "--max-evals=%d" % args.max_evals, "--threads=%d" % args.threads, dataset]
+   start = time.monotonic()
+   proc = subprocess.run(cmd, stdout=subprocess.DEVNULL, stderr=subprocess.PIPE,
+                         universal_newlines=True, check=True)
+   wall = time.monotonic() - start
+
+   docs = [json.loads(line) for line in proc.stderr.splitlines() if line.startswith("{")]
+   stats = next(doc for doc in docs if "phases" in doc)
+   memory = {doc["when"]: doc for doc in docs if "when" in doc}
+   return {
+      "wall_seconds": wall,
+      "load_seconds": stats["phases"]["load"]["seconds"],
+      "evaluations": stats["evaluations"],
+      "evaluations_per_second": stats["evaluations_per_second"],
+      "samples_per_second": stats["samples_per_second"],
+      "columns_bytes": memory["load"]["columns_total"]["bytes"],
+      "peak_rss_bytes": memory["exit"]["peak_rss_bytes"],
+   }
+
+def median_run(dataset, mode):
+   runs = [run(dataset, mode) for _ in range(args.repeat)]
+   return {key: statistics.median(r[key] for r in runs) for key in runs[0]}
+
+def git_commit():
+   try:
+      return subprocess.run(["git", "rev-parse", "HEAD"], cwd=ROOT, check=True,
+                            stdout=subprocess.PIPE, stderr=subprocess.DEVNULL,
+                            universal_newlines=True).stdout.strip()
+   except (OSError, subprocess.CalledProcessError):
+      return None
+
+results = {
+   "commit": git_commit(),
+   "date": time.strftime("%Y-%m-%dT%H:%M:%S"),
+   "machine": {
+      "system": platform.system(),
+      "processor": platform.processor() or platform.machine(),
+      "cpus": os.cpu_count(),
+   },
+   "settings": {
+      "gen_args": args.gen_args,
+      "max_evals": args.max_evals,
+      "threads": args.threads,
+      "repeat": args.repeat,
+   },
+   "runs": [],
+}
+
+directory = tempfile.mkdtemp(prefix="bfss-bench-")
+try:
+   for rows in args.rows:
+      for features in args.features:
+         dataset = generate(directory, rows, features)
+         for mode in args.modes:
+            measures = median_run(dataset, mode)
+            log("%7d rows %4d features %-14s load %7.3fs %10.1f evals/s %8.1f MiB" % (
+                rows, features, mode, measures["load_seconds"],
+                measures["evaluations_per_second"], measures["peak_rss_bytes"] / 2**20))
+            results["runs"].append(dict(rows=rows, features=features, mode=mode, **measures))
+finally:
+   shutil.rmtree(directory)
+
+out = open(args.output, "w") if args.output else sys.stdout
+json.dump(results, out, indent=3)
+out.write("\n")
@@ -0,0 +1,99 @@
+#!/usr/bin/env python3
+
+"""
+Writes a synthetic dataset on stdout, in the format read by bayes_fss. The
+output only depends on the arguments, so that benchmarks can regenerate the
+same datasets anywhere.
+
+Each feature gets a cardinality drawn log-uniformly from the given range, and
+its values are drawn from a Zipf distribution over that many values (uniform if
+the exponent is zero). Some dependencies on the label are planted:
+
+- informative features take a value determined by the label, except with the
+  given noise probability;
+- feature pairs are individually independent of the label, but determine it
+  when joined: the second value is the label shifted by the first one.
+
+The other features are noise. Planted features come first, then noise ones.
+"""
+
+import sys, math, random, argparse, bisect, itertools
+
+def parse_range(arg):
+   low, sep, high = arg.partition("-")
+   low, high = int(low), int(high) if sep else int(low)
+   if low < 1 or high < low:
+      raise argparse.ArgumentTypeError("invalid range: %s" % arg)
+   return low, high
+
+parser = argparse.ArgumentParser(description=__doc__.strip().splitlines()[0])
+parser.add_argument("-r", "--rows", type=int, default=10000, help="number of samples")
+parser.add_argument("-f", "--features", type=int, default=20, help="number of features")
+parser.add_argument("-l", "--labels", type=int, default=2, help="number of labels")
+parser.add_argument("-c", "--cardinality", type=parse_range, default=(2, 100),
+                    metavar="MIN-MAX", help="range of feature cardinalities")
+parser.add_argument("-z", "--zipf", type=float, default=1.0,
+                    help="Zipf exponent of the values distribution (0 for uniform)")
+parser.add_argument("--label-zipf", type=float, default=0.0,
+                    help="Zipf exponent of the labels distribution")
+parser.add_argument("-i", "--informative", type=int, default=2,
+                    help="number of features depending on the label")
+parser.add_argument("-p", "--pairs", type=int, default=1,
+                    help="number of feature pairs that depend on the label when joined")
+parser.add_argument("-n", "--noise", type=float, default=0.3,
+                    help="probability that a planted value is drawn at random")
+parser.add_argument("-s", "--seed", type=int, default=0)
+args = parser.parse_args()
+
+if args.informative + 2 * args.pairs > args.features:
+   parser.error("more planted features than features")
+if args.labels < 2:
+   parser.error("at least two labels are needed")
+
+def zipf_weights(n, exponent):
+   return list(itertools.accumulate(1. / (k + 1) ** exponent for k in range(n)))
+
+# Independent generators, so that changing a feature doesn't change the others.
+def generator(*what):
+   return random.Random("%d:%s" % (args.seed, ":".join(map(str, what))))
+
+def draw(rng, cum_weights, n):
+   total = cum_weights[-1]
+   return [bisect.bisect(cum_weights, rng.random() * total) for _ in range(n)]
+
+def cardinality(feat_no):
+   low, high = args.cardinality
+   rng = generator("cardinality", feat_no)
+   return int(round(math.exp(rng.uniform(math.log(low), math.log(high)))))
+
+labels = draw(generator("labels"), zipf_weights(args.labels, args.label_zipf), args.rows)
+
+def noisy(rng, values, card):
+   noise = draw(rng, zipf_weights(card, args.zipf), len(values))
+   return [noise[i] if rng.random() < args.noise else v for i, v in enumerate(values)]
+
+columns = []
+for feat_no in range(args.informative):
+   card = cardinality(feat_no)
+   rng = generator("informative", feat_no)
+   offset = rng.randrange(card)
+   columns.append(noisy(rng, [(label + offset) % card for label in labels], card))
+
+for pair_no in range(args.pairs):
+   feat_no = args.informative + 2 * pair_no
+   card = max(cardinality(feat_no), args.labels)
+   rng = generator("pair", pair_no)
+   first = draw(rng, zipf_weights(card, 0.), args.rows)
+   columns.append(first)
+   columns.append(noisy(rng, [(label + v) % card for label, v in zip(labels, first)], card))
+
+for feat_no in range(len(columns), args.features):
+   card = cardinality(feat_no)
+   columns.append(draw(generator("noise", feat_no), zipf_weights(card, args.zipf), args.rows))
+
+out = sys.stdout
+out.write("\t" + "\t".join("f%d" % i for i in range(args.features)) + "\n")
+for row_no, label in enumerate(labels):
+   out.write("c%d\t" % label)
+   out.write("\t".join("v%d" % column[row_no] for column in columns))
+   out.write("\n")
@@ -1,52 +1,46 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <signal.h>
 #include <stdio.h>
 #include <string.h>
-#include <stdnoreturn.h>
 #include "dataset.h"
 #include "common.h"
 #include "column.h"
+#include "config.h"
 #include "eval.h"
 #include "search.h"
+#include "bfss.h"
+#include "remote.h"
+#include "serve.h"
+#include "classify.h"
+#include "sweep.h"
+#include "targets.h"
+#include "stats.h"
+#include "memory.h"
+#include "model.h"
 #include "cmd.h"
 
-#define VERSION "0.3"
+static struct bfss g_bfss;
 
-struct config g_config = {
-   .num_folds = 5,
-   .smooth = 0.5,
-   .measure_name = "F1",
-   .search_mode = "forward-join",
-   .averaging_mode = "macro",
-   .classification_mode = "multiclass",
-   .max_links = SIZE_MAX,
-   .max_features = SIZE_MAX,
-   .verbose = false,
-   .compact_json = false,
-};
+static void handle_signal(int sig)
+{
+   (void)sig;
+   if (g_bfss.config.sweep)
+      sweep_stop(&g_bfss);
+   else
+      search_stop(&g_bfss);
+}
 
-noreturn static void version(void)
+static void handle_status_signal(int sig)
 {
-   const char msg[] =
-   "Bayes FSS version "VERSION"\n"
-   "Copyright (c) 2015-16 Michaël Meyer"
-   ;
-   puts(msg);
-   exit(EXIT_SUCCESS);
+   (void)sig;
+   search_status(&g_bfss);
 }
 
 static void check_options(int argc)
 {
-   if (g_config.num_folds < 2)
-      die("--num-folds must be >= 2");
-   if (g_config.smooth <= 0.)
-      die("--smooth must be > 0.0");
-   
-   if (!strcmp(g_config.classification_mode, "binary")) {
-      if (!g_config.positive_label_name)
-         die("--truth must be given for binary classification");
-   } else if (!strcmp(g_config.classification_mode, "multiclass")) {
-      if (g_config.positive_label_name)
-         die("--truth doesn't make sense for multiclass classification");
-   }
+   config_check(&g_bfss.config);
    
    if (argc > 1)
       die("excess arguments");
@@ -56,21 +50,6 @@ static void check_options(int argc)
 
 int main(int argc, char **argv)
 {
-   struct option options[] = {
-      {'k',  "folds",          OPT_SIZE_T(g_config.num_folds)            },
-      {'S',  "smooth",         OPT_DOUBLE(g_config.smooth)               },
-      {'m',  "mode",           OPT_STR(g_config.classification_mode)     },
-      {'t',  "truth",          OPT_STR(g_config.positive_label_name)     },
-      {'a',  "average",        OPT_STR(g_config.averaging_mode)          },
-      {'M',  "measure",        OPT_STR(g_config.measure_name)            },
-      {'s',  "search",         OPT_STR(g_config.search_mode)             },
-      {'L',  "max-links",      OPT_SIZE_T(g_config.max_links)            },
-      {'F',  "max-features",   OPT_SIZE_T(g_config.max_features)         },
-      {'v',  "verbose",        OPT_BOOL(g_config.verbose)                },
-      {'c',  "compact",        OPT_BOOL(g_config.compact_json)           }, 
-      {'\0', "version",        OPT_FUNC(version)                         },
-      {'\0', 0,                .z = 0                                    },
-   };
    const char help[] =
       #include "help_screen.h"
    ;
@@ -80,13 +59,56 @@ int main(int argc, char **argv)
       fprintf(stderr, help, g_progname);
       return EXIT_FAILURE;
    }
+   if (!strcmp(argv[1], "serve"))
+      serve(argc, argv, help);
+   if (!strcmp(argv[1], "classify"))
+      classify(argc, argv, help);
    
+   struct bfss *bfss = &g_bfss;
+   struct config *config = &bfss->config;
+   config_init(config);
+   struct option *options = config_options(config);
    parse_options(options, help, &argc, &argv);
-   g_config.dataset_path = *argv;
+   free(options);
+   config->dataset_path = *argv;
    check_options(argc);
+   if (config->stats)
+      stats_enable(config->perf_counters);
+   
+   load_dataset(bfss);
+   measure_init(&bfss->measure, config, bfss->data.num_labels);
+   eval_init(&bfss->eval, bfss);
+   if (config->memory_report)
+      memory_report(stderr, bfss, "load");
+   if (config->listen_addr)
+      remote_serve(&bfss->eval, config->listen_addr);
+   
+   if (signal(SIGINT, handle_signal) == SIG_ERR ||
+       signal(SIGTERM, handle_signal) == SIG_ERR)
+      die("can't install signal handler: %s", strerror(errno));
    
-   load_dataset();
-   eval_init();
-   measure_init();
-   search();
+   // The handler must stay installed, and must not interrupt system calls.
+   struct sigaction status_action = {
+      .sa_handler = handle_status_signal,
+      .sa_flags = SA_RESTART,
+   };
+   sigemptyset(&status_action.sa_mask);
+   if (sigaction(SIGUSR1, &status_action, NULL))
+      die("can't install signal handler: %s", strerror(errno));
+   if (config->sweep) {
+      save_columns(&bfss->data);
+      sweep(bfss, stdout);
+   } else if (config->targets) {
+      targets_search(bfss, stdout);
+   } else {
+      if (config->save_model_path)
+         model_init(bfss);
+      search(bfss, stdout);
+      if (config->save_model_path)
+         model_save(bfss, config->save_model_path);
+   }
+   if (config->stats && !config->targets)
+      stats_print(stderr, bfss);
+   if (config->memory_report && !config->targets)
+      memory_report(stderr, bfss, "exit");
 }
@@ -0,0 +1,40 @@
+#ifndef BFSS_BFSS_H
+#define BFSS_BFSS_H
+
+#include <stdatomic.h>
+#include <stdio.h>
+#include "config.h"
+#include "dataset.h"
+#include "eval.h"
+#include "measure.h"
+
+struct search;
+
+/* Context of the command-line program or of a library user: the options, the
+   dataset they apply to, and the state of the searches made on it. Everything
+   a search reads or modifies is reached from here, except the statistics of
+   --stats and --memory-report, which are kept for the whole process. Distinct
+   contexts can thus be used at the same time, each one from a single thread
+   (the threads of its pool aside).
+ */
+struct bfss {
+   struct config config;
+   struct dataset data;
+   struct eval eval;             // Used by the search, see eval_init().
+   struct measure measure;       // See measure_init().
+   struct search *search;        // State kept between searches, see search.c.
+
+   // Can be set from a signal handler, see search_stop() and search_status().
+   atomic_bool stop;
+   atomic_bool status_requested;
+
+   // Library state, see libbayes_fss.c.
+   char **strings;               // Option values, owned by the context.
+   size_t num_strings, strings_alloc;
+   FILE *out;                    // Report being written.
+   char *report;
+   size_t report_size;
+   char error[256];
+};
+
+#endif
@@ -0,0 +1,275 @@
+#define _DEFAULT_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "cache.h"
+#include "dataset.h"
+#include "eval.h"
+#include "buffer.h"
+#include "common.h"
+#include "cmd.h"
+
+#define CACHE_MAGIC "BFSSMAT"
+#define CACHE_VERSION 1
+#define CACHE_FLUSH_RECORDS 256  // Append records to the file by batches of
+                                 // this size.
+
+struct cache_header {
+   char magic[8];
+   uint32_t version;
+   uint32_t num_features;
+   uint64_t context;             // See eval_context().
+   uint64_t record_size;
+};
+
+struct cache {
+   int fd;
+   struct buffer path;
+   size_t key_size;              // In bytes.
+   size_t record_size;           // Key followed by the confusion matrix.
+   
+   const char *map;              // Records present when the cache was opened.
+   size_t map_size;
+   size_t num_records;
+   uint32_t *index;              // Open addressing table of record numbers
+                                 // plus one (zero marks empty slots).
+   size_t index_mask;
+   
+   char *pending;                // Records to append.
+   size_t num_pending, pending_alloc;
+   
+   size_t hits, added;
+   pthread_mutex_t lock;
+};
+
+static uint64_t key_hash(const struct cache *cache, const uint32_t *key)
+{
+   uint64_t hash = hash_bytes(HASH_INIT, key, cache->key_size);
+   return hash ^ (hash >> 32);
+}
+
+static void lock_file(struct cache *cache, int operation)
+{
+   while (flock(cache->fd, operation))
+      if (errno != EINTR)
+         die("can't lock %s: %s", cache->path.data, strerror(errno));
+}
+
+static void write_all(struct cache *cache, const void *data, size_t size)
+{
+   while (size) {
+      ssize_t ret = write(cache->fd, data, size);
+      if (ret < 0) {
+         if (errno == EINTR)
+            continue;
+         die("can't write to %s: %s", cache->path.data, strerror(errno));
+      }
+      data = (const char *)data + ret;
+      size -= ret;
+   }
+}
+
+// Writes the header if the file is new, or checks it otherwise.
+static void check_header(struct cache *cache, const struct cache_header *header)
+{
+   struct cache_header old;
+   
+   ssize_t ret = pread(cache->fd, &old, sizeof old, 0);
+   if (ret < 0)
+      die("can't read %s: %s", cache->path.data, strerror(errno));
+   if (!ret) {
+      write_all(cache, header, sizeof *header);
+      return;
+   }
+   if ((size_t)ret < sizeof old || memcmp(&old, header, sizeof old))
+      die("%s is not a valid cache file for this dataset", cache->path.data);
+}
+
+static void build_index(struct cache *cache)
+{
+   size_t size = 16;
+   while (size < 2 * cache->num_records)
+      size *= 2;
+   cache->index = xcalloc(size, sizeof *cache->index);
+   cache->index_mask = size - 1;
+   
+   const char *records = cache->map + sizeof(struct cache_header);
+   for (size_t i = 0; i < cache->num_records; i++) {
+      const uint32_t *key = (const uint32_t *)&records[i * cache->record_size];
+      size_t pos = key_hash(cache, key) & cache->index_mask;
+      while (cache->index[pos])
+         pos = (pos + 1) & cache->index_mask;
+      cache->index[pos] = i + 1;
+   }
+}
+
+struct cache *cache_open(const char *dir, const struct eval *ev)
+{
+   size_t conf_mat_size = ev->conf_mat_size;
+   size_t num_features = ev->data->num_features;
+
+   if (mkdir(dir, 0777) && errno != EEXIST)
+      die("can't create cache directory %s: %s", dir, strerror(errno));
+   
+   struct cache_header header = {
+      .magic = CACHE_MAGIC,
+      .version = CACHE_VERSION,
+      .num_features = num_features,
+      .context = eval_context(ev),
+   };
+   struct cache *cache = xmalloc(sizeof *cache);
+   *cache = (struct cache){
+      .path = BUFFER_INIT,
+      .key_size = num_features * sizeof(uint32_t),
+   };
+   pthread_mutex_init(&cache->lock, NULL);
+   cache->record_size = cache->key_size + conf_mat_size;
+   header.record_size = cache->record_size;
+   
+   char name[32];
+   snprintf(name, sizeof name, "/%016llx.cache", (unsigned long long)header.context);
+   buffer_cat(&cache->path, dir, strlen(dir));
+   buffer_cat(&cache->path, name, strlen(name));
+   
+   cache->fd = open(cache->path.data, O_RDWR | O_CREAT | O_APPEND, 0666);
+   if (cache->fd < 0)
+      die("can't open %s: %s", cache->path.data, strerror(errno));
+   
+   lock_file(cache, LOCK_EX);
+   check_header(cache, &header);
+   
+   struct stat st;
+   if (fstat(cache->fd, &st))
+      die("can't stat %s: %s", cache->path.data, strerror(errno));
+   lock_file(cache, LOCK_UN);
+   
+   // Ignore a partial record left by a process that crashed while appending.
+   cache->map_size = st.st_size;
+   cache->num_records = (cache->map_size - sizeof header) / cache->record_size;
+   if (cache->num_records) {
+      cache->map = mmap(NULL, cache->map_size, PROT_READ, MAP_SHARED, cache->fd, 0);
+      if (cache->map == MAP_FAILED)
+         die("can't map %s: %s", cache->path.data, strerror(errno));
+   }
+   build_index(cache);
+   return cache;
+}
+
+bool cache_lookup(struct cache *cache, const uint32_t *key, struct conf_mat *mat)
+{
+   if (!cache)
+      return false;
+   
+   const char *records = cache->map + sizeof(struct cache_header);
+   size_t pos = key_hash(cache, key) & cache->index_mask;
+   
+   for (; cache->index[pos]; pos = (pos + 1) & cache->index_mask) {
+      const char *record = &records[(cache->index[pos] - 1) * cache->record_size];
+      if (!memcmp(record, key, cache->key_size)) {
+         memcpy(mat, record + cache->key_size, cache->record_size - cache->key_size);
+         pthread_mutex_lock(&cache->lock);
+         cache->hits++;
+         pthread_mutex_unlock(&cache->lock);
+         return true;
+      }
+   }
+   return false;
+}
+
+// Must be called with the lock of the cache held.
+static void flush(struct cache *cache)
+{
+   if (!cache->num_pending)
+      return;
+   
+   lock_file(cache, LOCK_EX);
+   
+   struct stat st;
+   if (fstat(cache->fd, &st))
+      die("can't stat %s: %s", cache->path.data, strerror(errno));
+   size_t extra = (st.st_size - sizeof(struct cache_header)) % cache->record_size;
+   if (extra && ftruncate(cache->fd, st.st_size - extra))
+      die("can't truncate %s: %s", cache->path.data, strerror(errno));
+   
+   write_all(cache, cache->pending, cache->num_pending * cache->record_size);
+   lock_file(cache, LOCK_UN);
+   
+   cache->added += cache->num_pending;
+   cache->num_pending = 0;
+}
+
+/* Flushes the pending records, then releases the lock of the cache. If writing
+   fails, the lock is released and the records dropped before the error is
+   passed on, so that it can reach the caller of the search.
+ */
+static void flush_unlock(struct cache *cache)
+{
+   struct die_handler handler, *prev_handler = g_die_handler;
+   if (setjmp(handler.env)) {
+      g_die_handler = prev_handler;
+      cache->num_pending = 0;
+      pthread_mutex_unlock(&cache->lock);
+      die("%s", handler.msg);
+   }
+   g_die_handler = &handler;
+   flush(cache);
+   g_die_handler = prev_handler;
+   pthread_mutex_unlock(&cache->lock);
+}
+
+void cache_append(struct cache *cache, const uint32_t *key, const struct conf_mat *mat)
+{
+   if (!cache)
+      return;
+   
+   pthread_mutex_lock(&cache->lock);
+   size_t offset = cache->num_pending * cache->record_size;
+   ENLARGE(cache->pending, offset + cache->record_size, cache->pending_alloc,
+           CACHE_FLUSH_RECORDS * cache->record_size);
+   memcpy(&cache->pending[offset], key, cache->key_size);
+   memcpy(&cache->pending[offset + cache->key_size], mat,
+          cache->record_size - cache->key_size);
+   if (++cache->num_pending == CACHE_FLUSH_RECORDS)
+      flush_unlock(cache);
+   else
+      pthread_mutex_unlock(&cache->lock);
+}
+
+void cache_close(struct cache *cache)
+{
+   if (!cache)
+      return;
+   
+   pthread_mutex_lock(&cache->lock);
+   flush_unlock(cache);
+   
+   if (cache->map)
+      munmap((void *)cache->map, cache->map_size);
+   close(cache->fd);
+   free(cache->index);
+   free(cache->pending);
+   buffer_fini(&cache->path);
+   pthread_mutex_destroy(&cache->lock);
+   free(cache);
+}
+
+size_t cache_hits(const struct cache *cache)
+{
+   if (!cache)
+      return 0;
+   return cache->hits;
+}
+
+size_t cache_records_added(const struct cache *cache)
+{
+   if (!cache)
+      return 0;
+   return cache->added + cache->num_pending;
+}
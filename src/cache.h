@@ -0,0 +1,39 @@
+#ifndef BFSS_CACHE_H
+#define BFSS_CACHE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+struct conf_mat;
+struct eval;
+
+/* Persistent evaluation cache. Confusion matrices are stored in a file of the
+   directory "dir", which is named after the evaluation context, see
+   eval_context(). Subsets are identified by the same keys as
+   in the transposition table, see memo_key().
+
+   The file is a header followed by fixed-size records, and is only ever
+   appended to, so that several processes can share it. Records present when
+   the cache is opened are mapped in memory; new records are buffered and
+   appended while holding an exclusive lock on the file.
+ */
+struct cache;
+
+struct cache *cache_open(const char *dir, const struct eval *);
+
+// Writes the pending records and closes the cache.
+void cache_close(struct cache *);
+
+/* Copies the matrix of a subset into "mat" and returns true if it is known.
+   A NULL cache is empty, and ignores appended records.
+ */
+bool cache_lookup(struct cache *, const uint32_t *key, struct conf_mat *mat);
+
+void cache_append(struct cache *, const uint32_t *key, const struct conf_mat *mat);
+
+size_t cache_hits(const struct cache *);
+// Including the records not written yet.
+size_t cache_records_added(const struct cache *);
+
+#endif
@@ -0,0 +1,196 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include "checkpoint.h"
+#include "dataset.h"
+#include "buffer.h"
+#include "common.h"
+#include "cmd.h"
+
+/* Text format, one item per line:
+
+      bayes_fss checkpoint 1
+      dataset <hash> <number of features>
+      search <mode>
+      step <integer>
+      evaluations <integer>
+      best_score <float, in hexadecimal notation>
+      column <number> active [<numbers of the columns joined with it>...]
+      column <number> merged
+      column <number> inactive
+ */
+#define CHECKPOINT_VERSION 1
+
+void checkpoint_write(const struct dataset *data, const char *path,
+                      const struct checkpoint *ckpt)
+{
+   struct buffer tmp_path = BUFFER_INIT;
+   buffer_cat(&tmp_path, path, strlen(path));
+   buffer_cat(&tmp_path, ".tmp", 4);
+   
+   FILE *fp = fopen(tmp_path.data, "w");
+   if (!fp)
+      die("can't create checkpoint at %s: %s", tmp_path.data, strerror(errno));
+   
+   fprintf(fp, "bayes_fss checkpoint %d\n", CHECKPOINT_VERSION);
+   fprintf(fp, "dataset %016" PRIx64 " %zu\n", data->hash, data->num_features);
+   fprintf(fp, "search %s\n", ckpt->search_mode);
+   fprintf(fp, "step %zu\n", ckpt->step);
+   fprintf(fp, "evaluations %zu\n", ckpt->num_evals);
+   fprintf(fp, "best_score %a\n", ckpt->best_score);
+   
+   const uint32_t *origins = ckpt->origins;
+   for (size_t i = 0; i < data->num_features; i++) {
+      fprintf(fp, "column %zu ", i);
+      if (origins[i] == i) {
+         fputs("active", fp);
+         for (size_t j = 0; j < data->num_features; j++)
+            if (j != i && origins[j] == i)
+               fprintf(fp, " %zu", j);
+      } else if (origins[i] != UINT32_MAX) {
+         fputs("merged", fp);
+      } else {
+         fputs("inactive", fp);
+      }
+      putc('\n', fp);
+   }
+   
+   if (ferror(fp) | fclose(fp))
+      die("can't write checkpoint at %s: %s", tmp_path.data, strerror(errno));
+   if (rename(tmp_path.data, path))
+      die("can't rename %s to %s: %s", tmp_path.data, path, strerror(errno));
+   
+   buffer_fini(&tmp_path);
+}
+
+struct reader {
+   const struct dataset *data;
+   const char *path;
+   FILE *fp;
+   char *line;
+   size_t line_alloc;
+   size_t line_no;
+};
+
+noreturn static void die_checkpoint(const struct reader *rd, const char *msg)
+{
+   die("invalid checkpoint at %s:%zu: %s", rd->path, rd->line_no, msg);
+}
+
+// Returns the value of the next line, which must start with "name".
+static char *read_field(struct reader *rd, const char *name)
+{
+   ssize_t len = getline(&rd->line, &rd->line_alloc, rd->fp);
+   if (len < 0) {
+      if (ferror(rd->fp))
+         die("can't read checkpoint at %s: %s", rd->path, strerror(errno));
+      die_checkpoint(rd, "unexpected end of file");
+   }
+   rd->line_no++;
+   if (len && rd->line[len - 1] == '\n')
+      rd->line[len - 1] = '\0';
+   
+   size_t name_len = strlen(name);
+   if (strncmp(rd->line, name, name_len) || rd->line[name_len] != ' ')
+      die_checkpoint(rd, "unexpected field");
+   return &rd->line[name_len + 1];
+}
+
+static size_t parse_size(const struct reader *rd, char *str, char **end)
+{
+   errno = 0;
+   unsigned long long value = strtoull(str, end, 10);
+   if (*end == str || errno || value > SIZE_MAX)
+      die_checkpoint(rd, "invalid integer");
+   return value;
+}
+
+enum { ACTIVE, MERGED, INACTIVE };
+
+static void set_origin(const struct reader *rd, uint32_t *origins, size_t col_no,
+                       size_t origin)
+{
+   if (col_no >= rd->data->num_features)
+      die_checkpoint(rd, "invalid column number");
+   if (origins[col_no] != UINT32_MAX)
+      die_checkpoint(rd, "column used twice");
+   origins[col_no] = origin;
+}
+
+static int read_column(struct reader *rd, size_t col_no, uint32_t *origins)
+{
+   char *str = read_field(rd, "column"), *end;
+   if (parse_size(rd, str, &end) != col_no || *end != ' ')
+      die_checkpoint(rd, "invalid column number");
+   str = end + 1;
+   
+   if (!strcmp(str, "merged"))
+      return MERGED;
+   if (!strcmp(str, "inactive"))
+      return INACTIVE;
+   if (strncmp(str, "active", 6) || (str[6] && str[6] != ' '))
+      die_checkpoint(rd, "invalid column state");
+   
+   set_origin(rd, origins, col_no, col_no);
+   for (str += 6; *str; str = end)
+      set_origin(rd, origins, parse_size(rd, str, &end), col_no);
+   return ACTIVE;
+}
+
+void checkpoint_read(const struct dataset *data, const char *path, struct checkpoint *ckpt)
+{
+   struct reader reader = {
+      .data = data,
+      .path = path,
+      .fp = fopen(path, "r"),
+   }, *rd = &reader;
+   if (!rd->fp)
+      die("can't open checkpoint at %s: %s", path, strerror(errno));
+   
+   char *str = read_field(rd, "bayes_fss"), *end;
+   char version[32];
+   snprintf(version, sizeof version, "checkpoint %d", CHECKPOINT_VERSION);
+   if (strcmp(str, version))
+      die_checkpoint(rd, "unsupported version");
+   
+   str = read_field(rd, "dataset");
+   errno = 0;
+   uint64_t hash = strtoull(str, &end, 16);
+   if (end == str || *end != ' ' || errno)
+      die_checkpoint(rd, "invalid dataset hash");
+   if (hash != data->hash || parse_size(rd, end + 1, &end) != data->num_features)
+      die("checkpoint at %s was made with another dataset", path);
+   
+   ckpt->search_mode = xstrdup(read_field(rd, "search"));
+   ckpt->step = parse_size(rd, read_field(rd, "step"), &end);
+   ckpt->num_evals = parse_size(rd, read_field(rd, "evaluations"), &end);
+   
+   str = read_field(rd, "best_score");
+   ckpt->best_score = strtod(str, &end);
+   if (end == str)
+      die_checkpoint(rd, "invalid score");
+   
+   uint32_t *origins = xmalloc(data->num_features * sizeof *origins);
+   for (size_t i = 0; i < data->num_features; i++)
+      origins[i] = UINT32_MAX;
+   
+   int *states = xmalloc(data->num_features * sizeof *states);
+   for (size_t i = 0; i < data->num_features; i++)
+      states[i] = read_column(rd, i, origins);
+   
+   // Links may refer to columns that come later, so we can only check merged
+   // columns now.
+   for (size_t i = 0; i < data->num_features; i++) {
+      if ((states[i] == MERGED) != (origins[i] != UINT32_MAX && origins[i] != i)
+          || (states[i] == INACTIVE) != (origins[i] == UINT32_MAX))
+         die("invalid checkpoint at %s: inconsistent state of column %zu", path, i);
+   }
+   free(states);
+   
+   ckpt->origins = origins;
+   free(rd->line);
+   fclose(rd->fp);
+}
@@ -0,0 +1,32 @@
+#ifndef BFSS_CHECKPOINT_H
+#define BFSS_CHECKPOINT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct dataset;
+
+/* Committed state of a search. The feature subset is given as an array with
+   one element per feature: the number of the column its group is named after,
+   or UINT32_MAX if the feature is not used. A group is thus named after the
+   feature "i" for which origins[i] == i.
+ */
+struct checkpoint {
+   const char *search_mode;
+   size_t step;            // Number of steps done.
+   size_t num_evals;       // Number of subsets evaluated.
+   double best_score;
+   uint32_t *origins;
+};
+
+/* Checkpoints are written to a temporary file which is then renamed, so that a
+   crash while writing doesn't destroy the previous checkpoint.
+ */
+void checkpoint_write(const struct dataset *, const char *path, const struct checkpoint *);
+
+/* Allocates "search_mode" and "origins". Dies if the checkpoint doesn't match
+   the dataset.
+ */
+void checkpoint_read(const struct dataset *, const char *path, struct checkpoint *);
+
+#endif
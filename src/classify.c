@@ -0,0 +1,361 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "classify.h"
+#include "buffer.h"
+#include "model.h"
+#include "pool.h"
+#include "common.h"
+#include "cmd.h"
+
+// Input given to each task.
+#define BATCH_SIZE (1 << 20)
+
+// Batches classified at once, per thread.
+#define BATCHES_PER_THREAD 4
+
+static struct {
+   const char *model_path;
+   bool scores;
+   size_t num_threads;
+   const char *input_path;
+   FILE *in;
+
+   struct model model;
+   size_t num_fields;                  // Columns of the input, the label excluded.
+   uint32_t *field_features;           // Feature of each column, or MODEL_NONE.
+   size_t *label_lengths;
+} g_classify = {
+   .num_threads = 1,
+};
+
+// Scratch space of a thread, allocated once.
+struct worker {
+   const char **fields;                // num_fields + 1
+   size_t *lengths;
+   uint32_t *value_ids;                // Of each feature of the model.
+   double *scores;                     // Of each label.
+};
+
+// Complete lines of the input, and their output.
+struct batch {
+   const char *data;
+   size_t size;
+   size_t num_lines;
+   bool failed;                        // On the last line.
+   char error[128];
+   struct buffer out;
+};
+
+static struct pool *g_pool;
+static struct worker *g_workers;
+static struct batch *g_batches;
+static size_t g_num_batches;
+
+static struct buffer g_input = BUFFER_INIT;
+static size_t g_line_no;
+
+static bool fail(struct batch *batch, const char *format, ...)
+{
+   va_list ap;
+   va_start(ap, format);
+   vsnprintf(batch->error, sizeof batch->error, format, ap);
+   va_end(ap);
+   batch->failed = true;
+   return false;
+}
+
+static void cat_score(struct buffer *out, double score)
+{
+   buffer_ensure(out, out->size + 32);
+   out->size += snprintf(&out->data[out->size], 32, "\t%.6f", score);
+}
+
+static bool classify_line(struct worker *w, struct batch *batch, const char *line,
+                          size_t size)
+{
+   const struct model *model = &g_classify.model;
+   const struct model_header *header = model->header;
+   size_t num_fields = 0;
+
+   // Empty fields are skipped, as when loading a dataset.
+   for (size_t pos = 0; pos < size; ) {
+      const char *tab = memchr(&line[pos], '\t', size - pos);
+      size_t end = tab ? (size_t)(tab - line) : size;
+      if (end > pos) {
+         if (num_fields > g_classify.num_fields)
+            return fail(batch, "excess fields (expected merely %zu, plus the label)",
+                        g_classify.num_fields);
+         w->fields[num_fields] = &line[pos];
+         w->lengths[num_fields++] = end - pos;
+      }
+      pos = end + 1;
+   }
+   if (num_fields < g_classify.num_fields)
+      return fail(batch, "not enough fields (expected %zu, found only %zu), maybe there is an empty field?",
+                  g_classify.num_fields, num_fields);
+
+   // The label, if given, is skipped.
+   size_t first = num_fields - g_classify.num_fields;
+   for (size_t i = 0; i < g_classify.num_fields; i++) {
+      uint32_t feat_no = g_classify.field_features[i];
+      if (feat_no != MODEL_NONE)
+         w->value_ids[feat_no] = model_value(model, &model->features[feat_no],
+                                             w->fields[first + i], w->lengths[first + i]);
+   }
+
+   memcpy(w->scores, model->priors, header->num_labels * sizeof *w->scores);
+   for (size_t i = 0; i < header->num_groups; i++) {
+      const struct model_group *group = &model->groups[i];
+      uint32_t type = model_type(model, group, &w->value_ids[group->first_feature]);
+      const double *log_probs = model_log_probs(model, group, type);
+      for (size_t j = 0; j < header->num_labels; j++)
+         w->scores[j] += log_probs[j];
+   }
+
+   size_t best = 0;
+   for (size_t j = 1; j < header->num_labels; j++)
+      if (w->scores[j] > w->scores[best])
+         best = j;
+
+   struct buffer *out = &batch->out;
+   buffer_cat(out, model_string(model, model->labels[best]), g_classify.label_lengths[best]);
+   if (g_classify.scores)
+      for (size_t j = 0; j < header->num_labels; j++)
+         cat_score(out, w->scores[j]);
+   buffer_catc(out, '\n');
+   return true;
+}
+
+static void classify_batch(size_t worker_no, size_t batch_no, void *arg)
+{
+   (void)arg;
+   struct worker *w = &g_workers[worker_no];
+   struct batch *batch = &g_batches[batch_no];
+
+   buffer_clear(&batch->out);
+   batch->num_lines = 0;
+   batch->failed = false;
+   for (size_t pos = 0; pos < batch->size; ) {
+      const char *nl = memchr(&batch->data[pos], '\n', batch->size - pos);
+      size_t end = nl ? (size_t)(nl - batch->data) : batch->size;
+      batch->num_lines++;
+      if (!classify_line(w, batch, &batch->data[pos], end - pos))
+         return;
+      pos = end + 1;
+   }
+}
+
+// Reads until "size" bytes are buffered. Returns false at the end of the input.
+static bool read_input(size_t size)
+{
+   while (g_input.size < size) {
+      buffer_ensure(&g_input, size);
+      size_t len = fread(&g_input.data[g_input.size], 1, size - g_input.size, g_classify.in);
+      g_input.size += len;
+      if (ferror(g_classify.in))
+         die("IO error while reading %s: %s", g_classify.input_path, strerror(errno));
+      if (!len)
+         return false;
+   }
+   return true;
+}
+
+// Drops the first "size" bytes of the input buffer.
+static void consume_input(size_t size)
+{
+   memmove(g_input.data, &g_input.data[size], g_input.size - size);
+   g_input.size -= size;
+}
+
+// Size of the complete lines at the start of the input buffer.
+static size_t complete_lines(void)
+{
+   size_t size = g_input.size;
+   while (size && g_input.data[size - 1] != '\n')
+      size--;
+   return size;
+}
+
+// Finds the features of the model among the columns named in the header.
+static void read_header(void)
+{
+   const struct model *model = &g_classify.model;
+   const struct model_header *header = model->header;
+   const char *nl;
+   bool more = true;
+
+   while (!(nl = memchr(g_input.data, '\n', g_input.size)) && more)
+      more = read_input(g_input.size + BATCH_SIZE);
+   size_t size = nl ? (size_t)(nl - g_input.data) : g_input.size;
+   if (!size && !nl)
+      die("invalid format at %s:1: empty file", g_classify.input_path);
+
+   size_t fields_alloc = 0;
+   g_input.data[size] = '\0';
+   for (char *name = strtok(g_input.data, "\t"); name; name = strtok(NULL, "\t")) {
+      uint32_t feat_no = 0;
+      while (feat_no < header->num_features
+             && strcmp(model_string(model, model->features[feat_no].name), name))
+         feat_no++;
+      if (feat_no == header->num_features) {
+         feat_no = MODEL_NONE;
+      } else {
+         for (size_t i = 0; i < g_classify.num_fields; i++)
+            if (g_classify.field_features[i] == feat_no)
+               die("invalid format at %s:1: duplicate column: %s", g_classify.input_path, name);
+      }
+      ENLARGE(g_classify.field_features, g_classify.num_fields + 1, fields_alloc, 16);
+      g_classify.field_features[g_classify.num_fields++] = feat_no;
+   }
+   consume_input(nl ? size + 1 : size);
+   g_line_no = 1;
+
+   for (uint32_t feat_no = 0; feat_no < header->num_features; feat_no++) {
+      size_t i = 0;
+      while (i < g_classify.num_fields && g_classify.field_features[i] != feat_no)
+         i++;
+      if (i == g_classify.num_fields)
+         die("no column named %s in %s",
+             model_string(model, model->features[feat_no].name), g_classify.input_path);
+   }
+}
+
+static void write_header(FILE *out)
+{
+   const struct model *model = &g_classify.model;
+   for (size_t i = 0; i < model->header->num_labels; i++) {
+      fputc('\t', out);
+      fputs(model_string(model, model->labels[i]), out);
+   }
+   fputc('\n', out);
+}
+
+// Splits "size" bytes of complete lines in batches, of which it returns the number.
+static size_t split_batches(size_t size)
+{
+   size_t num_batches = 0;
+   for (size_t pos = 0; pos < size; num_batches++) {
+      size_t end = size;
+      if (size - pos > BATCH_SIZE) {
+         const char *nl = memchr(&g_input.data[pos + BATCH_SIZE], '\n',
+                                 size - pos - BATCH_SIZE);
+         if (nl)
+            end = nl - g_input.data + 1;
+      }
+      if (num_batches == g_num_batches) {
+         g_batches = xrealloc(g_batches, (g_num_batches + 1) * sizeof *g_batches);
+         g_batches[g_num_batches++] = (struct batch){.out = BUFFER_INIT};
+      }
+      g_batches[num_batches].data = &g_input.data[pos];
+      g_batches[num_batches].size = end - pos;
+      pos = end;
+   }
+   return num_batches;
+}
+
+static void write_batches(size_t num_batches, FILE *out)
+{
+   for (size_t i = 0; i < num_batches; i++) {
+      const struct batch *batch = &g_batches[i];
+      if (batch->failed)
+         die("invalid format at %s:%zu: %s", g_classify.input_path,
+             g_line_no + batch->num_lines, batch->error);
+      g_line_no += batch->num_lines;
+      fwrite(batch->out.data, 1, batch->out.size, out);
+   }
+}
+
+static void classify_input(FILE *out)
+{
+   size_t chunk_size = g_classify.num_threads * BATCHES_PER_THREAD * BATCH_SIZE;
+   bool more = true;
+
+   while (more || g_input.size) {
+      more = read_input(chunk_size);
+      size_t size = more ? complete_lines() : g_input.size;
+
+      // A line longer than a chunk.
+      while (!size && more) {
+         more = read_input(g_input.size + BATCH_SIZE);
+         size = more ? complete_lines() : g_input.size;
+      }
+
+      size_t num_batches = split_batches(size);
+      pool_run(g_pool, num_batches, classify_batch, NULL);
+      write_batches(num_batches, out);
+      consume_input(size);
+   }
+}
+
+static void init_workers(void)
+{
+   const struct model_header *header = g_classify.model.header;
+   size_t num_threads = g_classify.num_threads;
+
+   g_workers = xmalloc(num_threads * sizeof *g_workers);
+   for (size_t i = 0; i < num_threads; i++) {
+      g_workers[i] = (struct worker){
+         .fields = xmalloc((g_classify.num_fields + 1) * sizeof(const char *)),
+         .lengths = xmalloc((g_classify.num_fields + 1) * sizeof(size_t)),
+         .value_ids = xmalloc((header->num_features + 1) * sizeof(uint32_t)),
+         .scores = xmalloc(header->num_labels * sizeof(double)),
+      };
+   }
+
+   g_classify.label_lengths = xmalloc(header->num_labels * sizeof *g_classify.label_lengths);
+   for (size_t i = 0; i < header->num_labels; i++)
+      g_classify.label_lengths[i] = strlen(model_string(&g_classify.model,
+                                                        g_classify.model.labels[i]));
+}
+
+noreturn void classify(int argc, char **argv, const char *help)
+{
+   // Drop the command name.
+   argv[1] = argv[0];
+   argc--;
+   argv++;
+
+   struct option options[] = {
+      {'\0', "model",   OPT_STR(g_classify.model_path)    },
+      {'\0', "scores",  OPT_BOOL(g_classify.scores)       },
+      {'j',  "threads", OPT_SIZE_T(g_classify.num_threads)},
+      {0},
+   };
+   parse_options(options, help, &argc, &argv);
+
+   if (!g_classify.model_path)
+      die("the classify command requires --model");
+   if (!g_classify.num_threads)
+      die("--threads must be > 0");
+   if (argc > 1)
+      die("excess arguments");
+
+   if (!argc || !strcmp(*argv, "-")) {
+      g_classify.input_path = "the standard input";
+      g_classify.in = stdin;
+   } else {
+      g_classify.input_path = *argv;
+      g_classify.in = fopen(*argv, "r");
+      if (!g_classify.in)
+         die("can't open input at %s: %s", *argv, strerror(errno));
+   }
+
+   model_open(&g_classify.model, g_classify.model_path);
+   read_header();
+   init_workers();
+   g_pool = pool_new(g_classify.num_threads);
+
+   if (g_classify.scores)
+      write_header(stdout);
+   classify_input(stdout);
+
+   if (fflush(stdout) || ferror(stdout))
+      die("can't write output: %s", strerror(errno));
+   exit(EXIT_SUCCESS);
+}
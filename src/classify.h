@@ -0,0 +1,24 @@
+#ifndef BFSS_CLASSIFY_H
+#define BFSS_CLASSIFY_H
+
+#include <stdnoreturn.h>
+
+/* The classify command: "bayes_fss classify --model=PATH [OPTIONS] [INPUT]"
+   predicts the label of each sample of INPUT, or of the standard input if it
+   is missing or "-", with a model saved by --save-model. The input is in the
+   format of datasets: its first line names the columns, and the following ones
+   contain the values of a sample, optionally preceded by its label, which is
+   ignored. Columns which aren't features of the model are ignored too.
+
+   One line is output for each sample, in the order of the input, with the
+   predicted label. With --scores, it is followed by the log2 probabilities of
+   all the labels, and a first line gives the names of the labels.
+
+   The input is read in large chunks, which are split in batches of lines
+   classified by a pool of threads; the output of each batch is written in
+   order once they are all done. "argv" is the full argument vector of the
+   program, and "help" its help screen.
+ */
+noreturn void classify(int argc, char **argv, const char *help);
+
+#endif
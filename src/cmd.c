@@ -9,11 +9,22 @@
 
 const char *g_progname = "program";
 
+_Thread_local struct die_handler *g_die_handler;
+
 noreturn void die(const char *msg, ...)
 {
+   va_list ap;
+   
+   struct die_handler *handler = g_die_handler;
+   if (handler) {
+      va_start(ap, msg);
+      vsnprintf(handler->msg, sizeof handler->msg, msg, ap);
+      va_end(ap);
+      longjmp(handler->env, 1);
+   }
+   
    fprintf(stderr, "%s: ", g_progname);
    
-   va_list ap;
    va_start(ap, msg);
    vfprintf(stderr, msg, ap);
    va_end(ap);
@@ -274,3 +285,23 @@ void parse_options(struct option *options, const char *help,
    *argcp -= i;
    *argvp += i;
 }
+
+void set_option(struct option *options, const char *name, const char *arg)
+{
+   struct option *option = long_option(options, name);
+   
+   if (option->type == OPT_FUNC)
+      die("option --%s can't be set here", name);
+   if (option->type == OPT_BOOL && arg) {
+      if (!strcmp(arg, "true") || !strcmp(arg, "false"))
+         *option->b = !strcmp(arg, "true");
+      else
+         die("invalid argument '%s' for option --%s", arg, name);
+      return;
+   }
+   if (needs_arg[option->type] && !arg)
+      die("option --%s requires an argument", name);
+   if (!needs_arg[option->type] && arg)
+      die("option --%s doesn't accept an argument, have '%s'", name, arg);
+   handle_option(option, arg);
+}
@@ -5,12 +5,25 @@
 #include <stdarg.h>
 #include <stdbool.h>
 #include <stdnoreturn.h>
+#include <setjmp.h>
 
 extern const char *g_progname;
 
 void warn(const char *, ...);
 noreturn void die(const char *, ...);
 
+/* When a handler is installed on the calling thread, die() writes the error
+   message to "msg" and returns to "env" instead of exiting the program. This is
+   how the library reports errors, and how the threads of a pool hand theirs
+   over to the thread that runs it, see pool_run().
+ */
+struct die_handler {
+   jmp_buf env;
+   char msg[256];
+};
+
+extern _Thread_local struct die_handler *g_die_handler;
+
 struct command {
    const char *name;    // NULL serves as a sentinel.
    void (*func)(int argc, char **argv);
@@ -66,4 +79,10 @@ struct option {
 void parse_options(struct option *options, const char *help_screen,
                    int *argc, char ***argv);
 
+/* Sets a single option, as if "--name=arg" was given on the command line.
+   "arg" can also be "true" or "false" for boolean options, or NULL, which
+   means "true". Options that call a function can't be set this way.
+ */
+void set_option(struct option *options, const char *name, const char *arg);
+
 #endif
@@ -1,19 +1,19 @@
+#include <math.h>
 #include <string.h>
 #include "column.h"
 #include "common.h"
 #include "dataset.h"
 #include "eval.h"
+#include "stats.h"
 
 #define TABLE_INIT_SIZE 4        // We can very well have few attributes, so
                                  // don't make tables too large per default.
 #define TABLE_GROWTH_FACTOR 2    // Must produce powers of two.
 
-static struct feature *g_free_list;
-
-static void feature_free(struct feature *feat)
+static void feature_free(struct table *table, struct feature *feat)
 {
-   feat->next = g_free_list;
-   g_free_list = feat;
+   feat->next = table->free_list;
+   table->free_list = feat;
 }
 
 static uint32_t feature_hash(const void *key)
@@ -31,12 +31,16 @@ static bool feature_equal(const void *restrict x, const void *restrict y)
 }
 
 // Maybe allocate from a pool?
-static struct feature *feature_alloc(const void *key)
+static struct feature *feature_alloc(struct table *table, const void *key)
 {
+   (void)table;
+   
    size_t key_size = strlen(key) + 1;
    size_t total = offsetof(struct feature, value) + key_size;
-   if (total < g_data.feature_size)
-      total = g_data.feature_size;
+   // The structure might be reused for a linked feature if the column is
+   // merged with another one.
+   if (total < sizeof(struct feature))
+      total = sizeof(struct feature);
    
    struct feature *feat = xmalloc(total);
    feat->next = NULL;
@@ -47,28 +51,27 @@ static struct feature *feature_alloc(const void *key)
 
 static uint32_t linked_feature_hash(const void *key_)
 {
-   const struct feature *const *key = key_;
-   assert(key[0] != key[1]);
+   const uint32_t *key = key_;
    
-   uint32_t hash = (uint32_t)(uintptr_t)key[0] + (uint32_t)(uintptr_t)key[1];
-   return (hash * 324027) >> 13;
+   uint32_t hash = key[0] * 2654435761U ^ key[1] * 2246822519U;
+   return hash ^ (hash >> 16);
 }
 
 static bool linked_feature_equal(const void *restrict x, const void *restrict y)
 {
-   return !memcmp(x, y, sizeof(struct feature *[2]));
+   return !memcmp(x, y, sizeof(uint32_t[2]));
 }
 
-static struct feature *linked_feature_alloc(const void *key)
+static struct feature *linked_feature_alloc(struct table *table, const void *key)
 {
-   struct feature *feat = g_free_list;
+   struct feature *feat = table->free_list;
    if (feat)
-      g_free_list = feat->next;
+      table->free_list = feat->next;
    else
-      feat = xmalloc(g_data.feature_size);
+      feat = xmalloc(sizeof *feat);
 
    feat->next = NULL;
-   memcpy(feat->sub_features, key, sizeof(struct feature *[2]));
+   memcpy(feat->sub_features, key, sizeof(uint32_t[2]));
 
    return feat;
 }
@@ -76,7 +79,7 @@ static struct feature *linked_feature_alloc(const void *key)
 struct table_vtab {
    uint32_t (*hash)(const void *);
    bool (*equal)(const void *restrict, const void *restrict);
-   struct feature *(*alloc)(const void *);
+   struct feature *(*alloc)(struct table *, const void *);
 };
 
 static const struct table_vtab feature_vtab = {
@@ -91,10 +94,11 @@ static const struct table_vtab linked_feature_vtab = {
    .alloc = linked_feature_alloc,
 };
 
-static void table_init(struct table *table, const struct table_vtab *vtab)
+static void table_init(struct table *table, const struct table_vtab *vtab,
+                       size_t num_samples)
 {
    *table = (struct table){
-      .samples = xmalloc(g_data.num_samples * sizeof *table->samples),
+      .samples = xmalloc(num_samples * sizeof *table->samples),
       .table = xcalloc(TABLE_INIT_SIZE, sizeof *table->table),
       .size = TABLE_INIT_SIZE,
       .mask = TABLE_INIT_SIZE - 1,
@@ -150,78 +154,92 @@ static void table_add(struct table *table, uint32_t sample_no, const void *key)
    struct feature *feat = *featp;
    
    if (!feat) {
-      feat = *featp = table->vtab->alloc(key);
+      feat = *featp = table->vtab->alloc(table, key);
+      feat->id = table->num_types;
       if (++table->num_types == table->resize_threshold)
          table_resize(table);
    }
    
-   table->samples[sample_no] = feat;
+   table->samples[sample_no] = feat->id;
 }
 
-void column_init(struct column *column, const char *name, uint32_t *links)
+void column_init(struct column *column, const struct dataset *data, const char *name,
+                 uint32_t *links)
 {
+   column->data = data;
    column->name = (struct buffer)BUFFER_INIT;
+   column->origin = 0;
    if (name) {
       buffer_set_json(&column->name, name);
-      table_init(&column->table, &feature_vtab);
+      column->origin = column - data->columns;
+      table_init(&column->table, &feature_vtab, data->num_samples);
    } else {
-      assert(column == &g_data.columns[g_data.num_features]);
-      table_init(&column->table, &linked_feature_vtab);
+      table_init(&column->table, &linked_feature_vtab, data->num_samples);
    }
    column->links = links;
    column->num_links = 0;
    column->state = COL_INACTIVE;
 }
 
-void column_add(struct column *column, uint32_t sample_no, const void *key)
+struct column *column_alloc_joined(const struct dataset *data)
 {
-   table_add(&column->table, sample_no, key);
+   struct column *column = xmalloc(sizeof *column);
+   column_init(column, data, NULL, xcalloc(data->links_size, sizeof *column->links));
+   return column;
 }
 
-static void table_zero(struct table *table)
+void column_add(struct column *column, uint32_t sample_no, const void *key)
 {
-   size_t size = table->size;
-   struct feature **buckets = table->table;
-   size_t freqs_size = sizeof(uint32_t[g_data.num_labels]);
-   
-   for (size_t i = 0; i < size; i++) {
-      for (struct feature *feat = buckets[i]; feat; feat = feat->next) {
-         feat->seen = false;
-         memset(feat->freqs, 0, freqs_size);
-      }
-   }
+   table_add(&column->table, sample_no, key);
 }
 
-static uint32_t count_samples(struct feature **samples, size_t start, size_t end)
+static uint32_t count_samples(const struct dataset *data, const uint32_t *samples,
+                              uint32_t *freqs, size_t start, size_t end)
 {
    uint32_t num_types = 0;
-   const uint32_t *labels = g_data.samples_labels;
+   const uint32_t *labels = data->samples_labels;
+   const size_t row_size = COLUMN_ROW_SIZE(data->num_labels);
    
    while (start < end) {
-      struct feature *sample = samples[start];
-      if (!sample->seen) {
-         sample->seen = true;
+      uint32_t *row = &freqs[samples[start] * row_size];
+      if (!row[0]) {
+         row[0] = true;
          num_types++;
       }
-      sample->freqs[labels[start]]++;
+      row[1 + labels[start]]++;
       start++;
    }
    return num_types;
 }
 
-uint32_t column_count(struct column *column, size_t test_start, size_t test_end)
+void column_zero(const struct column *column, uint32_t *freqs)
 {
-   assert(column->state == COL_ACTIVE);
+   size_t row_size = COLUMN_ROW_SIZE(column->data->num_labels);
+   memset(freqs, 0, column->table.num_types * row_size * sizeof *freqs);
+}
+
+uint32_t column_count_range(const struct column *column, uint32_t *freqs,
+                            size_t start, size_t end)
+{
+   assert(start <= end && end <= column->data->num_samples);
    
-   table_zero(&column->table);
+   return count_samples(column->data, column->table.samples, freqs, start, end);
+}
+
+uint32_t column_count(const struct column *column, uint32_t *freqs,
+                      size_t test_start, size_t test_end)
+{
+   column_zero(column, freqs);
    
-   struct feature **samples = column->table.samples;
-   return count_samples(samples, 0, test_start)
-        + count_samples(samples, test_end, g_data.num_samples);
+   return column_count_range(column, freqs, 0, test_start)
+        + column_count_range(column, freqs, test_end, column->data->num_samples);
 }
 
 static void table_clear(struct table *table)
 {
+   if (!table->table)
+      return;
+   
    const size_t size = table->size;
    struct feature **buckets = table->table;
    
@@ -229,7 +247,7 @@ static void table_clear(struct table *table)
       struct feature *feat = buckets[i];
       while (feat) {
          struct feature *next = feat->next;
-         feature_free(feat);
+         feature_free(table, feat);
          feat = next;
       }
    }
@@ -243,21 +261,24 @@ static void table_mutate(struct table *table)
    table->vtab = &linked_feature_vtab;
 }
 
-static void add_link(uint32_t *links, uint32_t feat_no)
+static void add_link(const struct dataset *data, uint32_t *links, const struct column *col)
 {
-   assert(feat_no < g_data.num_features);
+   size_t feat_no = col - data->columns;
+   assert(feat_no < data->num_features);
    links[feat_no >> 5] |= 1 << (feat_no & 31);
 }
 
-static void join_links(struct column *restrict x,
-                       const struct column *restrict y,
+void column_join_links(struct column *restrict x, const struct column *restrict y,
                        const struct column *restrict z)
 {
-   for (size_t i = 0; i < g_data.links_size; i++)
+   const struct dataset *data = x->data;
+   
+   for (size_t i = 0; i < data->links_size; i++)
       x->links[i] = y->links[i] | z->links[i];
 
    x->name = y->name;
-   add_link(x->links, z - g_data.columns);
+   x->origin = y->origin;
+   add_link(data, x->links, z);
    
    x->num_links = y->num_links + z->num_links + 1;
 }
@@ -266,40 +287,120 @@ void column_join(struct column *restrict x, const struct column *restrict y,
                  const struct column *restrict z)
 {
    assert(x != y && y != z && x != z);
-   assert(x == &g_data.columns[g_data.num_features]);
-   assert(x->vtab == &joined_vtab);
-   assert(x->state == COL_ACTIVE);
-   assert(y->state == COL_INACTIVE && z->state == COL_INACTIVE);
+   assert(x->table.vtab == &linked_feature_vtab);
+   assert(z >= x->data->columns && z < &x->data->columns[x->data->num_features]);
 
-   join_links(x, y, z);
+   double start = stats_start(STATS_JOIN);
+   column_join_links(x, y, z);
    
    table_clear(&x->table);
 
-   struct feature **y_samples = y->table.samples;
-   struct feature **z_samples = z->table.samples;
-   size_t nr = g_data.num_samples;
+   const uint32_t *y_samples = y->table.samples;
+   const uint32_t *z_samples = z->table.samples;
+   size_t nr = x->data->num_samples;
    
    for (size_t i = 0; i < nr; i++) {
-      column_add(x, i, (const struct feature *[]){
+      column_add(x, i, (const uint32_t []){
          y_samples[i],
          z_samples[i],
       });
    }
+   stats_stop(STATS_JOIN, start, 1);
 }
 
 static void table_fini(struct table *table)
 {
    table_clear(table);
+   
+   struct feature *feat = table->free_list;
+   while (feat) {
+      struct feature *next = feat->next;
+      free(feat);
+      feat = next;
+   }
+   
    free(table->table);
    free(table->samples);
+   *table = (struct table){0};
+}
+
+void column_free_joined(struct column *column)
+{
+   table_fini(&column->table);
+   free(column->links);
+   free(column);
+}
+
+void column_fini(struct column *column)
+{
+   table_fini(&column->table);
+   buffer_fini(&column->name);
+}
+
+void column_values(const struct column *column, const char **values)
+{
+   const struct table *table = &column->table;
+   assert(table->vtab == &feature_vtab);
+   
+   for (size_t i = 0; i < table->size; i++)
+      for (const struct feature *feat = table->table[i]; feat; feat = feat->next)
+         values[feat->id] = feat->value;
+}
+
+void column_reset(struct column *column, const uint32_t *samples, size_t num_types)
+{
+   if (column->num_links || column->state == COL_MERGED) {
+      table_fini(&column->table);
+      table_init(&column->table, &feature_vtab, column->data->num_samples);
+      memcpy(column->table.samples, samples, column->data->num_samples * sizeof *samples);
+      column->table.num_types = num_types;
+      memset(column->links, 0, column->data->links_size * sizeof *column->links);
+      column->num_links = 0;
+   }
+   column->state = COL_INACTIVE;
+}
+
+void column_usage(const struct column *column, struct table_usage *usage)
+{
+   const struct table *table = &column->table;
+   
+   *usage = (struct table_usage){
+      .num_types = table->num_types,
+      .num_buckets = table->table ? table->size : 0,
+      .bucket_bytes = table->table ? table->size * sizeof *table->table : 0,
+      .samples_bytes = table->samples ? column->data->num_samples * sizeof *table->samples : 0,
+   };
+   
+   for (size_t i = 0; table->table && i < table->size; i++) {
+      size_t chain = 0;
+      for (const struct feature *feat = table->table[i]; feat; feat = feat->next) {
+         size_t size = sizeof *feat;
+         if (table->vtab == &feature_vtab) {
+            size = offsetof(struct feature, value) + strlen(feat->value) + 1;
+            if (size < sizeof *feat)
+               size = sizeof *feat;
+         }
+         usage->feature_bytes += size;
+         chain++;
+      }
+      if (chain > usage->longest_chain)
+         usage->longest_chain = chain;
+   }
+   
+   for (const struct feature *feat = table->free_list; feat; feat = feat->next) {
+      usage->free_features++;
+      usage->free_bytes += sizeof *feat;
+   }
 }
 
 static void merge_links(struct column *restrict x, const struct column *restrict y)
 {
-   for (size_t i = 0; i < g_data.links_size; i++)
+   const struct dataset *data = x->data;
+   
+   for (size_t i = 0; i < data->links_size; i++)
       x->links[i] |= y->links[i];
    
-   add_link(x->links, y - g_data.columns);
+   add_link(data, x->links, y);
    
    x->num_links += y->num_links + 1;
 }
@@ -309,6 +410,7 @@ void column_merge(struct column *restrict x, struct column *restrict y)
    assert(x != y);
    assert(x->state == COL_ACTIVE && y->state == COL_INACTIVE);
 
+   double start = stats_start(STATS_MERGE);
    merge_links(x, y);
    
    table_clear(&x->table);
@@ -316,16 +418,49 @@ void column_merge(struct column *restrict x, struct column *restrict y)
    
    table_mutate(&x->table);
 
-   struct feature **x_samples = x->table.samples;
-   struct feature **y_samples = y->table.samples;
-   size_t nr = g_data.num_samples;
+   uint32_t *x_samples = x->table.samples;
+   const uint32_t *y_samples = y->table.samples;
+   size_t nr = x->data->num_samples;
    
    for (size_t i = 0; i < nr; i++) {
-      column_add(x, i, (const struct feature *[]){
+      column_add(x, i, (const uint32_t []){
          x_samples[i],
          y_samples[i],
       });
    }
 
    table_fini(&y->table);
+   stats_stop(STATS_MERGE, start, 1);
+}
+
+void column_entropy(const struct column *column, double *values, double *joint)
+{
+   size_t num_labels = column->data->num_labels;
+   size_t row_size = COLUMN_ROW_SIZE(num_labels);
+   size_t num_types = column->table.num_types;
+   
+   uint32_t *freqs = xmalloc(num_types * row_size * sizeof *freqs);
+   column_zero(column, freqs);
+   column_count_range(column, freqs, 0, column->data->num_samples);
+   
+   double values_sum = 0., joint_sum = 0.;
+   
+   for (size_t i = 0; i < num_types; i++) {
+      const uint32_t *row = &freqs[i * row_size];
+      uint32_t total = 0;
+      for (size_t label = 0; label < num_labels; label++) {
+         uint32_t freq = row[1 + label];
+         if (freq) {
+            joint_sum += freq * log2(freq);
+            total += freq;
+         }
+      }
+      if (total)
+         values_sum += total * log2(total);
+   }
+   free(freqs);
+   
+   double num_samples = column->data->num_samples;
+   *values = log2(num_samples) - values_sum / num_samples;
+   *joint = log2(num_samples) - joint_sum / num_samples;
 }
@@ -7,28 +7,24 @@
 
 #include "buffer.h"
 
-/* While creating a hash table, the following union initially stores features
-   values. Features values are no longer needed once the table is built, so
-   we discard them and stuff the frequency vectors at the same place. This
-   reduces memory usage by about 20%. The "next" pointer must still be
-   kept out of the union because we need to traverse the table to zero out
-   features frequencies.
-
-   When linking features, we store the original addresses of the joined
-   features in "sub_features". Allocated features structures that are no
-   longer needed are either reused or marked as dirty, so the pointers in
-   "sub_features" do not actually point to the correct sub-features, though
-   they do point to a valid memory location. This doesn't matter since we don't
-   need to access "sub_features" anymore.
+/* Each distinct feature value of a column is given an identifier, which is its
+   insertion rank in the column hash table. Samples are represented by the
+   identifier of their feature value, so that frequencies can be stored in
+   plain arrays owned by the evaluator, instead of in the features structures
+   themselves. This allows several evaluators to use the same columns at the
+   same time.
+
+   When linking features, we store the identifiers of the joined features in
+   "sub_features". For joined columns that are built from other joined columns,
+   these identifiers refer to the state of the sub-columns at the time the join
+   was made, and might not be valid anymore afterwards. This doesn't matter
+   since we don't need to access "sub_features" once the join is done.
  */
 struct feature {
    struct feature *next;
+   uint32_t id;
    union {
-      struct {
-         uint32_t seen;       // Necessary for counting types. Better idea?
-         uint32_t freqs[];    // Frequency of each label.
-      };
-      struct feature *sub_features[2];
+      uint32_t sub_features[2];
       char value[1];
    };
 };
@@ -36,23 +32,29 @@ struct feature {
 struct table_vtab;
 
 struct table {
-   struct feature **samples;
+   uint32_t *samples;         // Feature identifier of each sample.
    struct feature **table;    // Hash table.
    size_t size;               // Number of buckets.
    size_t mask;               // Hash mask.
    size_t num_types;          // Number of features types.
    size_t resize_threshold;   // Enlarge the table when "num_types" reaches this
                               // value.
+   struct feature *free_list; // Features that can be reused.
    const struct table_vtab *vtab;   // Hash, compare, allocate features.
 };
 
+struct dataset;
+
 struct column {
+   const struct dataset *data;   // Dataset the column belongs to.
    struct buffer name;        // Feature name, encoded as a JSON string.
    uint32_t *links;           // Bitset of features joined with this one.
    size_t num_links;          // Cardinality of the "links" bitset.
+   uint32_t origin;           // Index of the original column this one is named
+                              // after.
    // Column state. TODO: use a stack of column pointers in search.c to avoid
    // messing with this.
-   enum {
+   enum column_state {
       COL_INACTIVE,           // Not in the current feature set but can be added
                               // to it.
       COL_MERGED,             // Not in the current feature set and must not
@@ -62,15 +64,87 @@ struct column {
    struct table table;
 };
 
-void column_init(struct column *, const char *label, uint32_t *links);
+void column_init(struct column *, const struct dataset *, const char *label,
+                 uint32_t *links);
+
+// Allocates a column meant to receive the result of column_join().
+struct column *column_alloc_joined(const struct dataset *);
+
+void column_free_joined(struct column *);
 
 void column_add(struct column *, uint32_t sample_no, const void *key);
 
-uint32_t column_count(struct column *, size_t test_start, size_t test_end);
+/* Frequencies are stored in an array of "num_types" rows, one per feature
+   identifier. The first element of each row is non-zero if the feature was
+   seen, and is followed by the frequency of each label. The counting functions
+   return the number of types seen.
+ */
+#define COLUMN_ROW_SIZE(num_labels) ((num_labels) + 1)
+
+uint32_t column_count(const struct column *, uint32_t *freqs,
+                      size_t test_start, size_t test_end);
 
+/* Lower-level counting functions. column_count() is equivalent to calling
+   column_zero() and then column_count_range() on the samples before and after
+   the test set. The returned number of types is only meaningful when summed
+   over all the ranges counted since the last call of column_zero().
+ */
+void column_zero(const struct column *, uint32_t *freqs);
+uint32_t column_count_range(const struct column *, uint32_t *freqs,
+                            size_t start, size_t end);
+
+/* Joins the columns "y" and "z" into "x", which must have been allocated with
+   column_alloc_joined(). "z" must be an original column. This doesn't modify
+   "y" and "z", so several joins involving the same columns can be made
+   concurrently.
+ */
 void column_join(struct column *restrict, const struct column *restrict,
                  const struct column *restrict);
 
+/* Gives "x" the name and features of the join of "y" and "z", as column_join()
+   does, but not its samples. Enough to describe the join to a remote worker,
+   see remote_eval().
+ */
+void column_join_links(struct column *restrict, const struct column *restrict,
+                       const struct column *restrict);
+
 void column_merge(struct column *restrict, struct column *restrict);
 
+/* Sets values[id] to the value of each feature type of an original column, as
+   read from the dataset. Values are lost once the column is merged or reset.
+ */
+void column_values(const struct column *, const char **values);
+
+// Frees an original column, but not its links, which belong to the dataset.
+void column_fini(struct column *);
+
+/* Restores an original column modified by column_merge() from a copy of its
+   samples made beforehand, and makes it inactive. The feature values are not
+   restored: they are only needed while loading the dataset.
+ */
+void column_reset(struct column *, const uint32_t *samples, size_t num_types);
+
+// Memory used by a column table, see column_usage().
+struct table_usage {
+   size_t num_types;
+   size_t num_buckets;
+   size_t longest_chain;
+   size_t bucket_bytes;
+   size_t feature_bytes;      // Features in the table.
+   size_t free_features;      // Features in the free list.
+   size_t free_bytes;         // Lower bound, see column_usage().
+   size_t samples_bytes;
+};
+
+/* Measures the memory used by a column. Features in the free list may be
+   larger than a linked feature, if they held a feature value before, but are
+   counted as linked features.
+ */
+void column_usage(const struct column *, struct table_usage *);
+
+/* Computes the entropy of the column values, and the joint entropy of the
+   column values and of the labels, in bits, over all samples.
+ */
+void column_entropy(const struct column *, double *values, double *joint);
+
 #endif
@@ -1,5 +1,8 @@
+#define _POSIX_C_SOURCE 200809L
+
 #include <stdio.h>
 #include <string.h>
+#include <time.h>
 #include "common.h"
 #include "cmd.h"
 
@@ -34,3 +37,10 @@ char *xstrdup(const char *str)
    size_t size = strlen(str) + 1;
    return memcpy(xmalloc(size), str, size);
 }
+
+double now(void)
+{
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return ts.tv_sec + ts.tv_nsec / 1e9;
+}
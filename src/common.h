@@ -3,6 +3,7 @@
 
 #include <stdlib.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <assert.h>
 
 void *xmalloc(size_t size);
@@ -13,6 +14,21 @@ void *xrealloc(void *mem, size_t size);
 
 char *xstrdup(const char *str);
 
+// Monotonic clock, in seconds.
+double now(void);
+
+#define HASH_INIT 14695981039346656037ULL
+
+/* FNV-1a of "size" bytes, continuing "hash", which is HASH_INIT for the first
+   bytes. Hashes that are saved or compared across processes are made with it.
+ */
+static inline uint64_t hash_bytes(uint64_t hash, const void *data, size_t size)
+{
+   for (size_t i = 0; i < size; i++)
+      hash = (hash ^ ((const unsigned char *)data)[i]) * 1099511628211ULL;
+   return hash;
+}
+
 #define ENLARGE(buf, size, alloc, init) do {                                   \
    const size_t size_ = (size);                                                \
    assert(size_ > 0);                                                          \
@@ -0,0 +1,150 @@
+#include <limits.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdnoreturn.h>
+#include "config.h"
+#include "common.h"
+#include "cmd.h"
+
+#define VERSION "0.3"
+
+void config_init(struct config *config)
+{
+   *config = (struct config){
+      .num_folds = 5,
+      .smooth = 0.5,
+      .measure_name = "F1",
+      .search_mode = "forward-join",
+      .averaging_mode = "macro",
+      .classification_mode = "multiclass",
+      .max_links = SIZE_MAX,
+      .max_features = SIZE_MAX,
+      .race = false,
+      .race_confidence = 0.95,
+      .lazy = false,
+      .mutual_rank = false,
+      .join_candidates = SIZE_MAX,
+      .max_join_cardinality = SIZE_MAX,
+      .max_model_bytes = SIZE_MAX,
+      .beam_width = SIZE_MAX,
+      .num_threads = 1,
+      .memo_entries = 1 << 16,
+      .time_limit = INFINITY,
+      .max_evals = SIZE_MAX,
+      .report_every = 0.,
+      .progress_fd = SIZE_MAX,
+      .verbose = false,
+      .compact_json = false,
+   };
+}
+
+noreturn static void version(void)
+{
+   const char msg[] =
+   "Bayes FSS version "VERSION"\n"
+   "Copyright (c) 2015-16 Michaël Meyer"
+   ;
+   puts(msg);
+   exit(EXIT_SUCCESS);
+}
+
+struct option *config_options(struct config *config)
+{
+   const struct option options[] = {
+      {'k',  "folds",                OPT_SIZE_T(config->num_folds)                },
+      {'S',  "smooth",               OPT_DOUBLE(config->smooth)                   },
+      {'m',  "mode",                 OPT_STR(config->classification_mode)         },
+      {'t',  "truth",                OPT_STR(config->positive_label_name)         },
+      {'\0', "targets",              OPT_STR(config->targets)                     },
+      {'a',  "average",              OPT_STR(config->averaging_mode)              },
+      {'M',  "measure",              OPT_STR(config->measure_name)                },
+      {'s',  "search",               OPT_STR(config->search_mode)                 },
+      {'L',  "max-links",            OPT_SIZE_T(config->max_links)                },
+      {'F',  "max-features",         OPT_SIZE_T(config->max_features)             },
+      {'\0', "max-join-cardinality", OPT_SIZE_T(config->max_join_cardinality)     },
+      {'\0', "max-model-bytes",      OPT_SIZE_T(config->max_model_bytes)          },
+      {'\0', "race",                 OPT_BOOL(config->race)                       },
+      {'\0', "race-confidence",      OPT_DOUBLE(config->race_confidence)          },
+      {'\0', "lazy",                 OPT_BOOL(config->lazy)                       },
+      {'\0', "mi-rank",              OPT_BOOL(config->mutual_rank)                },
+      {'\0', "join-candidates",      OPT_SIZE_T(config->join_candidates)          },
+      {'\0', "beam-width",           OPT_SIZE_T(config->beam_width)               },
+      {'j',  "threads",              OPT_SIZE_T(config->num_threads)              },
+      {'\0', "processes",            OPT_SIZE_T(config->num_processes)            },
+      {'\0', "connect",              OPT_STR(config->connect_addrs)               },
+      {'\0', "listen",               OPT_STR(config->listen_addr)                 },
+      {'\0', "memo-entries",         OPT_SIZE_T(config->memo_entries)             },
+      {'\0', "cache-dir",            OPT_STR(config->cache_dir)                   },
+      {'\0', "checkpoint",           OPT_STR(config->checkpoint_path)             },
+      {'\0', "resume",               OPT_STR(config->resume_path)                 },
+      {'\0', "save-model",           OPT_STR(config->save_model_path)             },
+      {'\0', "init-subset",          OPT_STR(config->init_subset)                 },
+      {'\0', "sweep",                OPT_STR(config->sweep)                       },
+      {'\0', "time-limit",           OPT_DOUBLE(config->time_limit)               },
+      {'\0', "max-evals",            OPT_SIZE_T(config->max_evals)                },
+      {'\0', "report-every",         OPT_DOUBLE(config->report_every)             },
+      {'\0', "progress",             OPT_SIZE_T(config->progress_fd)              },
+      {'\0', "progress-file",        OPT_STR(config->progress_path)               },
+      {'v',  "verbose",              OPT_BOOL(config->verbose)                    },
+      {'c',  "compact",              OPT_BOOL(config->compact_json)               },
+      {'\0', "stats",                OPT_BOOL(config->stats)                      },
+      {'\0', "perf-counters",        OPT_BOOL(config->perf_counters)              },
+      {'\0', "memory-report",        OPT_BOOL(config->memory_report)              },
+      {'\0', "version",              OPT_FUNC(version)                            },
+      {'\0', 0,                      .z = 0                                       },
+   };
+   return memcpy(xmalloc(sizeof options), options, sizeof options);
+}
+
+void config_check(struct config *config)
+{
+   if (config->num_folds < 2)
+      die("--num-folds must be >= 2");
+   if (config->smooth <= 0.)
+      die("--smooth must be > 0.0");
+   if (config->race_confidence <= 0. || config->race_confidence >= 1.)
+      die("--race-confidence must be > 0.0 and < 1.0");
+   if (!config->beam_width)
+      die("--beam-width must be > 0");
+   if (!config->num_threads)
+      die("--threads must be > 0");
+   if (config->num_threads != 1 && (config->num_processes || config->connect_addrs))
+      die("--threads can't be used with --processes or --connect");
+   if (config->listen_addr && (config->num_processes || config->connect_addrs))
+      die("--listen can't be used with --processes or --connect");
+   if (config->time_limit <= 0.)
+      die("--time-limit must be > 0.0");
+   if (!config->max_evals)
+      die("--max-evals must be > 0");
+   if (config->report_every < 0.)
+      die("--report-every must be >= 0.0");
+   if (config->progress_fd != SIZE_MAX && config->progress_path)
+      die("--progress and --progress-file can't be used together");
+   if (config->progress_fd != SIZE_MAX && config->progress_fd > INT_MAX)
+      die("--progress must be a file descriptor");
+   if ((config->sweep || config->targets) && (config->verbose || config->report_every))
+      die("--%s can't be used with --verbose or --report-every",
+          config->sweep ? "sweep" : "targets");
+   if (config->sweep && (config->checkpoint_path || config->resume_path))
+      die("--sweep can't be used with --checkpoint or --resume");
+   if (config->sweep && config->listen_addr)
+      die("--sweep can't be used with --listen");
+   if (config->targets && (config->sweep || config->listen_addr))
+      die("--targets can't be used with --sweep or --listen");
+   if (config->targets && (config->checkpoint_path || config->resume_path))
+      die("--targets can't be used with --checkpoint or --resume");
+   if (config->save_model_path && (config->sweep || config->targets))
+      die("--save-model can't be used with --sweep or --targets");
+   if (config->perf_counters)
+      config->stats = true;
+   
+   if (!strcmp(config->classification_mode, "binary")) {
+      if (!config->positive_label_name)
+         die("--truth must be given for binary classification");
+   } else if (!strcmp(config->classification_mode, "multiclass")) {
+      if (config->positive_label_name)
+         die("--truth doesn't make sense for multiclass classification");
+   }
+}
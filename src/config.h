@@ -0,0 +1,66 @@
+#ifndef BFSS_CONFIG_H
+#define BFSS_CONFIG_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+struct option;
+
+struct config {
+   const char *dataset_path;
+   const char *targets;
+   const char *positive_label_name;
+   const char *classification_mode;
+   const char *averaging_mode;
+   const char *measure_name;
+   const char *search_mode;
+   size_t max_links;
+   size_t max_features;
+   size_t num_folds;
+   double smooth;
+   bool race;
+   double race_confidence;
+   bool lazy;
+   bool mutual_rank;
+   size_t join_candidates;
+   size_t max_join_cardinality;
+   size_t max_model_bytes;
+   size_t beam_width;
+   size_t num_threads;
+   size_t num_processes;
+   const char *connect_addrs;
+   const char *listen_addr;
+   size_t memo_entries;
+   const char *cache_dir;
+   const char *checkpoint_path;
+   const char *resume_path;
+   const char *save_model_path;
+   const char *init_subset;
+   const char *sweep;
+   double time_limit;
+   size_t max_evals;
+   double report_every;
+   size_t progress_fd;
+   const char *progress_path;
+   bool verbose;
+   bool compact_json;
+   bool stats;
+   bool perf_counters;
+   bool memory_report;
+
+   uint32_t positive_label;
+};
+
+// Sets the default values of all options.
+void config_init(struct config *);
+
+/* Options table of the command-line program, which refers to "config". Ends
+   with a zeroed option, see parse_options(). Must be freed.
+ */
+struct option *config_options(struct config *);
+
+// Dies if the options are invalid or inconsistent.
+void config_check(struct config *);
+
+#endif
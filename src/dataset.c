@@ -1,3 +1,5 @@
+#define _POSIX_C_SOURCE 200809L
+
 #include <stdio.h>
 #include <string.h>
 #include <errno.h>
@@ -5,218 +7,414 @@
 #include <stdnoreturn.h>
 
 #include "dataset.h"
+#include "bfss.h"
 #include "buffer.h"
 #include "eval.h"
+#include "stats.h"
 #include "common.h"
 #include "cmd.h"
 
-struct dataset g_data;
-
-extern struct config g_config;
+// State of a load, see load_dataset_file().
+struct loader {
+   struct dataset *data;
+   const struct config *config;
+   FILE *file;
+   struct buffer line;
+   size_t line_no;
+   size_t *field_targets;  // Target of each field of a line, the first one
+   size_t num_fields;      // included, or NO_TARGET for features.
+};
 
-static FILE *g_file;
-static struct buffer g_line = BUFFER_INIT;
-static size_t g_line_no;
+static void seek_start(struct loader *ld)
+{
+   rewind(ld->file);
+   ld->line_no = 0;
+   ld->data->hash = HASH_INIT;
+}
 
-static void seek_start(void)
+// The hash covers the lines read since the last seek_start().
+static void hash_line(struct dataset *data, const char *line, size_t size)
 {
-   rewind(g_file);
-   g_line_no = 0;
+   data->hash = hash_bytes(hash_bytes(data->hash, line, size), "\n", 1);
 }
 
-static char *get_line(void)
+static char *get_line(struct loader *ld)
 {
-   if (feof(g_file))
+   struct buffer *line = &ld->line;
+   
+   if (feof(ld->file))
       return NULL;
 
-   g_line.size = 0;
+   line->size = 0;
    
    int c;
-   while ((c = fgetc(g_file)) != EOF && c != '\n') {
-      if (g_line.size == g_line.alloc)
-         buffer_ensure(&g_line, g_line.size + 1024);
-      g_line.data[g_line.size++] = c;
+   while ((c = fgetc(ld->file)) != EOF && c != '\n') {
+      if (line->size == line->alloc)
+         buffer_ensure(line, line->size + 1024);
+      line->data[line->size++] = c;
    }
-   if (g_line.alloc)
-      g_line.data[g_line.size] = '\0';
+   if (line->alloc)
+      line->data[line->size] = '\0';
    
-   if (ferror(g_file))
-      die("IO error while reading %s: %s", g_config.dataset_path, strerror(errno));
+   if (ferror(ld->file))
+      die("IO error while reading %s: %s", ld->config->dataset_path, strerror(errno));
    
    // Skip the last line if empty.
-   if (!g_line.size) {
-      c = fgetc(g_file);
+   if (!line->size) {
+      c = fgetc(ld->file);
       if (c == EOF)
          return NULL;
-      ungetc(c, g_file);
+      ungetc(c, ld->file);
    }
 
-   g_line_no++;
-   return g_line.data;
+   ld->line_no++;
+   hash_line(ld->data, line->data, line->size);
+   return line->data;
 }
 
-noreturn static void die_loc(const char *format, ...)
+noreturn static void die_loc(const struct loader *ld, const char *format, ...)
 {
-   extern const char *g_progname;
+   char msg[256];
    
-   fprintf(stderr, "%s: invalid format at %s:%zu: ", g_progname,
-           g_config.dataset_path, g_line_no);
-
    va_list ap;
    va_start(ap, format);
-   vfprintf(stderr, format, ap);
+   vsnprintf(msg, sizeof msg, format, ap);
    va_end(ap);
    
-   putc('\n', stderr);
-   
-   exit(EXIT_FAILURE);
+   die("invalid format at %s:%zu: %s", ld->config->dataset_path, ld->line_no, msg);
 }
 
 #define INVALID_LABEL UINT32_MAX
+#define NO_TARGET SIZE_MAX
 
-static uint32_t find_label(const char *label)
+static uint32_t find_label(const struct target *target, const char *label)
 {
-   for (uint32_t i = 0; i < g_data.num_labels; i++)
-      if (!strcmp(g_data.labels[i], label))
+   for (uint32_t i = 0; i < target->num_labels; i++)
+      if (!strcmp(target->labels[i], label))
          return i;
    return INVALID_LABEL;
 }
 
-static void intern_label(const char *label)
+static void intern_label(struct target *target, const char *label)
 {
-   static size_t labels_alloc;
-   
-   if (find_label(label) == INVALID_LABEL) {
-      ENLARGE(g_data.labels, g_data.num_labels + 1, labels_alloc, 2);
-      g_data.labels[g_data.num_labels++] = xstrdup(label);
+   if (find_label(target, label) == INVALID_LABEL) {
+      ENLARGE(target->labels, target->num_labels + 1, target->labels_alloc, 2);
+      target->labels[target->num_labels++] = xstrdup(label);
    }
 }
 
-static size_t read_labels(void)
+static size_t read_labels(struct loader *ld)
 {
+   struct dataset *data = ld->data;
    char *line;
    
-   assert(g_line_no == 1);
-   while ((line = get_line())) {
-      const char *label = strtok(line, "\t");
-      if (!label)
-         die_loc("no label provided");
-      intern_label(label);
+   assert(ld->line_no == 1);
+   while ((line = get_line(ld))) {
+      char *pos;
+      char *field = strtok_r(line, "\t", &pos);
+      if (!field)
+         die_loc(ld, "no label provided");
+      for (size_t i = 0; i < ld->num_fields; i++) {
+         if (i)
+            field = strtok_r(NULL, "\t", &pos);
+         if (ld->field_targets[i] == NO_TARGET)
+            continue;
+         struct target *target = &data->targets[ld->field_targets[i]];
+         if (!field)
+            die_loc(ld, "no label provided for target %s", target->name);
+         intern_label(target, field);
+      }
    }
 
-   size_t num_samples = g_line_no - 1;
+   size_t num_samples = ld->line_no - 1;
    if (!num_samples)
-      die_loc("at least one sample is required");
+      die_loc(ld, "at least one sample is required");
    
-   seek_start();   
+   seek_start(ld);   
    return num_samples;
 }
 
-static size_t count_features(void)
+// The first column is the first target, named after the --targets option.
+static void alloc_targets(struct loader *ld)
 {
-   assert(g_line_no == 0);
-   char *line = get_line();
-   if (!line)
-      die_loc("empty file");
-   
-   size_t num_features = 0;
-   for (line = strtok(line, "\t"); line; line = strtok(NULL, "\t"))
-      num_features++;
+   struct dataset *data = ld->data;
+   size_t targets_alloc = 0;
+   ENLARGE(data->targets, 1, targets_alloc, 4);
+   data->targets[0] = (struct target){0};
+   data->num_targets = 1;
+   if (!ld->config->targets)
+      return;
    
-   return num_features;
+   char *names = xstrdup(ld->config->targets), *pos;
+   for (char *name = strtok_r(names, ",", &pos); name; name = strtok_r(NULL, ",", &pos)) {
+      for (size_t i = 1; i < data->num_targets; i++)
+         if (!strcmp(data->targets[i].name, name))
+            die("target %s given twice", name);
+      ENLARGE(data->targets, data->num_targets + 1, targets_alloc, 4);
+      data->targets[data->num_targets++] = (struct target){
+         .name = xstrdup(name),
+      };
+   }
+   free(names);
 }
 
-static void add_sample(size_t sample_no, char *sample)
+static size_t find_target(const struct dataset *data, const char *name)
 {
-   const char *label = strtok(sample, "\t");
-   if (!label)
-      die("unexpected error");
+   for (size_t i = 1; i < data->num_targets; i++)
+      if (!strcmp(data->targets[i].name, name))
+         return i;
+   return NO_TARGET;
+}
+
+// Reads the first line, and finds out which columns are targets.
+static void read_header(struct loader *ld)
+{
+   struct dataset *data = ld->data;
    
-   uint32_t label_no = find_label(label);
-   if (label_no == INVALID_LABEL)
-      die("unexpected error");
+   assert(ld->line_no == 0);
+   char *line = get_line(ld);
+   if (!line)
+      die_loc(ld, "empty file");
+   
+   alloc_targets(ld);
+   size_t fields_alloc = 0;
+   ENLARGE(ld->field_targets, 1, fields_alloc, 16);
+   ld->field_targets[0] = 0;
+   ld->num_fields = 1;
    
-   g_data.samples_labels[sample_no] = label_no;
+   char *pos;
+   for (line = strtok_r(line, "\t", &pos); line; line = strtok_r(NULL, "\t", &pos)) {
+      size_t target_no = find_target(data, line);
+      for (size_t i = 1; target_no != NO_TARGET && i < ld->num_fields; i++)
+         if (ld->field_targets[i] == target_no)
+            die_loc(ld, "duplicate target: %s", line);
+      ENLARGE(ld->field_targets, ld->num_fields + 1, fields_alloc, 16);
+      ld->field_targets[ld->num_fields++] = target_no;
+      if (target_no == NO_TARGET)
+         data->num_features++;
+   }
    
-   for (size_t feat_no = 0; feat_no < g_data.num_features; feat_no++) {
-      const char *feat = strtok(NULL, "\t");
-      if (!feat)
-         die_loc("not enough features (expected %zu, found only %zu), maybe there is an empty field?",
-                 g_data.num_features, feat_no);
-      column_add(&g_data.columns[feat_no], sample_no, feat);
+   for (size_t i = 1; i < data->num_targets; i++) {
+      size_t field_no = 1;
+      while (field_no < ld->num_fields && ld->field_targets[field_no] != i)
+         field_no++;
+      if (field_no == ld->num_fields)
+         die("no column named %s in the dataset", data->targets[i].name);
    }
-   if (strtok(NULL, "\t"))
-      die_loc("excess features (expected merely %zu)", g_data.num_features);
 }
 
-static size_t feature_size(size_t num_labels)
+static void add_sample(struct loader *ld, size_t sample_no, char *sample)
 {
-   size_t size = offsetof(struct feature, freqs) + sizeof(uint32_t[num_labels]);
-   return size < sizeof(struct feature) ? sizeof(struct feature) : size;
+   struct dataset *data = ld->data;
+   
+   // Timed per line, as timing each value would cost more than hashing it.
+   double start = stats_start(STATS_HASH);
+   char *pos;
+   const char *field = strtok_r(sample, "\t", &pos);
+   if (!field)
+      die("unexpected error");
+   
+   size_t feat_no = 0;
+   for (size_t i = 0; i < ld->num_fields; i++) {
+      if (i)
+         field = strtok_r(NULL, "\t", &pos);
+      size_t target_no = ld->field_targets[i];
+      if (target_no != NO_TARGET) {
+         if (!field)
+            die("unexpected error");
+         struct target *target = &data->targets[target_no];
+         uint32_t label_no = find_label(target, field);
+         if (label_no == INVALID_LABEL)
+            die("unexpected error");
+         target->samples_labels[sample_no] = label_no;
+         continue;
+      }
+      if (!field)
+         die_loc(ld, "not enough features (expected %zu, found only %zu), maybe there is an empty field?",
+                 data->num_features, feat_no);
+      column_add(&data->columns[feat_no++], sample_no, field);
+   }
+   if (strtok_r(NULL, "\t", &pos))
+      die_loc(ld, "excess features (expected merely %zu)", data->num_features);
+   stats_stop(STATS_HASH, start, feat_no);
 }
 
-static void alloc_columns(void)
+static void alloc_columns(struct loader *ld)
 {
-   g_data.columns = xmalloc((g_data.num_features + 1) * sizeof *g_data.columns);
+   struct dataset *data = ld->data;
+   
+   data->columns = xmalloc(data->num_features * sizeof *data->columns);
    
-   g_data.links_size = (g_data.num_features + 1) / 32 + 1;
-   uint32_t *links = xcalloc(g_data.num_features + 1, sizeof(uint32_t[g_data.links_size]));
+   data->links_size = data->num_features / 32 + 1;
+   uint32_t *links = NULL;
+   if (data->num_features)
+      links = xcalloc(data->num_features, sizeof(uint32_t[data->links_size]));
    
-   assert(g_line_no == 0);
-   char *line = get_line();
+   assert(ld->line_no == 0);
+   char *line = get_line(ld);
    if (!line)
-      die_loc("empty file");
-   for (size_t i = 0; i < g_data.num_features; i++) {
-      const char *feat_name = strtok(i ? NULL : line, "\t");
-      if (!feat_name)
-         die_loc("read error");
-      column_init(&g_data.columns[i], feat_name, links);
-      links += g_data.links_size;
+      die_loc(ld, "empty file");
+   size_t feat_no = 0;
+   char *pos;
+   for (size_t i = 1; i < ld->num_fields; i++) {
+      const char *name = strtok_r(i > 1 ? NULL : line, "\t", &pos);
+      if (!name)
+         die_loc(ld, "read error");
+      if (ld->field_targets[i] != NO_TARGET)
+         continue;
+      column_init(&data->columns[feat_no++], data, name, links);
+      links += data->links_size;
    }
 
    // Sanity check.
-   for (size_t i = 0; i < g_data.num_features; i++)
-      for (size_t j = i + 1; j < g_data.num_features; j++)
-         if (!strcmp(g_data.columns[i].name.data, g_data.columns[j].name.data))
-            die_loc("duplicate feature: %s", g_data.columns[i].name.data);
-
-   column_init(&g_data.columns[g_data.num_features], NULL, links);
+   for (size_t i = 0; i < data->num_features; i++)
+      for (size_t j = i + 1; j < data->num_features; j++)
+         if (!strcmp(data->columns[i].name.data, data->columns[j].name.data))
+            die_loc(ld, "duplicate feature: %s", data->columns[i].name.data);
 }
 
-static void load_real(void)
+void find_positive_label(struct bfss *bfss)
 {
-   g_data.num_features = count_features();
-   g_data.num_samples = read_labels();
-   g_data.feature_size = feature_size(g_data.num_labels);
-
-   if (!strcmp(g_config.classification_mode, "binary")) {
-      assert(g_config.positive_label_name);
-      uint32_t label_no = find_label(g_config.positive_label_name);
-      if (label_no == INVALID_LABEL)
-         die("positive label '%s' not present in dataset", g_config.positive_label_name);
-      g_config.positive_label = label_no;
+   struct config *config = &bfss->config;
+   
+   if (!strcmp(config->classification_mode, "binary")) {
+      assert(config->positive_label_name);
+      const struct target *target = &bfss->data.targets[bfss->data.target_no];
+      uint32_t label_no = find_label(target, config->positive_label_name);
+      if (label_no == INVALID_LABEL) {
+         if (target->name)
+            die("positive label '%s' not present in target %s",
+                config->positive_label_name, target->name);
+         die("positive label '%s' not present in dataset", config->positive_label_name);
+      }
+      config->positive_label = label_no;
    }
+}
+
+static void load_real(struct loader *ld)
+{
+   struct dataset *data = ld->data;
    
-   alloc_columns();  
+   read_header(ld);
+   data->num_samples = read_labels(ld);
+
+   alloc_columns(ld);  
    
-   assert(g_line_no == 1);
-   g_data.samples_labels = xmalloc(g_data.num_samples * sizeof *g_data.samples_labels);
-   for (size_t i = 0; i < g_data.num_samples; i++) {
-      char *line = get_line();
+   assert(ld->line_no == 1);
+   for (size_t i = 0; i < data->num_targets; i++) {
+      struct target *target = &data->targets[i];
+      target->samples_labels = xmalloc(data->num_samples * sizeof *target->samples_labels);
+   }
+   for (size_t i = 0; i < data->num_samples; i++) {
+      char *line = get_line(ld);
       if (!line)
          die("unexpected error");
-      add_sample(i, line);
+      add_sample(ld, i, line);
+   }
+   
+   // The first target keeps the hash of the file, so that caches made before
+   // targets existed stay valid.
+   for (size_t i = 0; i < data->num_targets; i++) {
+      struct target *target = &data->targets[i];
+      target->hash = data->hash;
+      if (target->name)
+         target->hash = hash_bytes(target->hash, target->name, strlen(target->name));
    }
+   select_target(data, 0);
+}
+
+void select_target(struct dataset *data, size_t target_no)
+{
+   const struct target *target = &data->targets[target_no];
+   
+   data->target_no = target_no;
+   data->num_labels = target->num_labels;
+   data->labels = target->labels;
+   data->samples_labels = target->samples_labels;
+   data->hash = target->hash;
+}
+
+void load_dataset_file(struct bfss *bfss, FILE *file)
+{
+   double start = stats_start(STATS_LOAD);
+   bfss->data = (struct dataset){.hash = HASH_INIT};
+   
+   struct loader ld = {
+      .data = &bfss->data,
+      .config = &bfss->config,
+      .file = file,
+      .line = BUFFER_INIT,
+   };
+   load_real(&ld);
+   stats_stop(STATS_LOAD, start, 1);
+   
+   buffer_fini(&ld.line);
+   free(ld.field_targets);
+   
+   // With --targets, the first column is not searched.
+   if (!bfss->config.targets)
+      find_positive_label(bfss);
 }
 
-void load_dataset(void)
+void load_dataset(struct bfss *bfss)
 {
-   g_file = fopen(g_config.dataset_path, "r");
-   if (!g_file)
-      die("can't open dataset at %s: %s", g_config.dataset_path, strerror(errno));
+   const char *path = bfss->config.dataset_path;
+   FILE *file = fopen(path, "r");
+   if (!file)
+      die("can't open dataset at %s: %s", path, strerror(errno));
    
-   load_real();
+   load_dataset_file(bfss, file);
    
-   fclose(g_file);
-   buffer_fini(&g_line);
+   fclose(file);
+}
+
+void free_dataset(struct dataset *data)
+{
+   for (size_t i = 0; i < data->num_targets; i++) {
+      struct target *target = &data->targets[i];
+      for (size_t j = 0; j < target->num_labels; j++)
+         free(target->labels[j]);
+      free(target->labels);
+      free(target->samples_labels);
+      free(target->name);
+   }
+   free(data->targets);
+   
+   if (data->columns) {
+      // The links of all columns are allocated at once. There are none if
+      // all the columns are targets.
+      if (data->num_features)
+         free(data->columns[0].links);
+      for (size_t i = 0; i < data->num_features; i++)
+         column_fini(&data->columns[i]);
+      free(data->columns);
+   }
+   if (data->saved_samples) {
+      for (size_t i = 0; i < data->num_features; i++)
+         free(data->saved_samples[i]);
+      free(data->saved_samples);
+      free(data->saved_types);
+   }
+   *data = (struct dataset){0};
+}
+
+void save_columns(struct dataset *data)
+{
+   size_t num_features = data->num_features;
+   
+   data->saved_samples = xmalloc(num_features * sizeof *data->saved_samples);
+   data->saved_types = xmalloc(num_features * sizeof *data->saved_types);
+   for (size_t i = 0; i < num_features; i++) {
+      const struct table *table = &data->columns[i].table;
+      size_t size = data->num_samples * sizeof *table->samples;
+      data->saved_samples[i] = memcpy(xmalloc(size), table->samples, size);
+      data->saved_types[i] = table->num_types;
+   }
+}
+
+void restore_columns(struct dataset *data)
+{
+   for (size_t i = 0; i < data->num_features; i++)
+      column_reset(&data->columns[i], data->saved_samples[i],
+                   data->saved_types[i]);
 }
@@ -3,22 +3,67 @@
 
 #include <stddef.h>
 #include <stdint.h>
+#include <stdio.h>
 
+struct bfss;
 struct column;
 
-struct dataset {
+/* A column of labels to predict. The first column of the dataset is the first
+   target, and has no name. Other targets are named with --targets, and are
+   not used as features.
+ */
+struct target {
+   char *name;
    size_t num_labels;
+   char **labels;
+   size_t labels_alloc;
+   uint32_t *samples_labels;
+   uint64_t hash;
+};
+
+struct dataset {
+   size_t num_labels;         // Labels of the selected target, see
+   char **labels;             // select_target().
+   uint32_t *samples_labels;
    size_t num_features;
    size_t num_samples;
-   char **labels;
    struct column *columns;
-   uint32_t *samples_labels;
-   size_t feature_size;       // Minimum size of a feature structure.
    size_t links_size;
+   uint64_t hash;             // Hash of the file contents, and of the name of
+                              // the selected target.
+   struct target *targets;
+   size_t num_targets;
+   size_t target_no;          // Selected target.
+   uint32_t **saved_samples;  // Copy of the original columns, see
+   size_t *saved_types;       // save_columns().
 };
 
-extern struct dataset g_data;
+// Loads the dataset at the "dataset_path" of the options of the context.
+void load_dataset(struct bfss *);
+
+/* Same, but reads an open file, which is not closed. "dataset_path" is still
+   used in error messages.
+ */
+void load_dataset_file(struct bfss *, FILE *);
+
+void free_dataset(struct dataset *);
+
+/* Makes the labels of a target those of the dataset. The first one is
+   selected once the dataset is loaded.
+ */
+void select_target(struct dataset *, size_t target_no);
+
+/* Copies the samples of the original columns, so that they can be restored
+   with restore_columns() once a search has merged some of them, in order to
+   run another search on the same dataset.
+ */
+void save_columns(struct dataset *);
+
+void restore_columns(struct dataset *);
 
-void load_dataset(void);
+/* Sets the "positive_label" option for binary classification. Dies if the
+   label named with --truth is not in the dataset.
+ */
+void find_positive_label(struct bfss *);
 
 #endif
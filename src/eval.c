@@ -4,34 +4,33 @@
 #include "column.h"
 #include "measure.h"
 #include "search.h"
+#include "stats.h"
 #include "common.h"
 #include "eval.h"
 #include "cmd.h"
+#include "bfss.h"
 
-extern struct config g_config;
-
-struct eval g_eval;
-
-static size_t classify(const double *probs)
+static size_t classify(const double *probs, size_t num_labels)
 {
    size_t best_label = 0;
    
-   for (size_t label = 1; label < g_data.num_labels; label++)
+   for (size_t label = 1; label < num_labels; label++)
       if (probs[label] > probs[best_label])
          best_label = label;
 
    return best_label;
 }
 
-static void update_mat_binary(void)
+static void update_mat_binary(struct eval *ev)
 {
-   double (*probs)[g_data.num_labels] = g_eval.probs;
-   uint32_t positive_label = g_config.positive_label;
-   struct conf_mat *mat = g_eval.conf_mat;
+   const struct dataset *data = ev->data;
+   double (*probs)[data->num_labels] = ev->probs;
+   uint32_t positive_label = ev->config->positive_label;
+   struct conf_mat *mat = ev->conf_mat;
    
-   for (size_t i = g_eval.test_start; i < g_eval.test_end; i++) {
-      size_t label = classify(probs[i - g_eval.test_start]);
-      size_t real_label = g_data.samples_labels[i];
+   for (size_t i = ev->test_start; i < ev->test_end; i++) {
+      size_t label = classify(probs[i - ev->test_start], data->num_labels);
+      size_t real_label = data->samples_labels[i];
       
       if (label == positive_label)
          if (real_label == positive_label)
@@ -46,34 +45,36 @@ static void update_mat_binary(void)
    }
 }
 
-static void update_mat_micro(void)
+static void update_mat_micro(struct eval *ev)
 {
-   double (*probs)[g_data.num_labels] = g_eval.probs;
-   struct conf_mat *mat = g_eval.conf_mat;
+   const struct dataset *data = ev->data;
+   double (*probs)[data->num_labels] = ev->probs;
+   struct conf_mat *mat = ev->conf_mat;
    
-   for (size_t i = g_eval.test_start; i < g_eval.test_end; i++) {
-      size_t label = classify(probs[i - g_eval.test_start]);
-      size_t real_label = g_data.samples_labels[i];
+   for (size_t i = ev->test_start; i < ev->test_end; i++) {
+      size_t label = classify(probs[i - ev->test_start], data->num_labels);
+      size_t real_label = data->samples_labels[i];
       
       if (label == real_label) {
          mat->true_pos++;
-         mat->true_neg += g_data.num_labels - 1;
+         mat->true_neg += data->num_labels - 1;
       } else {
          mat->false_pos++;
          mat->false_neg++;
-         mat->true_neg += g_data.num_labels - 2;
+         mat->true_neg += data->num_labels - 2;
       }
    }
 }
 
-static void update_mat_macro(void)
+static void update_mat_macro(struct eval *ev)
 {
-   double (*probs)[g_data.num_labels] = g_eval.probs;
-   struct conf_mat *mat = g_eval.conf_mat;
+   const struct dataset *data = ev->data;
+   double (*probs)[data->num_labels] = ev->probs;
+   struct conf_mat *mat = ev->conf_mat;
    
-   for (size_t i = g_eval.test_start; i < g_eval.test_end; i++) {
-      size_t label = classify(probs[i - g_eval.test_start]);
-      size_t real_label = g_data.samples_labels[i];
+   for (size_t i = ev->test_start; i < ev->test_end; i++) {
+      size_t label = classify(probs[i - ev->test_start], data->num_labels);
+      size_t real_label = data->samples_labels[i];
       
       if (label == real_label) {
          mat[label].true_pos++;
@@ -81,124 +82,270 @@ static void update_mat_macro(void)
          mat[label].false_pos++;
          mat[real_label].false_neg++;
       }
-      for (size_t label_no = 0; label_no < g_data.num_labels; label_no++)
+      for (size_t label_no = 0; label_no < data->num_labels; label_no++)
          if (label_no != label && label_no != real_label)
             mat[label_no].true_neg++;
    }
 }
 
-static void (*update_mat)(void);
-
-void eval_init(void)
+void eval_init(struct eval *ev, struct bfss *bfss)
 {
+   const struct dataset *data = &bfss->data;
+   const struct config *config = &bfss->config;
+   
+   *ev = (struct eval){
+      .data = data,
+      .config = config,
+      .measure = &bfss->measure,
+   };
+   
    // We drop some samples if num_samples is not a multiple of num_folds
    // I don't think this matters much.
-   g_eval.fold_size = g_data.num_samples / g_config.num_folds;
-   if (!g_eval.fold_size)
+   ev->fold_size = data->num_samples / config->num_folds;
+   if (!ev->fold_size)
       die("not enough samples for evaluation (have %zu, can't perform %zu-fold cross-validation)",
-          g_data.num_samples, g_config.num_folds);
-   
-   g_eval.probs = xmalloc(sizeof(double[g_eval.fold_size][g_data.num_labels]));
-   
-   g_eval.labels_freqs = xmalloc(g_data.num_labels * sizeof *g_eval.labels_freqs);
-   g_eval.types_freqs = xmalloc((g_data.num_features + 1) * sizeof *g_eval.types_freqs);
-
-   if (!strcmp(g_config.classification_mode, "binary")) {
-      g_eval.conf_mat_size = sizeof *g_eval.conf_mat;
-      update_mat = update_mat_binary;
-   } else if (!strcmp(g_config.classification_mode, "multiclass")) {
-      if (!strcmp(g_config.averaging_mode, "micro")) {
-         g_eval.conf_mat_size = sizeof *g_eval.conf_mat;
-         update_mat = update_mat_micro;
-      } else if (!strcmp(g_config.averaging_mode, "macro")) {
-         g_eval.conf_mat_size = g_data.num_labels * sizeof *g_eval.conf_mat;
-         update_mat = update_mat_macro;
+          data->num_samples, config->num_folds);
+   
+   if (!strcmp(config->classification_mode, "binary")) {
+      ev->conf_mat_size = sizeof *ev->conf_mat;
+      ev->update_mat = update_mat_binary;
+   } else if (!strcmp(config->classification_mode, "multiclass")) {
+      if (!strcmp(config->averaging_mode, "micro")) {
+         ev->conf_mat_size = sizeof *ev->conf_mat;
+         ev->update_mat = update_mat_micro;
+      } else if (!strcmp(config->averaging_mode, "macro")) {
+         ev->conf_mat_size = data->num_labels * sizeof *ev->conf_mat;
+         ev->update_mat = update_mat_macro;
       } else {
-         die("invalid averaging mode: %s", g_config.averaging_mode);
+         die("invalid averaging mode: %s", config->averaging_mode);
       }
    } else {
-      die("invalid classification mode: %s", g_config.classification_mode);
+      die("invalid classification mode: %s", config->classification_mode);
    }
-   g_eval.conf_mat = xmalloc(g_eval.conf_mat_size);
+   
+   ev->probs = xmalloc(sizeof(double[ev->fold_size][data->num_labels]));
+   ev->labels_freqs = xmalloc(data->num_labels * sizeof *ev->labels_freqs);
+   ev->conf_mat = xmalloc(ev->conf_mat_size);
 }
 
-static void train(void)
+void eval_fini(struct eval *ev)
 {
-   g_eval.num_samples = g_data.num_samples - (g_eval.test_end - g_eval.test_start);
+   free(ev->probs);
+   free(ev->labels_freqs);
+   free(ev->conf_mat);
+   free(ev->types_freqs);
+   free(ev->freqs);
+   free(ev->freqs_buf);
+}
+
+size_t eval_bytes(const struct eval *ev)
+{
+   return sizeof(double[ev->fold_size][ev->data->num_labels])
+        + ev->data->num_labels * sizeof *ev->labels_freqs
+        + ev->conf_mat_size
+        + ev->columns_alloc * (sizeof *ev->types_freqs + sizeof *ev->freqs)
+        + ev->freqs_alloc * sizeof *ev->freqs_buf;
+}
 
-   memset(g_eval.labels_freqs, 0, g_data.num_labels * sizeof *g_eval.labels_freqs);
-   for (size_t i = 0; i < g_eval.test_start; i++)
-      g_eval.labels_freqs[g_data.samples_labels[i]]++;
-   for (size_t i = g_eval.test_end; i < g_data.num_samples; i++)
-      g_eval.labels_freqs[g_data.samples_labels[i]]++;
+// Allocates frequency tables for the columns to evaluate.
+static void set_columns(struct eval *ev, const struct column *const *columns,
+                        size_t num_columns)
+{
+   ev->columns = columns;
+   ev->num_columns = num_columns;
+   if (!num_columns)
+      return;
+   
+   size_t old_alloc = ev->columns_alloc;
+   ENLARGE(ev->types_freqs, num_columns, ev->columns_alloc, 16);
+   if (ev->columns_alloc != old_alloc)
+      ev->freqs = xrealloc(ev->freqs, ev->columns_alloc * sizeof *ev->freqs);
    
-   for (size_t feat = 0; feat <= g_data.num_features; feat++) {
-      struct column *column = &g_data.columns[feat];
-      if (column->state == COL_ACTIVE)
-         g_eval.types_freqs[feat] = column_count(column, g_eval.test_start,
-                                                 g_eval.test_end);
+   size_t row_size = COLUMN_ROW_SIZE(ev->data->num_labels);
+   size_t total = 0;
+   for (size_t i = 0; i < num_columns; i++)
+      total += columns[i]->table.num_types * row_size;
+   if (total)
+      ENLARGE(ev->freqs_buf, total, ev->freqs_alloc, 1024);
+   
+   total = 0;
+   for (size_t i = 0; i < num_columns; i++) {
+      ev->freqs[i] = &ev->freqs_buf[total];
+      total += columns[i]->table.num_types * row_size;
    }
 }
 
-static void compute_priors(void)
+static void count_labels(struct eval *ev, size_t start, size_t end)
+{
+   for (size_t i = start; i < end; i++)
+      ev->labels_freqs[ev->data->samples_labels[i]]++;
+}
+
+static void train(struct eval *ev)
 {
-   double (*probs)[g_data.num_labels] = g_eval.probs;
-   size_t num_labels = g_data.num_labels;
+   const struct dataset *data = ev->data;
+   
+   ev->num_samples = data->num_samples - (ev->test_end - ev->test_start);
+
+   memset(ev->labels_freqs, 0, data->num_labels * sizeof *ev->labels_freqs);
+   count_labels(ev, 0, ev->test_start);
+   count_labels(ev, ev->test_end, data->num_samples);
+   
+   double start = stats_start(STATS_COUNT);
+   for (size_t i = 0; i < ev->num_columns; i++)
+      ev->types_freqs[i] = column_count(ev->columns[i], ev->freqs[i],
+                                        ev->test_start, ev->test_end);
+   stats_stop(STATS_COUNT, start, 1);
+}
 
-   double denom = g_eval.num_samples + g_config.smooth * num_labels;
+/* Same as train(), but only uses the first "sample_size" samples of each of
+   the other folds. The test set must already be restricted in the same way.
+ */
+static void train_sample(struct eval *ev, size_t sample_size)
+{
+   size_t fold_size = ev->fold_size;
+   size_t num_folds = ev->config->num_folds;
+   
+   ev->num_samples = (num_folds - 1) * sample_size;
+   
+   memset(ev->labels_freqs, 0, ev->data->num_labels * sizeof *ev->labels_freqs);
+   for (size_t fold = 0; fold < num_folds; fold++) {
+      if (fold != ev->fold_no)
+         count_labels(ev, fold * fold_size, fold * fold_size + sample_size);
+   }
+   
+   double start = stats_start(STATS_COUNT);
+   for (size_t i = 0; i < ev->num_columns; i++) {
+      const struct column *column = ev->columns[i];
+      uint32_t *freqs = ev->freqs[i];
+      column_zero(column, freqs);
+      uint32_t num_types = 0;
+      for (size_t fold = 0; fold < num_folds; fold++) {
+         if (fold == ev->fold_no)
+            continue;
+         size_t start = fold * fold_size;
+         num_types += column_count_range(column, freqs, start, start + sample_size);
+      }
+      ev->types_freqs[i] = num_types;
+   }
+   stats_stop(STATS_COUNT, start, 1);
+}
+
+static void compute_priors(struct eval *ev)
+{
+   size_t num_labels = ev->data->num_labels;
+   double (*probs)[num_labels] = ev->probs;
+   double smooth = ev->config->smooth;
+
+   double denom = ev->num_samples + smooth * num_labels;
    for (size_t label = 0; label < num_labels; label++)
-      probs[0][label] = log2((g_eval.labels_freqs[label] + g_config.smooth) / denom);
+      probs[0][label] = log2((ev->labels_freqs[label] + smooth) / denom);
 
-   size_t num_samples = g_eval.test_end - g_eval.test_start;
+   size_t num_samples = ev->test_end - ev->test_start;
    for (size_t i = 1; i < num_samples; i++)
       for (size_t label = 0; label < num_labels; label++)
          probs[i][label] = probs[0][label];
 }
 
-static void compute_feat_probs(const struct column *column, size_t feat_no)
+static void compute_feat_probs(struct eval *ev, size_t col_no)
 {
-   assert(column->state == COL_ACTIVE);
-   
-   double (*probs)[g_data.num_labels] = g_eval.probs;
-   double div_smooth = g_config.smooth * g_eval.types_freqs[feat_no];
+   const size_t num_labels = ev->data->num_labels;
+   double (*probs)[num_labels] = ev->probs;
+   const double smooth = ev->config->smooth;
+   double div_smooth = smooth * ev->types_freqs[col_no];
+   const uint32_t *freqs = ev->freqs[col_no];
+   const size_t row_size = COLUMN_ROW_SIZE(num_labels);
    
-   struct feature **samples = column->table.samples;
-   for (size_t i = g_eval.test_start; i < g_eval.test_end; i++) {
-      const struct feature *feat = samples[i];
-      for (size_t label = 0; label < g_data.num_labels; label++) {
-         double prob = (feat->freqs[label] + g_config.smooth)
-                     / (double)(g_eval.labels_freqs[label] + div_smooth);
-         probs[i - g_eval.test_start][label] += log2(prob);
+   const uint32_t *samples = ev->columns[col_no]->table.samples;
+   for (size_t i = ev->test_start; i < ev->test_end; i++) {
+      const uint32_t *feat_freqs = &freqs[samples[i] * row_size + 1];
+      for (size_t label = 0; label < num_labels; label++) {
+         double prob = (feat_freqs[label] + smooth)
+                     / (double)(ev->labels_freqs[label] + div_smooth);
+         probs[i - ev->test_start][label] += log2(prob);
       }
    }
 }
 
-static void compute_probs(void)
+static void compute_probs(struct eval *ev)
 {
-   compute_priors();
-   for (size_t feat = 0; feat <= g_data.num_features; feat++) {
-      const struct column *column = &g_data.columns[feat];
-      if (column->state == COL_ACTIVE)
-         compute_feat_probs(column, feat);
-   }
+   double start = stats_start(STATS_PROBS);
+   compute_priors(ev);
+   for (size_t i = 0; i < ev->num_columns; i++)
+      compute_feat_probs(ev, i);
+   stats_stop(STATS_PROBS, start, 1);
+}
+
+static void count_mat(struct eval *ev)
+{
+   double start = stats_start(STATS_UPDATE_MAT);
+   ev->update_mat(ev);
+   stats_stop(STATS_UPDATE_MAT, start, 1);
 }
 
-double eval_model(void)
+double eval_columns(struct eval *ev, const struct column *const *columns,
+                    size_t num_columns)
 {
-   memset(g_eval.conf_mat, 0, g_eval.conf_mat_size);
+   double start = stats_start(STATS_EVAL);
+   set_columns(ev, columns, num_columns);
+   memset(ev->conf_mat, 0, ev->conf_mat_size);
 
-   g_eval.test_end = 0;
+   ev->test_end = 0;
 
-   for (size_t fold = 0; fold < g_config.num_folds; fold++) {
-      g_eval.fold_no = fold;
-      g_eval.test_start = g_eval.test_end;
-      g_eval.test_end += g_eval.fold_size;
+   for (size_t fold = 0; fold < ev->config->num_folds; fold++) {
+      ev->fold_no = fold;
+      ev->test_start = ev->test_end;
+      ev->test_end += ev->fold_size;
       
-      train();
-      compute_probs();
-      update_mat();
+      train(ev);
+      compute_probs(ev);
+      count_mat(ev);
    }
 
-   g_eval.num_evals++;
-   return measure_func(g_eval.conf_mat);
+   ev->num_evals++;
+   stats_stop(STATS_EVAL, start, 1);
+   return measure_score(ev->measure, ev->conf_mat);
+}
+
+double eval_columns_sample(struct eval *ev, const struct column *const *columns,
+                           size_t num_columns, size_t sample_size)
+{
+   assert(sample_size > 0 && sample_size <= ev->fold_size);
+   
+   double start = stats_start(STATS_EVAL_SAMPLE);
+   set_columns(ev, columns, num_columns);
+   memset(ev->conf_mat, 0, ev->conf_mat_size);
+
+   for (size_t fold = 0; fold < ev->config->num_folds; fold++) {
+      ev->fold_no = fold;
+      ev->test_start = fold * ev->fold_size;
+      ev->test_end = ev->test_start + sample_size;
+      
+      train_sample(ev, sample_size);
+      compute_probs(ev);
+      count_mat(ev);
+   }
+   
+   stats_stop(STATS_EVAL_SAMPLE, start, 1);
+   return measure_score(ev->measure, ev->conf_mat);
+}
+
+uint64_t eval_context(const struct eval *ev)
+{
+   const struct dataset *data = ev->data;
+   const struct config *config = ev->config;
+   uint64_t hash = hash_bytes(HASH_INIT, &data->hash, sizeof data->hash);
+   
+   uint64_t values[] = {
+      data->num_features,
+      data->num_samples,
+      config->num_folds,
+      config->positive_label,
+      ev->conf_mat_size,
+   };
+   hash = hash_bytes(hash, values, sizeof values);
+   hash = hash_bytes(hash, &config->smooth, sizeof config->smooth);
+   hash = hash_bytes(hash, config->classification_mode, strlen(config->classification_mode) + 1);
+   hash = hash_bytes(hash, config->averaging_mode, strlen(config->averaging_mode) + 1);
+   return hash;
 }
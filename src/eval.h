@@ -4,31 +4,33 @@
 #include "dataset.h"
 #include "column.h"
 #include "measure.h"
+#include "config.h"
 
-struct config {
-   const char *dataset_path;
-   const char *positive_label_name;
-   const char *classification_mode;
-   const char *averaging_mode;
-   const char *measure_name;
-   const char *search_mode;
-   size_t max_links;
-   size_t max_features;
-   size_t num_folds;
-   double smooth;
-   bool verbose;
-   bool compact_json;
-
-   uint32_t positive_label;
-};
+struct bfss;
 
+/* Evaluation context. Distinct contexts can be used concurrently, as long as
+   the evaluated columns are not modified in the meantime.
+ */
 struct eval {
+   const struct dataset *data;
+   const struct config *config;
+   const struct measure *measure;
+   void (*update_mat)(struct eval *);  // Depends on the classification mode.
+   
    size_t fold_size;
    
    size_t fold_no;         // Current fold number (starting at zero).
    uint32_t num_samples;   // Number of samples in the current train set.
    uint32_t *labels_freqs; // Frequency of each label in the current train set.
-   uint32_t *types_freqs;  // Number of types in the current train set.
+   
+   const struct column *const *columns;   // Columns to evaluate.
+   size_t num_columns;
+   uint32_t *types_freqs;  // Number of types of each column in the current
+                           // train set.
+   uint32_t **freqs;       // Frequencies of each column, see column_count().
+   size_t columns_alloc;
+   uint32_t *freqs_buf;    // Storage for "freqs".
+   size_t freqs_alloc;
    
    struct conf_mat *conf_mat;    // Confusion matrix.
    size_t conf_mat_size;         // Size in bytes (for zeroing).
@@ -40,10 +42,31 @@ struct eval {
    size_t num_evals;
 };
 
-extern struct eval g_eval;
+/* Evaluates with the dataset, options and measure of a context, which must
+   outlive the evaluation context.
+ */
+void eval_init(struct eval *, struct bfss *);
+
+void eval_fini(struct eval *);
+
+// Bytes allocated for the buffers of an evaluation context.
+size_t eval_bytes(const struct eval *);
+
+// Evaluates the model that uses the given columns, in this order.
+double eval_columns(struct eval *, const struct column *const *columns,
+                    size_t num_columns);
 
-void eval_init(void);
+/* Approximate evaluation, for racing candidates. Cross-validation is done as
+   usual, but only the first "sample_size" samples of each fold are used, both
+   for training and testing. This is not counted in "num_evals".
+ */
+double eval_columns_sample(struct eval *, const struct column *const *columns,
+                           size_t num_columns, size_t sample_size);
 
-double eval_model(void);
+/* Hash of everything, except the feature subset, that determines the result
+   of an evaluation: dataset contents, number of folds, smoothing,
+   classification and averaging modes, and positive label.
+ */
+uint64_t eval_context(const struct eval *);
 
 #endif
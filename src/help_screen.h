@@ -1,4 +1,4 @@
-"Usage: %s [options] [--] <dataset>\n"
+"Usage: %s [serve --socket=<path>] [options] [--] <dataset>\n"
 "Select an optimal feature subset for Bayesian classification.\n"
 "\n"
 "Main options:\n"
@@ -6,6 +6,8 @@
 "                                  [multiclass]\n"
 "   -t, --truth=<string>         name of the label corresponding to the positive\n"
 "                                  class, for binary classification\n"
+"   --targets=<names>            run a search for each of these comma-separated\n"
+"                                  columns, used as labels instead of the first\n"
 "   -k, --folds=<integer>        number of folds for cross-validation [5]\n"
 "   -S, --smooth=<float>         frequency increment for additive smoothing [0.5]\n"
 "   -M, --measure=<string>       measure to maximize (accuracy|precision|recall|\n"
@@ -13,15 +15,82 @@
 "   -a, --average=<string>       averaging mode for multiclass classification\n"
 "                                  (micro|macro) [macro]\n"
 "   -s, --search=<string>        search mode (none|forward|forward-join|backward|\n"
-"                                  backward-join) [forward-join]\n"
+"                                  backward-join|beam) [forward-join]\n"
 "   -F, --max-features=<integer> maximum number of features to select [inf]\n"
+"   --init-subset=<json>         subset to start the search from, in the format\n"
+"                                  of the \"subset\" output field\n"
+"   --sweep=<grid>               run a search for each combination of option\n"
+"                                  values, e.g. \"smooth=0.1,1;measure=F1,accuracy\"\n"
 "   -L, --max-links=<integer>    maximum number of dependencies to model [inf]\n"
+"   --max-join-cardinality=<integer>\n"
+"                                maximum number of distinct values of a joined\n"
+"                                  feature [inf]\n"
+"   --max-model-bytes=<integer>  maximum estimated size of the selected model\n"
+"                                  when joining features [inf]\n"
+"\n"
+"Search options:\n"
+"   --race                       drop unpromising candidates early by evaluating\n"
+"                                  them on growing samples (approximate)\n"
+"   --race-confidence=<float>    confidence level for dropping candidates [0.95]\n"
+"   --lazy                       reuse the scores of the previous steps to skip\n"
+"                                  candidates during forward searches\n"
+"                                  (approximate)\n"
+"   --mi-rank                    evaluate candidates by decreasing mutual\n"
+"                                  information\n"
+"   --join-candidates=<integer>  only try to join each feature with the ones it\n"
+"                                  depends on most (implies --mi-rank) [inf]\n"
+"   --beam-width=<integer>       number of subsets kept at each step of the beam\n"
+"                                  search [4]\n"
+"   -j, --threads=<integer>      number of threads evaluating candidates [1]\n"
+"   --processes=<integer>        fork this number of worker processes to\n"
+"                                  evaluate candidates [0]\n"
+"   --connect=<addresses>        evaluate candidates with the workers listening\n"
+"                                  on these comma-separated addresses\n"
+"   --listen=<address>           run as a worker, serving coordinators on this\n"
+"                                  address\n"
+"   --time-limit=<float>         stop the search after this number of seconds\n"
+"                                  and output the best subset found [inf]\n"
+"   --max-evals=<integer>        stop the search after this number of\n"
+"                                  evaluations [inf]\n"
+"   --memo-entries=<integer>     maximum number of subsets whose results are\n"
+"                                  kept to avoid evaluating them again, 0 to\n"
+"                                  disable [65536]\n"
+"   --cache-dir=<path>           directory where evaluation results are stored\n"
+"                                  and reused across runs\n"
+"   --checkpoint=<path>          save the search state after each step and when\n"
+"                                  interrupted\n"
+"   --resume=<path>              resume the search saved in a checkpoint\n"
 "\n"
 "Output options:\n"
 "   -v, --verbose                output performance measures for all evaluated\n"
 "                                  models\n"
 "   -c, --compact                output compressed JSON documents that fit on a\n"
 "                                  single line\n"
+"   --report-every=<float>       output the best subset found so far every\n"
+"                                  this number of seconds\n"
+"   --progress=<integer>         output a JSON line to this file descriptor\n"
+"                                  after each search step\n"
+"   --progress-file=<path>       same, to a file\n"
+"   --stats                      output the time spent in each phase on the\n"
+"                                  standard error at exit\n"
+"   --perf-counters              add hardware performance counters to --stats\n"
+"                                  (Linux only)\n"
+"   --memory-report              output the memory used by the column tables\n"
+"                                  and the search buffers on the standard error,\n"
+"                                  after loading and at exit\n"
+"   --save-model=<path>          train the selected subset on all samples and\n"
+"                                  save the classifier to this file\n"
+"\n"
+"Serve command:\n"
+"   --socket=<path>              answer evaluation and search requests on this\n"
+"                                  Unix-domain socket, see the manual\n"
+"\n"
+"Classify command:\n"
+"   --model=<path>               predict the labels of the samples of the input\n"
+"                                  file (or of the standard input) with a model\n"
+"                                  saved by --save-model\n"
+"   --scores                     also output the log2 probability of each label\n"
+"   -j, --threads=<integer>      number of threads classifying samples [1]\n"
 "\n"
 "General options:\n"
 "   -h, --help                   display this message\n"
@@ -0,0 +1,180 @@
+#include <ctype.h>
+#include <string.h>
+#include "json.h"
+#include "cmd.h"
+
+void json_init(struct json_reader *rd, const char *what, const char *json)
+{
+   *rd = (struct json_reader){
+      .what = what,
+      .json = json,
+      .pos = json,
+      .str = BUFFER_INIT,
+   };
+}
+
+void json_fini(struct json_reader *rd)
+{
+   buffer_fini(&rd->str);
+   rd->str = (struct buffer)BUFFER_INIT;
+}
+
+noreturn void json_error(const struct json_reader *rd, const char *msg)
+{
+   die("invalid %s at offset %zu: %s", rd->what, (size_t)(rd->pos - rd->json), msg);
+}
+
+static void skip_spaces(struct json_reader *rd)
+{
+   while (isspace((unsigned char)*rd->pos))
+      rd->pos++;
+}
+
+bool json_accept(struct json_reader *rd, char c)
+{
+   skip_spaces(rd);
+   if (*rd->pos != c)
+      return false;
+   rd->pos++;
+   return true;
+}
+
+void json_expect(struct json_reader *rd, char c)
+{
+   if (!json_accept(rd, c)) {
+      switch (c) {
+      case ']': json_error(rd, "expected ',' or ']'");
+      case '}': json_error(rd, "expected ',' or '}'");
+      default: json_error(rd, "unexpected character");
+      }
+   }
+}
+
+static void cat_utf8(struct buffer *buf, unsigned long code)
+{
+   char bytes[4];
+   size_t len;
+   
+   if (code < 0x80) {
+      bytes[0] = code;
+      len = 1;
+   } else if (code < 0x800) {
+      bytes[0] = 0xc0 | code >> 6;
+      bytes[1] = 0x80 | (code & 0x3f);
+      len = 2;
+   } else if (code < 0x10000) {
+      bytes[0] = 0xe0 | code >> 12;
+      bytes[1] = 0x80 | (code >> 6 & 0x3f);
+      bytes[2] = 0x80 | (code & 0x3f);
+      len = 3;
+   } else {
+      bytes[0] = 0xf0 | code >> 18;
+      bytes[1] = 0x80 | (code >> 12 & 0x3f);
+      bytes[2] = 0x80 | (code >> 6 & 0x3f);
+      bytes[3] = 0x80 | (code & 0x3f);
+      len = 4;
+   }
+   buffer_cat(buf, bytes, len);
+}
+
+static unsigned long parse_hex4(struct json_reader *rd)
+{
+   unsigned long code = 0;
+   
+   for (size_t i = 0; i < 4; i++) {
+      int c = tolower((unsigned char)*rd->pos);
+      if (!isxdigit(c))
+         json_error(rd, "invalid unicode escape");
+      code = code << 4 | (isdigit(c) ? c - '0' : c - 'a' + 10);
+      rd->pos++;
+   }
+   return code;
+}
+
+const char *json_string(struct json_reader *rd)
+{
+   struct buffer *str = &rd->str;
+   
+   json_expect(rd, '"');
+   buffer_clear(str);
+   buffer_ensure(str, 1);
+   str->data[0] = '\0';
+   for (;;) {
+      char c = *rd->pos++;
+      if (!c) {
+         rd->pos--;
+         json_error(rd, "unterminated string");
+      } else if (c == '"') {
+         break;
+      } else if (c != '\\') {
+         buffer_catc(str, c);
+         continue;
+      }
+      
+      c = *rd->pos++;
+      switch (c) {
+      case 'b': buffer_catc(str, '\b'); break;
+      case 'f': buffer_catc(str, '\f'); break;
+      case 'n': buffer_catc(str, '\n'); break;
+      case 'r': buffer_catc(str, '\r'); break;
+      case 't': buffer_catc(str, '\t'); break;
+      case 'u': {
+         unsigned long code = parse_hex4(rd);
+         if (code >= 0xd800 && code < 0xdc00 && rd->pos[0] == '\\'
+             && rd->pos[1] == 'u') {
+            rd->pos += 2;
+            unsigned long low = parse_hex4(rd);
+            code = 0x10000 + ((code - 0xd800) << 10) + (low - 0xdc00);
+         }
+         cat_utf8(str, code);
+         break;
+      }
+      case '\0':
+         rd->pos--;
+         json_error(rd, "unterminated string");
+      default:
+         buffer_catc(str, c);
+      }
+   }
+   return str->data;
+}
+
+const char *json_skip(struct json_reader *rd)
+{
+   skip_spaces(rd);
+   const char *start = rd->pos;
+   
+   if (*rd->pos == '"') {
+      json_string(rd);
+   } else if (json_accept(rd, '[')) {
+      if (!json_accept(rd, ']')) {
+         do
+            json_skip(rd);
+         while (json_accept(rd, ','));
+         json_expect(rd, ']');
+      }
+   } else if (json_accept(rd, '{')) {
+      if (!json_accept(rd, '}')) {
+         do {
+            json_string(rd);
+            json_expect(rd, ':');
+            json_skip(rd);
+         } while (json_accept(rd, ','));
+         json_expect(rd, '}');
+      }
+   } else {
+      // Numbers and literals.
+      while (*rd->pos && (isalnum((unsigned char)*rd->pos) || strchr("+-.", *rd->pos)))
+         rd->pos++;
+      if (rd->pos == start)
+         json_error(rd, "expected a value");
+   }
+   return start;
+}
+
+void json_end(struct json_reader *rd)
+{
+   skip_spaces(rd);
+   if (*rd->pos)
+      json_error(rd, "trailing characters");
+}
@@ -0,0 +1,42 @@
+#ifndef BFSS_JSON_H
+#define BFSS_JSON_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdnoreturn.h>
+#include "buffer.h"
+
+/* Minimal JSON reader, for the documents we are given: subsets and server
+   requests. Errors are reported with die(), prefixed with "what" and the
+   offset at which they occurred.
+ */
+struct json_reader {
+   const char *what;
+   const char *json;
+   const char *pos;
+   struct buffer str;      // Last string read.
+};
+
+void json_init(struct json_reader *, const char *what, const char *json);
+
+void json_fini(struct json_reader *);
+
+noreturn void json_error(const struct json_reader *, const char *msg);
+
+// Skips whitespace, then consumes "c" if it comes next.
+bool json_accept(struct json_reader *, char c);
+
+void json_expect(struct json_reader *, char c);
+
+// Reads a string and decodes it into "str". Returns its contents.
+const char *json_string(struct json_reader *);
+
+/* Skips a value of any type. Returns a pointer to its first character, its
+   length is then "pos" minus this pointer.
+ */
+const char *json_skip(struct json_reader *);
+
+// Dies if anything but whitespace remains.
+void json_end(struct json_reader *);
+
+#endif
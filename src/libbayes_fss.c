@@ -0,0 +1,187 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <setjmp.h>
+#include <stdio.h>
+#include <string.h>
+#include "libbayes_fss.h"
+#include "config.h"
+#include "dataset.h"
+#include "eval.h"
+#include "measure.h"
+#include "search.h"
+#include "bfss.h"
+#include "common.h"
+#include "cmd.h"
+
+/* Everything a call works on is reached from its context, so distinct
+   contexts can be used from distinct threads at the same time. Errors raised
+   with die() jump back to the calling function, through a handler installed
+   on the calling thread for the duration of the call; those of the threads of
+   a search are handed over to it by pool_run().
+ */
+
+// Uninstalls the handler of a call, and records its error if any.
+static int leave(struct bfss *bfss, struct die_handler *prev, const char *error)
+{
+   g_die_handler = prev;
+   if (!error)
+      return 0;
+   snprintf(bfss->error, sizeof bfss->error, "%s", error);
+   return -1;
+}
+
+static const char *keep_string(struct bfss *bfss, const char *str)
+{
+   ENLARGE(bfss->strings, bfss->num_strings + 1, bfss->strings_alloc, 8);
+   return bfss->strings[bfss->num_strings++] = xstrdup(str);
+}
+
+struct bfss *bfss_new(void)
+{
+   struct bfss *bfss = xcalloc(1, sizeof *bfss);
+   config_init(&bfss->config);
+   return bfss;
+}
+
+void bfss_free(struct bfss *bfss)
+{
+   if (!bfss)
+      return;
+
+   search_fini(bfss);
+   free_dataset(&bfss->data);
+
+   for (size_t i = 0; i < bfss->num_strings; i++)
+      free(bfss->strings[i]);
+   free(bfss->strings);
+   free(bfss);
+}
+
+int bfss_set_option(struct bfss *bfss, const char *name, const char *value)
+{
+   struct option *options = config_options(&bfss->config);
+   struct die_handler handler, *prev = g_die_handler;
+   g_die_handler = &handler;
+   if (setjmp(handler.env)) {
+      free(options);
+      return leave(bfss, prev, handler.msg);
+   }
+
+   set_option(options, name, value ? keep_string(bfss, value) : NULL);
+   free(options);
+   return leave(bfss, prev, NULL);
+}
+
+static int load(struct bfss *bfss, FILE *file, const char *name)
+{
+   struct die_handler handler, *prev = g_die_handler;
+   g_die_handler = &handler;
+   if (setjmp(handler.env)) {
+      // Whatever was loaded is leaked.
+      bfss->data = (struct dataset){0};
+      return leave(bfss, prev, handler.msg);
+   }
+
+   if (bfss->data.columns)
+      die("a dataset is already loaded");
+   bfss->config.dataset_path = keep_string(bfss, name);
+   config_check(&bfss->config);
+   load_dataset_file(bfss, file);
+   save_columns(&bfss->data);
+   return leave(bfss, prev, NULL);
+}
+
+int bfss_load_file(struct bfss *bfss, const char *path)
+{
+   FILE *file = fopen(path, "r");
+   if (!file) {
+      snprintf(bfss->error, sizeof bfss->error, "can't open dataset at %s: %s",
+               path, strerror(errno));
+      return -1;
+   }
+   int ret = load(bfss, file, path);
+   fclose(file);
+   return ret;
+}
+
+int bfss_load_memory(struct bfss *bfss, const char *data, size_t size)
+{
+   FILE *file = size ? fmemopen((void *)data, size, "r") : NULL;
+   if (!file) {
+      snprintf(bfss->error, sizeof bfss->error, "can't read dataset from memory: %s",
+               size ? strerror(errno) : "empty dataset");
+      return -1;
+   }
+   int ret = load(bfss, file, "<memory>");
+   fclose(file);
+   return ret;
+}
+
+static char *run(struct bfss *bfss, const char *subset)
+{
+   // The options are only overridden for this call.
+   struct config config = bfss->config;
+   struct die_handler handler, *prev = g_die_handler;
+   g_die_handler = &handler;
+   if (setjmp(handler.env)) {
+      // Stop the threads of the search first, they may still write to the report.
+      search_fini(bfss);
+      if (bfss->out) {
+         fclose(bfss->out);
+         free(bfss->report);
+         bfss->out = NULL;
+      }
+      eval_fini(&bfss->eval);
+      bfss->eval = (struct eval){0};
+      bfss->config = config;
+      leave(bfss, prev, handler.msg);
+      return NULL;
+   }
+
+   if (!bfss->data.columns)
+      die("no dataset loaded");
+   if (bfss->config.targets || bfss->config.save_model_path)
+      die("--%s is only supported by the command-line program",
+          bfss->config.targets ? "targets" : "save-model");
+   if (subset) {
+      bfss->config.search_mode = "none";
+      bfss->config.init_subset = subset;
+   }
+   config_check(&bfss->config);
+
+   // Undo the merges made by the previous search.
+   restore_columns(&bfss->data);
+
+   find_positive_label(bfss);
+   measure_init(&bfss->measure, &bfss->config, bfss->data.num_labels);
+   eval_init(&bfss->eval, bfss);
+
+   bfss->out = open_memstream(&bfss->report, &bfss->report_size);
+   if (!bfss->out)
+      die("can't allocate report: %s", strerror(errno));
+   search(bfss, bfss->out);
+   fclose(bfss->out);
+   bfss->out = NULL;
+
+   eval_fini(&bfss->eval);
+   bfss->eval = (struct eval){0};
+   bfss->config = config;
+   leave(bfss, prev, NULL);
+   return bfss->report;
+}
+
+char *bfss_search(struct bfss *bfss)
+{
+   return run(bfss, NULL);
+}
+
+char *bfss_eval(struct bfss *bfss, const char *subset)
+{
+   return run(bfss, subset);
+}
+
+const char *bfss_error(const struct bfss *bfss)
+{
+   return bfss->error;
+}
@@ -0,0 +1,48 @@
+#ifndef LIBBAYES_FSS_H
+#define LIBBAYES_FSS_H
+
+#include <stddef.h>
+
+/* Library interface. A context holds a dataset and the options used to
+   evaluate it and to search it, so that several searches can be made on the
+   same dataset without reloading it. Any number of contexts can be used at
+   once, each one from a single thread at a time, and their searches run
+   concurrently. A search runs on the calling thread unless the "threads" or
+   "processes" options are set, as with the command-line program.
+
+   Functions that return an int return 0 on success, or -1 on error, in which
+   case a description of the error is available through bfss_error(). This
+   includes the errors raised by the evaluation threads of a search.
+ */
+struct bfss;
+
+struct bfss *bfss_new(void);
+
+void bfss_free(struct bfss *);
+
+/* Sets an option, with the long names and values of the command-line program,
+   e.g. ("search", "beam") for --search=beam. "value" is NULL, "true" or
+   "false" for boolean options. Options can be changed between searches, and
+   are only checked when a dataset is loaded or a search is started.
+ */
+int bfss_set_option(struct bfss *, const char *name, const char *value);
+
+// Loads a dataset, in the same format as the command-line program.
+int bfss_load_file(struct bfss *, const char *path);
+
+int bfss_load_memory(struct bfss *, const char *data, size_t size);
+
+/* Runs a search and returns the JSON report the command-line program would
+   print, which must be freed by the caller, or NULL on error.
+ */
+char *bfss_search(struct bfss *);
+
+/* Evaluates a single subset, given in JSON as with --init-subset. Returns the
+   JSON report, as with --search=none.
+ */
+char *bfss_eval(struct bfss *, const char *subset);
+
+// Describes the last error.
+const char *bfss_error(const struct bfss *);
+
+#endif
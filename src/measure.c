@@ -1,40 +1,41 @@
 #include <string.h>
 #include "measure.h"
 #include "common.h"
-#include "dataset.h"
-#include "eval.h"
+#include "config.h"
 #include "cmd.h"
 
-extern struct config g_config;
-
-static double accuracy_micro(const struct conf_mat *mat)
+// The number of labels only matters to macro-averaged measures.
+static double accuracy_micro(const struct conf_mat *mat, size_t num_labels)
 {
+   (void)num_labels;
    double div = mat->true_pos + mat->false_pos + mat->true_neg + mat->false_neg;
    if (div)
       return (mat->true_pos + mat->true_neg) / div;
    return 0.;
 }
 
-static double precision_micro(const struct conf_mat *mat)
+static double precision_micro(const struct conf_mat *mat, size_t num_labels)
 {
+   (void)num_labels;
    double div = mat->true_pos + mat->false_pos;
    if (div)
       return mat->true_pos / div;
    return 0.;
 }
 
-static double recall_micro(const struct conf_mat *mat)
+static double recall_micro(const struct conf_mat *mat, size_t num_labels)
 {
+   (void)num_labels;
    double div = mat->true_pos + mat->false_neg;
    if (div)
       return mat->true_pos / div;
    return 0.;
 }
 
-static double F1_micro(const struct conf_mat *mat)
+static double F1_micro(const struct conf_mat *mat, size_t num_labels)
 {
-   double prec = precision_micro(mat);
-   double rec = recall_micro(mat);
+   double prec = precision_micro(mat, num_labels);
+   double rec = recall_micro(mat, num_labels);
    
    if (prec || rec)
       return 2 * prec * rec / (prec + rec);
@@ -42,13 +43,12 @@ static double F1_micro(const struct conf_mat *mat)
 }
 
 #define _(NAME)                                                                \
-static double NAME##_macro(const struct conf_mat *mat)                         \
+static double NAME##_macro(const struct conf_mat *mat, size_t num_labels)      \
 {                                                                              \
    double sum = 0;                                                             \
-   size_t num_labels = g_data.num_labels;                                      \
                                                                                \
    for (size_t label = 0; label < num_labels; label++)                         \
-      sum += NAME##_micro(&mat[label]);                                        \
+      sum += NAME##_micro(&mat[label], 1);                                     \
                                                                                \
    return sum / (double)num_labels;                                            \
 }
@@ -59,25 +59,27 @@ _(F1)
 #undef _
 
 #define _(TYPE)                                                                \
-static void full_eval_##TYPE(struct measures *ret, const struct conf_mat *mat) \
+static void full_eval_##TYPE(struct measures *ret, const struct conf_mat *mat, \
+                             size_t num_labels)                                \
 {                                                                              \
    *ret = (struct measures){                                                   \
-      .accuracy = accuracy_##TYPE(mat),                                        \
-      .precision = precision_##TYPE(mat),                                      \
-      .recall = recall_##TYPE(mat),                                            \
-      .F1 = F1_##TYPE(mat)                                                     \
+      .accuracy = accuracy_##TYPE(mat, num_labels),                            \
+      .precision = precision_##TYPE(mat, num_labels),                          \
+      .recall = recall_##TYPE(mat, num_labels),                                \
+      .F1 = F1_##TYPE(mat, num_labels)                                         \
    };                                                                          \
 }
 _(micro)
 _(macro)
 #undef _
 
-static double (*get_measure_func(bool macro))(const struct conf_mat *)
+static double (*get_measure_func(const struct config *config, bool macro))
+   (const struct conf_mat *, size_t)
 {   
    const struct {
       const char *name;
-      double (*micro)(const struct conf_mat *);
-      double (*macro)(const struct conf_mat *);
+      double (*micro)(const struct conf_mat *, size_t);
+      double (*macro)(const struct conf_mat *, size_t);
    } funcs[] = {
    #define _(NAME) {#NAME, NAME##_micro, NAME##_macro},
       _(accuracy)
@@ -88,20 +90,18 @@ static double (*get_measure_func(bool macro))(const struct conf_mat *)
    };
 
    for (size_t i = 0; i < sizeof funcs / sizeof *funcs; i++)
-      if (!strcmp(g_config.measure_name, funcs[i].name))
+      if (!strcmp(config->measure_name, funcs[i].name))
          return macro ? funcs[i].macro : funcs[i].micro;
 
-   die("invalid measure: %s", g_config.measure_name);
+   die("invalid measure: %s", config->measure_name);
 }
 
-double (*measure_func)(const struct conf_mat *);
-void (*full_eval)(struct measures *, const struct conf_mat *);
-
-void measure_init(void)
+void measure_init(struct measure *measure, const struct config *config, size_t num_labels)
 {
-   bool macro = !strcmp(g_config.classification_mode, "multiclass") &&
-                !strcmp(g_config.averaging_mode, "macro");
+   bool macro = !strcmp(config->classification_mode, "multiclass") &&
+                !strcmp(config->averaging_mode, "macro");
    
-   measure_func = get_measure_func(macro);
-   full_eval = macro ? full_eval_macro : full_eval_micro;
+   measure->func = get_measure_func(config, macro);
+   measure->full_eval = macro ? full_eval_macro : full_eval_micro;
+   measure->num_labels = num_labels;
 }
@@ -15,9 +15,32 @@ struct measures {
    double F1;
 };
 
-double (*measure_func)(const struct conf_mat *);
-void (*full_eval)(struct measures *, const struct conf_mat *);
+#include <stddef.h>
 
-void measure_init(void);
+struct config;
+
+/* Measure to maximize, and the measures of the full report. Macro-averaged
+   measures take one matrix per label.
+ */
+struct measure {
+   double (*func)(const struct conf_mat *, size_t num_labels);
+   void (*full_eval)(struct measures *, const struct conf_mat *, size_t num_labels);
+   size_t num_labels;
+};
+
+// Dies if the measure named in the options is invalid.
+void measure_init(struct measure *, const struct config *, size_t num_labels);
+
+static inline double measure_score(const struct measure *measure,
+                                   const struct conf_mat *mat)
+{
+   return measure->func(mat, measure->num_labels);
+}
+
+static inline void measure_full(const struct measure *measure, struct measures *ret,
+                                const struct conf_mat *mat)
+{
+   measure->full_eval(ret, mat, measure->num_labels);
+}
 
 #endif
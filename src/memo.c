@@ -0,0 +1,198 @@
+#include <pthread.h>
+#include <string.h>
+#include "memo.h"
+#include "column.h"
+#include "dataset.h"
+#include "measure.h"
+#include "common.h"
+
+#define MEMO_INIT_SIZE 1024      // Number of buckets, must be a power of two.
+
+struct memo_entry {
+   struct memo_entry *next;
+   uint64_t hash;
+   uint32_t key[];               // Followed by the confusion matrix.
+};
+
+struct memo {
+   struct memo_entry **table;
+   size_t size;                  // Number of buckets.
+   size_t num_entries;
+   size_t max_entries;
+   size_t num_features;
+   size_t key_size;              // In bytes.
+   size_t conf_mat_size;
+   size_t hits, misses;
+   pthread_mutex_t lock;
+};
+
+struct memo *memo_new(size_t num_features, size_t max_entries, size_t conf_mat_size)
+{
+   struct memo *memo = xmalloc(sizeof *memo);
+   *memo = (struct memo){
+      .max_entries = max_entries,
+      .num_features = num_features,
+      .key_size = num_features * sizeof(uint32_t),
+      .conf_mat_size = conf_mat_size,
+      .size = MEMO_INIT_SIZE,
+      .table = xcalloc(MEMO_INIT_SIZE, sizeof *memo->table),
+   };
+   pthread_mutex_init(&memo->lock, NULL);
+   return memo;
+}
+
+void memo_free(struct memo *memo)
+{
+   if (!memo)
+      return;
+   
+   for (size_t i = 0; i < memo->size; i++) {
+      struct memo_entry *entry = memo->table[i];
+      while (entry) {
+         struct memo_entry *next = entry->next;
+         free(entry);
+         entry = next;
+      }
+   }
+   free(memo->table);
+   pthread_mutex_destroy(&memo->lock);
+   free(memo);
+}
+
+void memo_reuse(struct memo *memo, size_t max_entries)
+{
+   memo->max_entries = max_entries;
+   memo->hits = memo->misses = 0;
+}
+
+static void set_group(const struct dataset *data, uint32_t *key, const struct column *col)
+{
+   uint32_t leader = col->origin;
+   for (uint32_t i = 0; i < leader; i++) {
+      if (col->links[i >> 5] & (1u << (i & 31))) {
+         leader = i;
+         break;
+      }
+   }
+   
+   key[col->origin] = leader;
+   for (size_t i = 0; i < data->links_size; i++) {
+      uint32_t word = col->links[i];
+      for (uint32_t j = 0; word; j++, word >>= 1)
+         if (word & 1)
+            key[i << 5 | j] = leader;
+   }
+}
+
+void memo_key(const struct dataset *data, const struct column *const *cols, size_t num_cols,
+              uint32_t *key)
+{
+   for (size_t i = 0; i < data->num_features; i++)
+      key[i] = UINT32_MAX;
+   for (size_t i = 0; i < num_cols; i++)
+      set_group(data, key, cols[i]);
+}
+
+uint64_t memo_hash(const uint32_t *key, size_t num_features)
+{
+   uint64_t hash = hash_bytes(HASH_INIT, key, num_features * sizeof *key);
+   return hash ^ (hash >> 32);
+}
+
+static struct memo_entry **find(struct memo *memo, const uint32_t *key, uint64_t hash)
+{
+   struct memo_entry **entry = &memo->table[hash & (memo->size - 1)];
+   while (*entry && ((*entry)->hash != hash
+                     || memcmp((*entry)->key, key, memo->key_size)))
+      entry = &(*entry)->next;
+   return entry;
+}
+
+bool memo_lookup(struct memo *memo, const uint32_t *key, struct conf_mat *mat)
+{
+   if (!memo->max_entries)
+      return false;
+   
+   uint64_t hash = memo_hash(key, memo->num_features);
+   
+   pthread_mutex_lock(&memo->lock);
+   struct memo_entry *entry = *find(memo, key, hash);
+   if (entry) {
+      memcpy(mat, (char *)entry->key + memo->key_size, memo->conf_mat_size);
+      memo->hits++;
+   } else {
+      memo->misses++;
+   }
+   pthread_mutex_unlock(&memo->lock);
+   
+   return entry;
+}
+
+/* Called with the lock held, so it must not die: chains just get longer if
+   the table can't be allocated.
+ */
+static void resize(struct memo *memo)
+{
+   size_t new_size = memo->size * 2;
+   struct memo_entry **new_table = calloc(new_size, sizeof *new_table);
+   if (!new_table)
+      return;
+   
+   for (size_t i = 0; i < memo->size; i++) {
+      struct memo_entry *entry = memo->table[i];
+      while (entry) {
+         struct memo_entry *next = entry->next;
+         size_t pos = entry->hash & (new_size - 1);
+         entry->next = new_table[pos];
+         new_table[pos] = entry;
+         entry = next;
+      }
+   }
+   free(memo->table);
+   memo->table = new_table;
+   memo->size = new_size;
+}
+
+void memo_insert(struct memo *memo, const uint32_t *key, const struct conf_mat *mat)
+{
+   uint64_t hash = memo_hash(key, memo->num_features);
+   
+   // Allocated beforehand, since die() would leave the lock held.
+   struct memo_entry *entry = xmalloc(sizeof *entry + memo->key_size + memo->conf_mat_size);
+   entry->next = NULL;
+   entry->hash = hash;
+   memcpy(entry->key, key, memo->key_size);
+   memcpy((char *)entry->key + memo->key_size, mat, memo->conf_mat_size);
+   
+   pthread_mutex_lock(&memo->lock);
+   struct memo_entry **pos = find(memo, key, hash);
+   if (!*pos && memo->num_entries < memo->max_entries) {
+      *pos = entry;
+      entry = NULL;
+      if (++memo->num_entries > memo->size)
+         resize(memo);
+   }
+   pthread_mutex_unlock(&memo->lock);
+   
+   // Another thread inserted the subset first, or the table is full.
+   free(entry);
+}
+
+size_t memo_bytes(const struct memo *memo)
+{
+   if (!memo)
+      return 0;
+   return memo->size * sizeof *memo->table
+        + memo->num_entries * (sizeof(struct memo_entry) + memo->key_size
+                               + memo->conf_mat_size);
+}
+
+size_t memo_hits(const struct memo *memo)
+{
+   return memo->hits;
+}
+
+size_t memo_misses(const struct memo *memo)
+{
+   return memo->misses;
+}
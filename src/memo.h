@@ -0,0 +1,53 @@
+#ifndef BFSS_MEMO_H
+#define BFSS_MEMO_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+struct column;
+struct conf_mat;
+struct dataset;
+
+/* Transposition table: confusion matrices of the subsets evaluated so far, so
+   that a subset reached again through another search path is not evaluated
+   twice. Subsets are identified by a canonical key, see memo_key(). A table
+   can be used by several threads at the same time.
+ */
+struct memo;
+
+struct memo *memo_new(size_t num_features, size_t max_entries, size_t conf_mat_size);
+
+void memo_free(struct memo *);
+
+/* Keeps the entries of the table for another search made in the same
+   evaluation context, see eval_context(). Only the limit and the counters are
+   reset.
+ */
+void memo_reuse(struct memo *, size_t max_entries);
+
+/* Computes the key of a subset, which must have room for "num_features"
+   elements. Element "i" is the smallest feature number of the group that
+   includes feature "i", or UINT32_MAX if the feature is not used. Keys thus
+   don't depend on the order of the columns, nor on the order in which features
+   were joined.
+ */
+void memo_key(const struct dataset *, const struct column *const *cols, size_t num_cols,
+              uint32_t *key);
+
+// Hash of a key, to look it up in hash tables.
+uint64_t memo_hash(const uint32_t *key, size_t num_features);
+
+// Copies the matrix of a subset into "mat" and returns true if it is known.
+bool memo_lookup(struct memo *, const uint32_t *key, struct conf_mat *mat);
+
+// Does nothing if the table is full.
+void memo_insert(struct memo *, const uint32_t *key, const struct conf_mat *mat);
+
+// Bytes allocated for the table and its entries.
+size_t memo_bytes(const struct memo *);
+
+size_t memo_hits(const struct memo *);
+size_t memo_misses(const struct memo *);
+
+#endif
@@ -0,0 +1,144 @@
+#define _DEFAULT_SOURCE
+
+#include <pthread.h>
+#include <sys/resource.h>
+#include "memory.h"
+#include "bfss.h"
+#include "memo.h"
+
+// Largest search recorded by memory_note_search(), guarded by g_search_lock.
+static pthread_mutex_t g_search_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct {
+   size_t num_workers;
+   size_t eval_bytes;
+   struct table_usage join;
+   size_t memo_bytes;
+} g_search;
+
+static void add_usage(struct table_usage *total, const struct table_usage *usage)
+{
+   total->num_types += usage->num_types;
+   total->num_buckets += usage->num_buckets;
+   if (usage->longest_chain > total->longest_chain)
+      total->longest_chain = usage->longest_chain;
+   total->bucket_bytes += usage->bucket_bytes;
+   total->feature_bytes += usage->feature_bytes;
+   total->free_features += usage->free_features;
+   total->free_bytes += usage->free_bytes;
+   total->samples_bytes += usage->samples_bytes;
+}
+
+static size_t usage_bytes(const struct table_usage *usage)
+{
+   return usage->bucket_bytes + usage->feature_bytes + usage->free_bytes
+        + usage->samples_bytes;
+}
+
+void memory_note_search(const struct memo *memo, const struct eval *const *evals,
+                        const struct column *const *join_columns, size_t num_workers)
+{
+   size_t eval_total = 0;
+   struct table_usage join = {0}, usage;
+   for (size_t i = 0; i < num_workers; i++) {
+      eval_total += eval_bytes(evals[i]);
+      column_usage(join_columns[i], &usage);
+      add_usage(&join, &usage);
+   }
+   size_t memo_total = memo_bytes(memo);
+   
+   pthread_mutex_lock(&g_search_lock);
+   if (eval_total + usage_bytes(&join) + memo_total
+       >= g_search.eval_bytes + usage_bytes(&g_search.join) + g_search.memo_bytes) {
+      g_search.num_workers = num_workers;
+      g_search.eval_bytes = eval_total;
+      g_search.join = join;
+      g_search.memo_bytes = memo_total;
+   }
+   pthread_mutex_unlock(&g_search_lock);
+}
+
+static const char *state_name(enum column_state state)
+{
+   switch (state) {
+   case COL_INACTIVE:
+      return "inactive";
+   case COL_MERGED:
+      return "merged";
+   case COL_ACTIVE:
+      return "active";
+   }
+   return "?";
+}
+
+static void print_usage(FILE *out, const struct table_usage *usage, const char *sp)
+{
+   fprintf(out, "\"num_types\":%s%zu,%s\"buckets\":%s%zu,%s\"load_factor\":%s%f,%s",
+           sp, usage->num_types, sp, sp, usage->num_buckets, sp, sp,
+           usage->num_buckets ? (double)usage->num_types / usage->num_buckets : 0., sp);
+   fprintf(out, "\"longest_chain\":%s%zu,%s\"bucket_bytes\":%s%zu,%s", sp,
+           usage->longest_chain, sp, sp, usage->bucket_bytes, sp);
+   fprintf(out, "\"feature_bytes\":%s%zu,%s\"free_features\":%s%zu,%s", sp,
+           usage->feature_bytes, sp, sp, usage->free_features, sp);
+   fprintf(out, "\"free_bytes\":%s%zu,%s\"samples_bytes\":%s%zu", sp,
+           usage->free_bytes, sp, sp, usage->samples_bytes);
+}
+
+void memory_report(FILE *out, const struct bfss *bfss, const char *when)
+{
+   const struct dataset *data = &bfss->data;
+   bool compact = bfss->config.compact_json;
+   const char *nl = compact ? "" : "\n";
+   const char *indent = compact ? "" : "   ";
+   const char *sep = compact ? ":" : ": ";
+   const char *sp = compact ? "" : " ";
+   
+   // Kilobytes on Linux.
+   struct rusage rusage;
+   size_t peak_rss = getrusage(RUSAGE_SELF, &rusage) ? 0 : (size_t)rusage.ru_maxrss * 1024;
+   
+   fprintf(out, "{%s", nl);
+   fprintf(out, "%s\"when\"%s\"%s\",%s", indent, sep, when, nl);
+   fprintf(out, "%s\"peak_rss_bytes\"%s%zu,%s", indent, sep, peak_rss, nl);
+   
+   struct table_usage total = {0}, usage;
+   fprintf(out, "%s\"columns\"%s[%s", indent, sep, nl);
+   for (size_t i = 0; i < data->num_features; i++) {
+      const struct column *col = &data->columns[i];
+      column_usage(col, &usage);
+      add_usage(&total, &usage);
+      fprintf(out, "%s%s{\"name\":%s%s,%s\"state\":%s\"%s\",%s", indent, indent, sp,
+              col->name.data, sp, sp, state_name(col->state), sp);
+      print_usage(out, &usage, sp);
+      fprintf(out, "}%s%s", i + 1 < data->num_features ? "," : "", nl);
+   }
+   fprintf(out, "%s],%s", indent, nl);
+   fprintf(out, "%s\"columns_total\"%s{", indent, sep);
+   print_usage(out, &total, sp);
+   fprintf(out, ",%s\"bytes\":%s%zu},%s", sp, sp, usage_bytes(&total), nl);
+   
+   size_t labels_bytes = 0;
+   for (size_t i = 0; i < data->num_targets; i++)
+      labels_bytes += data->num_samples * sizeof *data->targets[i].samples_labels;
+   fprintf(out, "%s\"labels_bytes\"%s%zu,%s", indent, sep, labels_bytes, nl);
+   size_t saved_bytes = data->saved_samples
+                        ? data->num_features * data->num_samples * sizeof **data->saved_samples
+                        : 0;
+   fprintf(out, "%s\"saved_samples_bytes\"%s%zu,%s", indent, sep, saved_bytes, nl);
+   
+   /* While no search has run, only the main evaluation context exists. Its
+      frequency buffers are only allocated by the first evaluation.
+    */
+   pthread_mutex_lock(&g_search_lock);
+   if (!g_search.num_workers) {
+      pthread_mutex_unlock(&g_search_lock);
+      fprintf(out, "%s\"eval_bytes\"%s%zu%s}\n", indent, sep, eval_bytes(&bfss->eval), nl);
+      return;
+   }
+   fprintf(out, "%s\"workers\"%s%zu,%s", indent, sep, g_search.num_workers, nl);
+   fprintf(out, "%s\"eval_bytes\"%s%zu,%s", indent, sep, g_search.eval_bytes, nl);
+   fprintf(out, "%s\"join_columns\"%s{", indent, sep);
+   print_usage(out, &g_search.join, sp);
+   fprintf(out, ",%s\"bytes\":%s%zu},%s", sp, sp, usage_bytes(&g_search.join), nl);
+   fprintf(out, "%s\"memo_bytes\"%s%zu%s}\n", indent, sep, g_search.memo_bytes, nl);
+   pthread_mutex_unlock(&g_search_lock);
+}
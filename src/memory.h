@@ -0,0 +1,28 @@
+#ifndef BFSS_MEMORY_H
+#define BFSS_MEMORY_H
+
+#include <stdio.h>
+#include "column.h"
+#include "eval.h"
+
+struct bfss;
+struct memo;
+
+/* Memory report, enabled with --memory-report: the tables of the dataset
+   columns, the buffers of the evaluation contexts, the join columns of the
+   workers and the transposition table, and the peak resident set size.
+ */
+
+/* Records the buffers of the workers of a search, and its transposition table,
+   before they are freed, for the report made at exit. The largest search of
+   the process is kept.
+ */
+void memory_note_search(const struct memo *, const struct eval *const *evals,
+                        const struct column *const *join_columns, size_t num_workers);
+
+/* Writes the report on the dataset of "bfss" as a JSON document, with "when"
+   describing the moment it is made.
+ */
+void memory_report(FILE *, const struct bfss *, const char *when);
+
+#endif
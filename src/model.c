@@ -0,0 +1,497 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "model.h"
+#include "buffer.h"
+#include "column.h"
+#include "bfss.h"
+#include "common.h"
+#include "cmd.h"
+
+/* Values of the original columns, see model_init(). Only the command-line
+   program saves models, so this is kept for the whole process.
+ */
+static struct {
+   struct buffer *values;     // Values of each column, in identifiers order,
+   size_t **offsets;          // each one followed by a NUL.
+} g_values;
+
+// File being written.
+static struct buffer g_file = BUFFER_INIT;
+
+void model_init(struct bfss *bfss)
+{
+   struct dataset *data = &bfss->data;
+   size_t num_features = data->num_features;
+
+   save_columns(data);
+   g_values.values = xmalloc(num_features * sizeof *g_values.values);
+   g_values.offsets = xmalloc(num_features * sizeof *g_values.offsets);
+   for (size_t i = 0; i < num_features; i++) {
+      const struct column *col = &data->columns[i];
+      size_t num_values = col->table.num_types;
+      const char **values = xmalloc(num_values * sizeof *values);
+      column_values(col, values);
+
+      struct buffer *buf = &g_values.values[i];
+      *buf = (struct buffer)BUFFER_INIT;
+      g_values.offsets[i] = xmalloc(num_values * sizeof **g_values.offsets);
+      for (size_t j = 0; j < num_values; j++) {
+         g_values.offsets[i][j] = buf->size;
+         buffer_cat(buf, values[j], strlen(values[j]) + 1);
+      }
+      free(values);
+   }
+}
+
+static uint64_t align(void)
+{
+   static const char zeros[8];
+   if (g_file.size % 8)
+      buffer_cat(&g_file, zeros, 8 - g_file.size % 8);
+   return g_file.size;
+}
+
+// Appends an aligned array, or zeroes if "data" is NULL.
+static uint64_t put(const void *data, size_t size)
+{
+   uint64_t offset = align();
+   buffer_ensure(&g_file, offset + size);
+   if (data)
+      memcpy(&g_file.data[offset], data, size);
+   else
+      memset(&g_file.data[offset], 0, size);
+   g_file.size += size;
+   return offset;
+}
+
+static uint64_t put_string(const char *str, size_t length)
+{
+   uint64_t offset = g_file.size;
+   buffer_cat(&g_file, str, length);
+   buffer_catc(&g_file, '\0');
+   return offset;
+}
+
+// Column names are kept encoded as JSON strings, see buffer_set_json().
+static uint64_t put_name(const struct buffer *name)
+{
+   uint64_t offset = g_file.size;
+   for (size_t i = 1; i + 1 < name->size; i++) {
+      if (name->data[i] == '\\')
+         i++;
+      buffer_catc(&g_file, name->data[i]);
+   }
+   buffer_catc(&g_file, '\0');
+   return offset;
+}
+
+static uint32_t num_slots(size_t num_entries)
+{
+   size_t size = 2;
+   while (size < 2 * num_entries)
+      size <<= 1;
+   if (size > UINT32_MAX)
+      die("too many values to save the model");
+   return size;
+}
+
+static void put_feature(const struct dataset *data, uint64_t offset, size_t feat_no)
+{
+   const struct buffer *values = &g_values.values[feat_no];
+   const size_t *offsets = g_values.offsets[feat_no];
+   uint32_t num_values = data->columns[feat_no].table.num_types;
+
+   struct model_feature feat = {
+      .name = put_name(&data->columns[feat_no].name),
+      .num_values = num_values,
+      .num_slots = num_slots(num_values),
+   };
+
+   uint32_t *slots = xmalloc(feat.num_slots * sizeof *slots);
+   struct model_value *entries = xcalloc(num_values, sizeof *entries);
+   for (size_t i = 0; i < feat.num_slots; i++)
+      slots[i] = MODEL_NONE;
+   for (uint32_t id = 0; id < num_values; id++) {
+      const char *value = &values->data[offsets[id]];
+      size_t length = strlen(value);
+      entries[id] = (struct model_value){
+         .hash = model_hash(value, length),
+         .string = put_string(value, length),
+         .length = length,
+      };
+      size_t pos = entries[id].hash & (feat.num_slots - 1);
+      while (slots[pos] != MODEL_NONE)
+         pos = (pos + 1) & (feat.num_slots - 1);
+      slots[pos] = id;
+   }
+   feat.slots = put(slots, feat.num_slots * sizeof *slots);
+   feat.values = put(entries, num_values * sizeof *entries);
+   free(slots);
+   free(entries);
+
+   memcpy(&g_file.data[offset], &feat, sizeof feat);
+}
+
+/* Gives an identifier to each tuple of values of the group's features, in
+   order of appearance, and writes the type of each sample to "types". Returns
+   the number of types.
+ */
+static uint32_t find_types(const struct dataset *data, struct model_group *group,
+                           const uint32_t *features, uint32_t *types)
+{
+   size_t k = group->num_features;
+   if (k == 1) {
+      const struct table *table = &data->columns[features[0]].table;
+      memcpy(types, table->samples, data->num_samples * sizeof *types);
+      return table->num_types;
+   }
+
+   uint32_t *tuples = NULL;
+   size_t tuples_alloc = 0, num_types = 0;
+   size_t size = 16, mask = size - 1;
+   uint32_t *slots = xmalloc(size * sizeof *slots);
+   for (size_t i = 0; i < size; i++)
+      slots[i] = MODEL_NONE;
+
+   uint32_t tuple[k];
+   for (size_t i = 0; i < data->num_samples; i++) {
+      for (size_t j = 0; j < k; j++)
+         tuple[j] = data->columns[features[j]].table.samples[i];
+
+      size_t pos = model_hash(tuple, sizeof tuple) & mask;
+      while (slots[pos] != MODEL_NONE && memcmp(&tuples[slots[pos] * k], tuple, sizeof tuple))
+         pos = (pos + 1) & mask;
+      if (slots[pos] != MODEL_NONE) {
+         types[i] = slots[pos];
+         continue;
+      }
+
+      ENLARGE(tuples, (num_types + 1) * k, tuples_alloc, 16 * k);
+      memcpy(&tuples[num_types * k], tuple, sizeof tuple);
+      types[i] = slots[pos] = num_types++;
+      if (num_types == UINT32_MAX)
+         die("too many types to save the model");
+
+      if (2 * num_types >= size) {
+         size *= 2;
+         mask = size - 1;
+         slots = xrealloc(slots, size * sizeof *slots);
+         for (size_t j = 0; j < size; j++)
+            slots[j] = MODEL_NONE;
+         for (uint32_t id = 0; id < num_types; id++) {
+            pos = model_hash(&tuples[id * k], sizeof tuple) & mask;
+            while (slots[pos] != MODEL_NONE)
+               pos = (pos + 1) & mask;
+            slots[pos] = id;
+         }
+      }
+   }
+
+   group->num_slots = size;
+   group->slots = put(slots, size * sizeof *slots);
+   group->tuples = put(tuples, num_types * sizeof tuple);
+   free(slots);
+   free(tuples);
+   return num_types;
+}
+
+static void put_group(const struct bfss *bfss, uint64_t offset, struct model_group *group,
+                      const uint32_t *features, const uint32_t *labels_freqs)
+{
+   const struct dataset *data = &bfss->data;
+   double smooth = bfss->config.smooth;
+   size_t num_labels = data->num_labels;
+   uint32_t *types = xmalloc(data->num_samples * sizeof *types);
+   uint32_t num_types = group->num_types = find_types(data, group, features, types);
+
+   uint32_t (*freqs)[num_labels] = xcalloc(num_types, sizeof *freqs);
+   for (size_t i = 0; i < data->num_samples; i++)
+      freqs[types[i]][data->samples_labels[i]]++;
+   free(types);
+
+   // As in compute_feat_probs(), the last row being that of unseen types.
+   double (*log_probs)[num_labels] = xmalloc((num_types + 1) * sizeof *log_probs);
+   double div_smooth = smooth * num_types;
+   for (size_t type = 0; type <= num_types; type++) {
+      for (size_t label = 0; label < num_labels; label++) {
+         uint32_t freq = type < num_types ? freqs[type][label] : 0;
+         double prob = (freq + smooth)
+                     / (double)(labels_freqs[label] + div_smooth);
+         log_probs[type][label] = log2(prob);
+      }
+   }
+   group->log_probs = put(log_probs, (num_types + 1) * sizeof *log_probs);
+   free(freqs);
+   free(log_probs);
+
+   memcpy(&g_file.data[offset], group, sizeof *group);
+}
+
+static void write_file(const char *path)
+{
+   struct buffer tmp_path = BUFFER_INIT;
+   buffer_cat(&tmp_path, path, strlen(path));
+   buffer_cat(&tmp_path, ".tmp", 4);
+
+   FILE *fp = fopen(tmp_path.data, "wb");
+   if (!fp)
+      die("can't create model at %s: %s", tmp_path.data, strerror(errno));
+   fwrite(g_file.data, 1, g_file.size, fp);
+   if (ferror(fp) | fclose(fp))
+      die("can't write model at %s: %s", tmp_path.data, strerror(errno));
+   if (rename(tmp_path.data, path))
+      die("can't rename %s to %s: %s", tmp_path.data, path, strerror(errno));
+
+   buffer_fini(&tmp_path);
+}
+
+void model_save(struct bfss *bfss, const char *path)
+{
+   struct dataset *data = &bfss->data;
+   double smooth = bfss->config.smooth;
+   size_t num_labels = data->num_labels;
+
+   // Features of the groups, in the order of the evaluation.
+   uint32_t *features = xmalloc(data->num_features * sizeof *features);
+   uint32_t *group_sizes = xmalloc(data->num_features * sizeof *group_sizes);
+   size_t num_features = 0, num_groups = 0;
+   for (size_t i = 0; i < data->num_features; i++) {
+      const struct column *col = &data->columns[i];
+      if (col->state != COL_ACTIVE)
+         continue;
+      features[num_features++] = i;
+      for (size_t j = 0; j < data->num_features; j++)
+         if (col->links[j >> 5] & (1u << (j & 31)))
+            features[num_features++] = j;
+      group_sizes[num_groups++] = col->num_links + 1;
+   }
+   restore_columns(data);
+
+   uint32_t *labels_freqs = xcalloc(num_labels, sizeof *labels_freqs);
+   for (size_t i = 0; i < data->num_samples; i++)
+      labels_freqs[data->samples_labels[i]]++;
+
+   buffer_clear(&g_file);
+   struct model_header header = {
+      .version = MODEL_VERSION,
+      .byte_order = MODEL_BYTE_ORDER,
+      .num_labels = num_labels,
+      .num_features = num_features,
+      .num_groups = num_groups,
+   };
+   memcpy(header.magic, MODEL_MAGIC, sizeof header.magic);
+   put(NULL, sizeof header);
+
+   uint64_t *labels = xmalloc(num_labels * sizeof *labels);
+   for (size_t i = 0; i < num_labels; i++)
+      labels[i] = put_string(data->labels[i], strlen(data->labels[i]));
+   header.labels = put(labels, num_labels * sizeof *labels);
+   free(labels);
+
+   // As in compute_priors().
+   double *priors = xmalloc(num_labels * sizeof *priors);
+   double denom = (uint32_t)data->num_samples + smooth * num_labels;
+   for (size_t label = 0; label < num_labels; label++)
+      priors[label] = log2((labels_freqs[label] + smooth) / denom);
+   header.priors = put(priors, num_labels * sizeof *priors);
+   free(priors);
+
+   header.features = put(NULL, num_features * sizeof(struct model_feature));
+   header.groups = put(NULL, num_groups * sizeof(struct model_group));
+   for (size_t i = 0; i < num_features; i++)
+      put_feature(data, header.features + i * sizeof(struct model_feature), features[i]);
+
+   for (size_t i = 0, first = 0; i < num_groups; first += group_sizes[i++]) {
+      struct model_group group = {
+         .first_feature = first,
+         .num_features = group_sizes[i],
+      };
+      put_group(bfss, header.groups + i * sizeof group, &group, &features[first],
+                labels_freqs);
+   }
+
+   header.file_size = align();
+   memcpy(g_file.data, &header, sizeof header);
+   write_file(path);
+
+   free(features);
+   free(group_sizes);
+   free(labels_freqs);
+   buffer_fini(&g_file);
+   g_file = (struct buffer)BUFFER_INIT;
+}
+
+noreturn static void die_model(const struct model *model, const char *msg)
+{
+   die("invalid model at %s: %s", model->path, msg);
+}
+
+// Checks that an array of "count" elements of "size" bytes is in the file.
+static void check_array(const struct model *model, uint64_t offset, uint64_t count,
+                        size_t size, const char *what)
+{
+   if (offset % 8 || offset > model->size || count > (model->size - offset) / size)
+      die_model(model, what);
+}
+
+static void check_string(const struct model *model, uint64_t offset, const char *what)
+{
+   if (offset >= model->size || !memchr(&model->data[offset], '\0', model->size - offset))
+      die_model(model, what);
+}
+
+static bool power_of_two(uint32_t n)
+{
+   return n && !(n & (n - 1));
+}
+
+static void check_model(struct model *model)
+{
+   const struct model_header *header = model->header;
+
+   if (model->size < sizeof *header || memcmp(header->magic, MODEL_MAGIC, sizeof header->magic))
+      die_model(model, "not a model file");
+   if (header->byte_order != MODEL_BYTE_ORDER)
+      die_model(model, "made on a machine with another byte order");
+   if (header->version != MODEL_VERSION)
+      die_model(model, "unsupported version");
+   if (header->file_size != model->size)
+      die_model(model, "truncated file");
+
+   check_array(model, header->labels, header->num_labels, sizeof(uint64_t), "labels");
+   check_array(model, header->priors, header->num_labels, sizeof(double), "priors");
+   check_array(model, header->features, header->num_features,
+               sizeof(struct model_feature), "features");
+   check_array(model, header->groups, header->num_groups,
+               sizeof(struct model_group), "groups");
+   model->labels = (const uint64_t *)&model->data[header->labels];
+   model->priors = (const double *)&model->data[header->priors];
+   model->features = (const struct model_feature *)&model->data[header->features];
+   model->groups = (const struct model_group *)&model->data[header->groups];
+   for (size_t i = 0; i < header->num_labels; i++)
+      check_string(model, model->labels[i], "label name");
+
+   for (size_t i = 0; i < header->num_features; i++) {
+      const struct model_feature *feat = &model->features[i];
+      check_string(model, feat->name, "feature name");
+      if (!power_of_two(feat->num_slots) || feat->num_slots <= feat->num_values)
+         die_model(model, "feature table");
+      check_array(model, feat->slots, feat->num_slots, sizeof(uint32_t), "feature table");
+      check_array(model, feat->values, feat->num_values, sizeof(struct model_value),
+                  "feature values");
+   }
+
+   uint32_t next_feature = 0;
+   for (size_t i = 0; i < header->num_groups; i++) {
+      const struct model_group *group = &model->groups[i];
+      if (group->first_feature != next_feature || !group->num_features
+          || group->num_features > header->num_features - next_feature)
+         die_model(model, "group features");
+      next_feature += group->num_features;
+
+      if (group->num_features > 1) {
+         if (!power_of_two(group->num_slots) || group->num_slots <= group->num_types)
+            die_model(model, "group table");
+         check_array(model, group->slots, group->num_slots, sizeof(uint32_t), "group table");
+         check_array(model, group->tuples, group->num_types,
+                     group->num_features * sizeof(uint32_t), "group types");
+      } else if (group->num_types != model->features[group->first_feature].num_values) {
+         die_model(model, "group types");
+      }
+      check_array(model, group->log_probs, group->num_types + 1ull,
+                  header->num_labels * sizeof(double), "probabilities");
+   }
+   if (next_feature != header->num_features)
+      die_model(model, "group features");
+}
+
+void model_open(struct model *model, const char *path)
+{
+   int fd = open(path, O_RDONLY);
+   if (fd < 0)
+      die("can't open model at %s: %s", path, strerror(errno));
+   struct stat st;
+   if (fstat(fd, &st))
+      die("can't stat model at %s: %s", path, strerror(errno));
+   if (!st.st_size)
+      die("invalid model at %s: empty file", path);
+
+   void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+   if (data == MAP_FAILED)
+      die("can't map model at %s: %s", path, strerror(errno));
+   close(fd);
+
+   *model = (struct model){
+      .path = path,
+      .data = data,
+      .size = st.st_size,
+      .header = data,
+   };
+   check_model(model);
+}
+
+void model_close(struct model *model)
+{
+   munmap((void *)model->data, model->size);
+   *model = (struct model){0};
+}
+
+uint32_t model_value(const struct model *model, const struct model_feature *feat,
+                     const char *value, size_t length)
+{
+   const uint32_t *slots = (const uint32_t *)&model->data[feat->slots];
+   const struct model_value *values = (const struct model_value *)&model->data[feat->values];
+   uint64_t hash = model_hash(value, length);
+   uint32_t mask = feat->num_slots - 1;
+
+   for (uint32_t pos = hash & mask, i = 0; i < feat->num_slots; pos = (pos + 1) & mask, i++) {
+      uint32_t id = slots[pos];
+      if (id == MODEL_NONE)
+         return MODEL_NONE;
+      if (id >= feat->num_values)
+         die_model(model, "feature table");
+      const struct model_value *entry = &values[id];
+      if (entry->hash != hash || entry->length != length)
+         continue;
+      if (entry->string >= model->size || length > model->size - entry->string)
+         die_model(model, "feature values");
+      if (!memcmp(&model->data[entry->string], value, length))
+         return id;
+   }
+   return MODEL_NONE;
+}
+
+uint32_t model_type(const struct model *model, const struct model_group *group,
+                    const uint32_t *value_ids)
+{
+   size_t k = group->num_features;
+   for (size_t i = 0; i < k; i++)
+      if (value_ids[i] == MODEL_NONE)
+         return group->num_types;
+   if (k == 1)
+      return value_ids[0];
+
+   const uint32_t *slots = (const uint32_t *)&model->data[group->slots];
+   const uint32_t *tuples = (const uint32_t *)&model->data[group->tuples];
+   uint64_t hash = model_hash(value_ids, k * sizeof *value_ids);
+   uint32_t mask = group->num_slots - 1;
+
+   for (uint32_t pos = hash & mask, i = 0; i < group->num_slots; pos = (pos + 1) & mask, i++) {
+      uint32_t id = slots[pos];
+      if (id == MODEL_NONE)
+         break;
+      if (id >= group->num_types)
+         die_model(model, "group table");
+      if (!memcmp(&tuples[(size_t)id * k], value_ids, k * sizeof *value_ids))
+         return id;
+   }
+   return group->num_types;
+}
@@ -0,0 +1,140 @@
+#ifndef BFSS_MODEL_H
+#define BFSS_MODEL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "common.h"
+
+struct bfss;
+
+/* Model file written with --save-model: the classifier of the selected subset,
+   trained on all samples. It is meant to be mapped in memory and used as is,
+   so it is made of fixed-size structures in the byte order of the machine that
+   wrote it, all aligned on 8 bytes. Locations in the file are given as offsets
+   from its start. Strings are NUL-terminated.
+
+   The file starts with a header. Each feature of the subset has a dictionary
+   of the values seen in the dataset, which gives them identifiers from 0 to
+   num_values - 1. It is an open-addressing hash table of value identifiers,
+   with linear probing, indexed by model_hash() of the value.
+
+   Features are grouped as in the subset. The type of a sample in a group is
+   identified by the tuple of its values identifiers, in the order of the
+   group's features. Groups of several features have a hash table of type
+   identifiers indexed by model_hash() of the tuple, taken as an array of
+   uint32_t; the type of a group of one feature is its value identifier.
+
+   Each group has a table of log2 probabilities, with one row per type plus a
+   last row for types not seen in the dataset, and one column per label. The
+   log2 probabilities of the labels of a sample are the sum of the priors and
+   of the rows of its types in the groups, added in the order of the groups;
+   the predicted label is the first one with the highest sum. This is the
+   computation made by the evaluation (see eval.c), with all samples used for
+   training.
+ */
+#define MODEL_MAGIC "BFSSMODL"
+#define MODEL_VERSION 1
+#define MODEL_BYTE_ORDER 0x01020304u
+
+// Empty slot of a hash table, or value or type not found.
+#define MODEL_NONE UINT32_MAX
+
+struct model_header {
+   char magic[8];             // MODEL_MAGIC, not terminated.
+   uint32_t version;          // MODEL_VERSION.
+   uint32_t byte_order;       // MODEL_BYTE_ORDER.
+   uint64_t file_size;
+   uint32_t num_labels;
+   uint32_t num_features;
+   uint32_t num_groups;
+   uint32_t reserved;
+   uint64_t labels;           // uint64_t[num_labels]: names of the labels.
+   uint64_t priors;           // double[num_labels]
+   uint64_t features;         // struct model_feature[num_features]
+   uint64_t groups;           // struct model_group[num_groups]
+};
+
+struct model_feature {
+   uint64_t name;
+   uint32_t num_values;
+   uint32_t num_slots;        // Power of two.
+   uint64_t slots;            // uint32_t[num_slots]: identifiers or MODEL_NONE.
+   uint64_t values;           // struct model_value[num_values]
+};
+
+struct model_value {
+   uint64_t hash;             // model_hash() of the value.
+   uint64_t string;
+   uint32_t length;           // Without the terminating NUL.
+   uint32_t reserved;
+};
+
+struct model_group {
+   uint32_t first_feature;    // Features of the group, contiguous.
+   uint32_t num_features;
+   uint32_t num_types;
+   uint32_t num_slots;        // Power of two, zero if the group has one feature.
+   uint64_t slots;            // uint32_t[num_slots]: identifiers or MODEL_NONE.
+   uint64_t tuples;           // uint32_t[num_types][num_features]
+   uint64_t log_probs;        // double[num_types + 1][num_labels]
+};
+
+// hash_bytes(), with the high bits folded into the low ones.
+static inline uint64_t model_hash(const void *data, size_t size)
+{
+   uint64_t hash = hash_bytes(HASH_INIT, data, size);
+   return hash ^ (hash >> 32);
+}
+
+/* Must be called once the dataset is loaded, before the search: copies the
+   values of the features and the original columns, which the search modifies.
+ */
+void model_init(struct bfss *);
+
+/* Trains a classifier on the active columns and writes it to "path". The file
+   is written to a temporary file which is then renamed. The original columns
+   are restored, see restore_columns().
+ */
+void model_save(struct bfss *, const char *path);
+
+// Model mapped in memory.
+struct model {
+   const char *path;
+   const unsigned char *data;
+   size_t size;
+   const struct model_header *header;
+   const uint64_t *labels;
+   const double *priors;
+   const struct model_feature *features;
+   const struct model_group *groups;
+};
+
+// Maps a model file in memory, and checks its structure. Dies on error.
+void model_open(struct model *, const char *path);
+
+void model_close(struct model *);
+
+static inline const char *model_string(const struct model *model, uint64_t offset)
+{
+   return (const char *)&model->data[offset];
+}
+
+// Identifier of a value of a feature, or MODEL_NONE if it is unknown.
+uint32_t model_value(const struct model *, const struct model_feature *,
+                     const char *value, size_t length);
+
+/* Type of a sample in a group, given the identifiers of its values in the
+   features of the group. Returns num_types for unknown types.
+ */
+uint32_t model_type(const struct model *, const struct model_group *,
+                    const uint32_t *value_ids);
+
+static inline const double *model_log_probs(const struct model *model,
+                                            const struct model_group *group,
+                                            uint32_t type)
+{
+   const double *log_probs = (const double *)&model->data[group->log_probs];
+   return &log_probs[(size_t)type * model->header->num_labels];
+}
+
+#endif
@@ -0,0 +1,213 @@
+#include <math.h>
+#include <string.h>
+#include "mutual.h"
+#include "column.h"
+#include "dataset.h"
+#include "common.h"
+
+/* Conditional mutual information is computed as in TAN structure learning
+   (Friedman et al., 1997):
+   
+      I(X;Y|C) = H(X,C) + H(Y,C) - H(X,Y,C) - H(C)
+   
+   The joint entropy of two features is obtained by joining their columns and
+   counting the result over all samples.
+ */
+struct mutual {
+   const struct dataset *data;
+   double *class_info;     // I(X;C), per feature.
+   double *pair_info;      // I(X;Y|C), per features pair.
+   bool *allowed;          // Whether a pair hasn't been pruned.
+   size_t *members;        // Buffer for the features of two columns.
+   double cost;
+};
+
+struct pair {
+   double info;
+   size_t feat;
+};
+
+// Sorts features by decreasing dependence, then by number.
+static int cmp_pairs(const void *x_, const void *y_)
+{
+   const struct pair *x = x_, *y = y_;
+   
+   if (x->info != y->info)
+      return x->info < y->info ? 1 : -1;
+   return x->feat < y->feat ? -1 : x->feat > y->feat;
+}
+
+static void prune_pairs(struct mutual *mutual, size_t max_pairs)
+{
+   size_t num_features = mutual->data->num_features;
+   struct pair *order = xmalloc(num_features * sizeof *order);
+   
+   for (size_t i = 0; i < num_features; i++) {
+      const double *info = &mutual->pair_info[i * num_features];
+      size_t num_others = 0;
+      for (size_t j = 0; j < num_features; j++)
+         if (j != i)
+            order[num_others++] = (struct pair){info[j], j};
+      qsort(order, num_others, sizeof *order, cmp_pairs);
+      
+      for (size_t k = 0; k < num_others && k < max_pairs; k++) {
+         size_t j = order[k].feat;
+         mutual->allowed[i * num_features + j] = true;
+         mutual->allowed[j * num_features + i] = true;
+      }
+   }
+   free(order);
+}
+
+static double labels_entropy(const struct dataset *data)
+{
+   size_t num_labels = data->num_labels;
+   uint32_t *freqs = xcalloc(num_labels, sizeof *freqs);
+   
+   for (size_t i = 0; i < data->num_samples; i++)
+      freqs[data->samples_labels[i]]++;
+   
+   double sum = 0.;
+   for (size_t label = 0; label < num_labels; label++)
+      if (freqs[label])
+         sum += freqs[label] * log2(freqs[label]);
+   free(freqs);
+   
+   double num_samples = data->num_samples;
+   return log2(num_samples) - sum / num_samples;
+}
+
+struct mutual *mutual_new(const struct dataset *data, size_t max_pairs)
+{
+   double start = now();
+   
+   size_t num_features = data->num_features;
+   struct column *columns = data->columns;
+   struct column *join_column = column_alloc_joined(data);
+   
+   struct mutual *mutual = xmalloc(sizeof *mutual);
+   *mutual = (struct mutual){
+      .data = data,
+      .class_info = xmalloc(num_features * sizeof *mutual->class_info),
+      .pair_info = xcalloc(num_features * num_features, sizeof *mutual->pair_info),
+      .allowed = xcalloc(num_features * num_features, sizeof *mutual->allowed),
+      .members = xmalloc(2 * num_features * sizeof *mutual->members),
+   };
+   
+   double h_class = labels_entropy(data);
+   double *h_joint = xmalloc(num_features * sizeof *h_joint);
+   
+   for (size_t i = 0; i < num_features; i++) {
+      double h_values;
+      column_entropy(&columns[i], &h_values, &h_joint[i]);
+      mutual->class_info[i] = h_values + h_class - h_joint[i];
+   }
+   
+   for (size_t i = 0; i < num_features; i++) {
+      for (size_t j = i + 1; j < num_features; j++) {
+         double h_values, h_pair;
+         column_join(join_column, &columns[i], &columns[j]);
+         column_entropy(join_column, &h_values, &h_pair);
+         double info = h_joint[i] + h_joint[j] - h_pair - h_class;
+         mutual->pair_info[i * num_features + j] = info;
+         mutual->pair_info[j * num_features + i] = info;
+      }
+   }
+   column_free_joined(join_column);
+   free(h_joint);
+   
+   prune_pairs(mutual, max_pairs);
+   
+   mutual->cost = now() - start;
+   return mutual;
+}
+
+void mutual_free(struct mutual *mutual)
+{
+   if (!mutual)
+      return;
+   
+   free(mutual->class_info);
+   free(mutual->pair_info);
+   free(mutual->allowed);
+   free(mutual->members);
+   free(mutual);
+}
+
+double mutual_class(const struct mutual *mutual, const struct column *col)
+{
+   assert(!col->num_links);
+   return mutual->class_info[col->origin];
+}
+
+static void get_members(const struct column *col, size_t *members, size_t *num_members)
+{
+   size_t nr = 0;
+   
+   members[nr++] = col->origin;
+   for (size_t i = 0; i < col->data->num_features && nr <= col->num_links; i++)
+      if (col->links[i >> 5] & (1u << (i & 31)))
+         members[nr++] = i;
+   
+   *num_members = nr;
+}
+
+/* Calls "func" for each pair of original features of the two columns, until it
+   returns true.
+ */
+static bool each_pair(struct mutual *mutual, const struct column *x,
+                      const struct column *y, bool (*func)(size_t, size_t, void *),
+                      void *arg)
+{
+   size_t *x_members = mutual->members;
+   size_t *y_members = &x_members[mutual->data->num_features];
+   size_t x_nr, y_nr;
+   
+   get_members(x, x_members, &x_nr);
+   get_members(y, y_members, &y_nr);
+   
+   bool ret = false;
+   for (size_t i = 0; i < x_nr && !ret; i++)
+      for (size_t j = 0; j < y_nr && !ret; j++)
+         ret = func(x_members[i], y_members[j], arg);
+   
+   return ret;
+}
+
+struct max_info {
+   const struct mutual *mutual;
+   double max;
+};
+
+static bool max_info(size_t x, size_t y, void *arg)
+{
+   struct max_info *max = arg;
+   double info = max->mutual->pair_info[x * max->mutual->data->num_features + y];
+   if (info > max->max)
+      max->max = info;
+   return false;
+}
+
+double mutual_pair(struct mutual *mutual, const struct column *x, const struct column *y)
+{
+   struct max_info max = {mutual, -INFINITY};
+   each_pair(mutual, x, y, max_info, &max);
+   return max.max;
+}
+
+static bool pair_allowed(size_t x, size_t y, void *arg)
+{
+   const struct mutual *mutual = arg;
+   return mutual->allowed[x * mutual->data->num_features + y];
+}
+
+bool mutual_pair_allowed(struct mutual *mutual, const struct column *x,
+                         const struct column *y)
+{
+   return each_pair(mutual, x, y, pair_allowed, mutual);
+}
+
+double mutual_cost(const struct mutual *mutual)
+{
+   return mutual ? mutual->cost : 0.;
+}
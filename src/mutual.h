@@ -0,0 +1,35 @@
+#ifndef BFSS_MUTUAL_H
+#define BFSS_MUTUAL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+struct column;
+struct dataset;
+
+/* Mutual information between features and labels, used to order candidates
+   and to prune joins. Must be computed before the search starts, when no column
+   has been merged yet. Features pairs that are not among the "max_pairs" most dependent
+   pairs of either feature are pruned.
+ */
+struct mutual;
+
+struct mutual *mutual_new(const struct dataset *, size_t max_pairs);
+
+void mutual_free(struct mutual *);
+
+// Mutual information I(X;C) of a base column and of the labels.
+double mutual_class(const struct mutual *, const struct column *);
+
+/* Highest conditional mutual information I(X;Y|C) between the original
+   features of two columns.
+ */
+double mutual_pair(struct mutual *, const struct column *, const struct column *);
+
+// Whether joining the two columns has not been pruned.
+bool mutual_pair_allowed(struct mutual *, const struct column *, const struct column *);
+
+// Time spent computing mutual information, in seconds, or zero if "mutual" is NULL.
+double mutual_cost(const struct mutual *);
+
+#endif
@@ -0,0 +1,173 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include "pool.h"
+#include "common.h"
+#include "cmd.h"
+
+struct pool {
+   pthread_t *threads;
+   size_t num_threads;        // Including the calling thread.
+   
+   pthread_mutex_t lock;
+   pthread_cond_t wake;       // Signaled when a batch of tasks is available.
+   pthread_cond_t done;       // Signaled when the last thread is done.
+   unsigned long batch_no;    // Incremented for each call of pool_run().
+   size_t num_running;        // Threads still working on the current batch.
+   bool quit;
+   
+   atomic_size_t next_task;
+   size_t num_tasks;
+   void (*func)(size_t, size_t, void *);
+   void *arg;
+   
+   bool failed;               // A task of the current batch died.
+   char error[sizeof ((struct die_handler *)0)->msg];
+};
+
+// Thread arguments.
+struct worker {
+   struct pool *pool;
+   size_t worker_no;
+};
+
+static void run_tasks(struct pool *pool, size_t worker_no)
+{
+   struct die_handler handler, *prev_handler = g_die_handler;
+   if (setjmp(handler.env)) {
+      g_die_handler = prev_handler;
+      pthread_mutex_lock(&pool->lock);
+      if (!pool->failed) {
+         pool->failed = true;
+         strcpy(pool->error, handler.msg);
+      }
+      pthread_mutex_unlock(&pool->lock);
+      atomic_store(&pool->next_task, pool->num_tasks);
+      return;
+   }
+   g_die_handler = &handler;
+   
+   for (;;) {
+      size_t task_no = atomic_fetch_add(&pool->next_task, 1);
+      if (task_no >= pool->num_tasks)
+         break;
+      pool->func(worker_no, task_no, pool->arg);
+   }
+   g_die_handler = prev_handler;
+}
+
+static void *thread_main(void *arg)
+{
+   struct worker *worker = arg;
+   struct pool *pool = worker->pool;
+   size_t worker_no = worker->worker_no;
+   unsigned long batch_no = 0;
+   free(worker);
+   
+   pthread_mutex_lock(&pool->lock);
+   for (;;) {
+      while (pool->batch_no == batch_no && !pool->quit)
+         pthread_cond_wait(&pool->wake, &pool->lock);
+      if (pool->quit)
+         break;
+      batch_no = pool->batch_no;
+      
+      pthread_mutex_unlock(&pool->lock);
+      run_tasks(pool, worker_no);
+      pthread_mutex_lock(&pool->lock);
+      
+      if (!--pool->num_running)
+         pthread_cond_signal(&pool->done);
+   }
+   pthread_mutex_unlock(&pool->lock);
+   
+   return NULL;
+}
+
+struct pool *pool_new(size_t num_threads)
+{
+   assert(num_threads);
+   
+   struct pool *pool = xmalloc(sizeof *pool);
+   *pool = (struct pool){
+      .threads = xcalloc(num_threads, sizeof *pool->threads),
+      .num_threads = 1,
+   };
+   pthread_mutex_init(&pool->lock, NULL);
+   pthread_cond_init(&pool->wake, NULL);
+   pthread_cond_init(&pool->done, NULL);
+   
+   for (size_t i = 1; i < num_threads; i++) {
+      struct worker *worker = xmalloc(sizeof *worker);
+      *worker = (struct worker){pool, i};
+      int ret = pthread_create(&pool->threads[i], NULL, thread_main, worker);
+      if (ret) {
+         free(worker);
+         pool_free(pool);
+         die("can't create thread: %s", strerror(ret));
+      }
+      pool->num_threads++;
+   }
+   return pool;
+}
+
+void pool_free(struct pool *pool)
+{
+   if (!pool)
+      return;
+   
+   pthread_mutex_lock(&pool->lock);
+   pool->quit = true;
+   pthread_cond_broadcast(&pool->wake);
+   pthread_mutex_unlock(&pool->lock);
+   
+   for (size_t i = 1; i < pool->num_threads; i++)
+      pthread_join(pool->threads[i], NULL);
+   
+   pthread_mutex_destroy(&pool->lock);
+   pthread_cond_destroy(&pool->wake);
+   pthread_cond_destroy(&pool->done);
+   free(pool->threads);
+   free(pool);
+}
+
+size_t pool_size(const struct pool *pool)
+{
+   return pool->num_threads;
+}
+
+void pool_run(struct pool *pool, size_t num_tasks,
+              void (*func)(size_t, size_t, void *), void *arg)
+{
+   if (pool->num_threads == 1 || num_tasks <= 1) {
+      for (size_t i = 0; i < num_tasks; i++)
+         func(0, i, arg);
+      return;
+   }
+   
+   pthread_mutex_lock(&pool->lock);
+   pool->func = func;
+   pool->arg = arg;
+   pool->num_tasks = num_tasks;
+   pool->failed = false;
+   atomic_store(&pool->next_task, 0);
+   pool->num_running = pool->num_threads - 1;
+   pool->batch_no++;
+   pthread_cond_broadcast(&pool->wake);
+   pthread_mutex_unlock(&pool->lock);
+   
+   run_tasks(pool, 0);
+   
+   pthread_mutex_lock(&pool->lock);
+   while (pool->num_running)
+      pthread_cond_wait(&pool->done, &pool->lock);
+   bool failed = pool->failed;
+   pthread_mutex_unlock(&pool->lock);
+   
+   if (failed)
+      die("%s", pool->error);
+}
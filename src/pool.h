@@ -0,0 +1,28 @@
+#ifndef BFSS_POOL_H
+#define BFSS_POOL_H
+
+#include <stddef.h>
+
+/* Fixed-size thread pool. The calling thread takes part in the work as worker
+   number zero, so that a pool of one thread doesn't create any thread at all.
+   Each pool is used by a single thread at a time.
+ */
+struct pool;
+
+struct pool *pool_new(size_t num_threads);
+
+void pool_free(struct pool *);
+
+size_t pool_size(const struct pool *);
+
+/* Calls "func" once for each task number in [0, num_tasks), from any worker,
+   and waits until all calls are done. "worker_no" is in [0, pool_size()), and
+   a worker only runs one task at a time.
+   If a task dies, the tasks not started yet are skipped, and once the others
+   are done, the error is raised again from the calling thread with die().
+ */
+void pool_run(struct pool *, size_t num_tasks,
+              void (*func)(size_t worker_no, size_t task_no, void *arg),
+              void *arg);
+
+#endif
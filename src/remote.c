@@ -0,0 +1,444 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <netdb.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include "remote.h"
+#include "dataset.h"
+#include "column.h"
+#include "eval.h"
+#include "common.h"
+#include "cmd.h"
+
+#define REMOTE_MAGIC "BFSSRPC"
+#define REMOTE_VERSION 1
+
+struct hello {
+   char magic[8];
+   uint32_t version;
+   uint32_t reserved;
+   uint64_t context;       // See eval_context().
+};
+
+/* A request is followed by "num_values" integers: for each column, its number
+   of features and then the features themselves, the one the column is named
+   after first. The reply is the confusion matrix.
+ */
+struct request {
+   uint64_t sample_size;
+   uint32_t num_columns;
+   uint32_t num_values;
+};
+
+struct conn {
+   int fd;
+   const char *addr;
+   uint32_t *values;
+   size_t values_alloc;
+};
+
+struct remote {
+   struct eval *eval;
+   struct conn *conns;
+   size_t num_conns, conns_alloc;
+   pid_t *children;     // Forked workers.
+   size_t num_children, children_alloc;
+};
+
+static bool write_all(int fd, const void *buf, size_t size)
+{
+   while (size) {
+      ssize_t ret = write(fd, buf, size);
+      if (ret < 0) {
+         if (errno == EINTR)
+            continue;
+         return false;
+      }
+      buf = (const char *)buf + ret;
+      size -= ret;
+   }
+   return true;
+}
+
+// Returns false on error or end of file.
+static bool read_all(int fd, void *buf, size_t size)
+{
+   while (size) {
+      ssize_t ret = read(fd, buf, size);
+      if (ret <= 0) {
+         if (ret < 0 && errno == EINTR)
+            continue;
+         if (!ret)
+            errno = 0;
+         return false;
+      }
+      buf = (char *)buf + ret;
+      size -= ret;
+   }
+   return true;
+}
+
+/* Worker side, which runs in its own process. Columns are rebuilt from the
+   original ones, which are never modified here, with a chain of joins.
+ */
+static struct {
+   struct eval *eval;
+   struct column **joins;
+   size_t joins_alloc;
+   const struct column **columns;
+   uint32_t *values;
+} g_server;
+
+static struct column *server_join(size_t join_no)
+{
+   if (join_no >= g_server.joins_alloc) {
+      size_t old_alloc = g_server.joins_alloc;
+      ENLARGE(g_server.joins, join_no + 1, g_server.joins_alloc, 8);
+      for (size_t i = old_alloc; i < g_server.joins_alloc; i++)
+         g_server.joins[i] = NULL;
+   }
+   if (!g_server.joins[join_no])
+      g_server.joins[join_no] = column_alloc_joined(g_server.eval->data);
+   return g_server.joins[join_no];
+}
+
+// Returns false if the request is malformed.
+static bool server_columns(const struct request *req)
+{
+   const struct dataset *data = g_server.eval->data;
+   uint32_t num_features = data->num_features;
+   const uint32_t *values = g_server.values;
+   const uint32_t *end = &values[req->num_values];
+   size_t num_joins = 0;
+
+   for (uint32_t i = 0; i < req->num_columns; i++) {
+      if (values == end || !*values || *values > (size_t)(end - values) - 1)
+         return false;
+      uint32_t num_members = *values++;
+      for (uint32_t j = 0; j < num_members; j++)
+         if (values[j] >= num_features)
+            return false;
+
+      const struct column *col = &data->columns[*values++];
+      for (uint32_t j = 1; j < num_members; j++) {
+         const struct column *member = &data->columns[*values++];
+         if (member == col)
+            return false;
+         struct column *join = server_join(num_joins++);
+         column_join(join, col, member);
+         col = join;
+      }
+      g_server.columns[i] = col;
+   }
+   return values == end;
+}
+
+static void serve_connection(int fd)
+{
+   struct eval *ev = g_server.eval;
+   size_t num_features = ev->data->num_features;
+   struct hello hello;
+   if (!read_all(fd, &hello, sizeof hello))
+      return;
+
+   uint32_t status = memcmp(hello.magic, REMOTE_MAGIC, sizeof hello.magic)
+                     || hello.version != REMOTE_VERSION
+                     || hello.context != eval_context(ev);
+   if (!write_all(fd, &status, sizeof status) || status)
+      return;
+
+   if (!g_server.columns) {
+      g_server.columns = xmalloc(num_features * sizeof *g_server.columns);
+      g_server.values = xmalloc(2 * num_features * sizeof *g_server.values);
+   }
+
+   struct request req;
+   while (read_all(fd, &req, sizeof req)) {
+      if (req.num_columns > num_features
+          || req.num_values > 2 * num_features
+          || req.sample_size > ev->fold_size
+          || !read_all(fd, g_server.values, req.num_values * sizeof *g_server.values)
+          || !server_columns(&req)) {
+         warn("malformed request from coordinator");
+         return;
+      }
+      if (req.sample_size)
+         eval_columns_sample(ev, g_server.columns, req.num_columns, req.sample_size);
+      else
+         eval_columns(ev, g_server.columns, req.num_columns);
+      if (!write_all(fd, ev->conf_mat, ev->conf_mat_size))
+         return;
+   }
+}
+
+/* Fills "addr" from "unix:PATH" or "HOST:PORT". Dies if the address is
+   invalid, or if "host" can't be resolved.
+ */
+static socklen_t parse_addr(const char *str, struct sockaddr_storage *addr, bool passive)
+{
+   memset(addr, 0, sizeof *addr);
+
+   if (!strncmp(str, "unix:", 5)) {
+      struct sockaddr_un *un = (struct sockaddr_un *)addr;
+      const char *path = str + 5;
+      if (!*path || strlen(path) >= sizeof un->sun_path)
+         die("invalid Unix socket path in '%s'", str);
+      un->sun_family = AF_UNIX;
+      strcpy(un->sun_path, path);
+      return sizeof *un;
+   }
+
+   const char *colon = strrchr(str, ':');
+   if (!colon || !colon[1])
+      die("invalid address '%s' (expected 'unix:PATH' or 'HOST:PORT')", str);
+
+   char *host = xstrdup(str);
+   host[colon - str] = '\0';
+
+   struct addrinfo hints = {
+      .ai_family = AF_UNSPEC,
+      .ai_socktype = SOCK_STREAM,
+      .ai_flags = passive ? AI_PASSIVE : 0,
+   }, *res;
+   int ret = getaddrinfo(*host ? host : NULL, colon + 1, &hints, &res);
+   free(host);
+   if (ret)
+      die("can't resolve '%s': %s", str, gai_strerror(ret));
+
+   socklen_t len = res->ai_addrlen;
+   memcpy(addr, res->ai_addr, len);
+   freeaddrinfo(res);
+   return len;
+}
+
+static int connect_addr(const char *str)
+{
+   struct sockaddr_storage addr;
+   socklen_t len = parse_addr(str, &addr, false);
+
+   int fd = socket(addr.ss_family, SOCK_STREAM, 0);
+   if (fd < 0 || connect(fd, (struct sockaddr *)&addr, len))
+      die("can't connect to '%s': %s", str, strerror(errno));
+   return fd;
+}
+
+static void add_conn(struct remote *remote, int fd, const char *addr)
+{
+   ENLARGE(remote->conns, remote->num_conns + 1, remote->conns_alloc, 4);
+   remote->conns[remote->num_conns++] = (struct conn){
+      .fd = fd,
+      .addr = addr,
+   };
+}
+
+static void fork_worker(struct remote *remote)
+{
+   int fds[2];
+
+   if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds))
+      die("can't create socket pair: %s", strerror(errno));
+
+   // Don't let the child flush our buffers a second time.
+   fflush(stdout);
+   fflush(stderr);
+
+   pid_t pid = fork();
+   if (pid < 0)
+      die("can't fork worker: %s", strerror(errno));
+   if (!pid) {
+      // The worker exits when the coordinator closes its end of the socket,
+      // including when it is interrupted.
+      // Errors end the worker, even if the coordinator catches its own.
+      signal(SIGINT, SIG_IGN);
+      signal(SIGTERM, SIG_IGN);
+      g_die_handler = NULL;
+      for (size_t i = 0; i < remote->num_conns; i++)
+         close(remote->conns[i].fd);
+      close(fds[0]);
+      g_server.eval = remote->eval;
+      serve_connection(fds[1]);
+      fflush(stderr);
+      _exit(EXIT_SUCCESS);
+   }
+
+   close(fds[1]);
+   add_conn(remote, fds[0], "forked worker");
+   ENLARGE(remote->children, remote->num_children + 1, remote->children_alloc, 4);
+   remote->children[remote->num_children++] = pid;
+}
+
+static void handshake(const struct remote *remote, const struct conn *conn)
+{
+   struct hello hello = {
+      .magic = REMOTE_MAGIC,
+      .version = REMOTE_VERSION,
+      .context = eval_context(remote->eval),
+   };
+   uint32_t status;
+
+   if (!write_all(conn->fd, &hello, sizeof hello)
+       || !read_all(conn->fd, &status, sizeof status))
+      die("can't reach worker (%s): %s", conn->addr,
+          errno ? strerror(errno) : "connection closed");
+   if (status)
+      die("worker (%s) refused the connection: different dataset, protocol or evaluation settings",
+          conn->addr);
+}
+
+struct remote *remote_new(struct eval *ev)
+{
+   struct remote *remote = xmalloc(sizeof *remote);
+   *remote = (struct remote){.eval = ev};
+   return remote;
+}
+
+size_t remote_connect(struct remote *remote, size_t num_processes, const char *addrs)
+{
+   // Broken connections are reported by write().
+   signal(SIGPIPE, SIG_IGN);
+
+   for (size_t i = 0; i < num_processes; i++)
+      fork_worker(remote);
+
+   if (addrs) {
+      char *list = xstrdup(addrs), *pos;
+      for (char *addr = strtok_r(list, ",", &pos); addr; addr = strtok_r(NULL, ",", &pos))
+         add_conn(remote, connect_addr(addr), xstrdup(addr));
+      free(list);
+   }
+
+   for (size_t i = 0; i < remote->num_conns; i++)
+      handshake(remote, &remote->conns[i]);
+   return remote->num_conns;
+}
+
+void remote_free(struct remote *remote)
+{
+   if (!remote)
+      return;
+
+   for (size_t i = 0; i < remote->num_conns; i++) {
+      close(remote->conns[i].fd);
+      free(remote->conns[i].values);
+   }
+   for (size_t i = 0; i < remote->num_children; i++)
+      while (waitpid(remote->children[i], NULL, 0) < 0 && errno == EINTR)
+         ;
+   free(remote->conns);
+   free(remote->children);
+   free(remote);
+}
+
+size_t remote_size(const struct remote *remote)
+{
+   return remote ? remote->num_conns : 0;
+}
+
+// Appends the features of a column to "values", the one it is named after first.
+static size_t add_members(uint32_t *values, const struct column *col)
+{
+   size_t nr = 1;
+
+   values[nr++] = col->origin;
+   for (size_t i = 0; i < col->data->links_size; i++) {
+      uint32_t word = col->links[i];
+      for (uint32_t j = 0; word; j++, word >>= 1)
+         if ((word & 1) && (i << 5 | j) != col->origin)
+            values[nr++] = i << 5 | j;
+   }
+   values[0] = nr - 1;
+   return nr;
+}
+
+void remote_eval(struct remote *remote, size_t worker_no,
+                 const struct column *const *columns, size_t num_columns,
+                 size_t sample_size, struct conf_mat *mat)
+{
+   assert(worker_no < remote->num_conns);
+   struct conn *conn = &remote->conns[worker_no];
+
+   // The request is sent in a single write.
+   size_t header_size = sizeof(struct request) / sizeof *conn->values;
+   ENLARGE(conn->values, header_size + num_columns + remote->eval->data->num_features,
+           conn->values_alloc, 64);
+
+   size_t num_values = 0;
+   for (size_t i = 0; i < num_columns; i++)
+      num_values += add_members(&conn->values[header_size + num_values], columns[i]);
+
+   struct request req = {
+      .sample_size = sample_size,
+      .num_columns = num_columns,
+      .num_values = num_values,
+   };
+   memcpy(conn->values, &req, sizeof req);
+
+   size_t size = (header_size + num_values) * sizeof *conn->values;
+   if (!write_all(conn->fd, conn->values, size)
+       || !read_all(conn->fd, mat, remote->eval->conf_mat_size))
+      die("lost worker (%s): %s", conn->addr,
+          errno ? strerror(errno) : "connection closed");
+}
+
+noreturn void remote_listen(const char *str, void (*serve_conn)(int fd))
+{
+   struct sockaddr_storage addr;
+   socklen_t len = parse_addr(str, &addr, true);
+
+   if (addr.ss_family == AF_UNIX) {
+      // Remove the socket left by a previous server.
+      const char *path = ((struct sockaddr_un *)&addr)->sun_path;
+      struct stat st;
+      if (!stat(path, &st) && S_ISSOCK(st.st_mode))
+         unlink(path);
+   }
+
+   int fd = socket(addr.ss_family, SOCK_STREAM, 0);
+   if (fd < 0)
+      die("can't create socket: %s", strerror(errno));
+   if (addr.ss_family != AF_UNIX
+       && setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &(int){1}, sizeof(int)))
+      die("can't set socket options: %s", strerror(errno));
+   if (bind(fd, (struct sockaddr *)&addr, len) || listen(fd, SOMAXCONN))
+      die("can't listen on '%s': %s", str, strerror(errno));
+
+   // Children are reaped automatically.
+   signal(SIGCHLD, SIG_IGN);
+   signal(SIGPIPE, SIG_IGN);
+
+   for (;;) {
+      int conn = accept(fd, NULL, NULL);
+      if (conn < 0) {
+         if (errno == EINTR || errno == ECONNABORTED)
+            continue;
+         die("can't accept connection on '%s': %s", str, strerror(errno));
+      }
+
+      fflush(stderr);
+      pid_t pid = fork();
+      if (pid < 0) {
+         warn("can't fork worker: %s", strerror(errno));
+      } else if (!pid) {
+         close(fd);
+         serve_conn(conn);
+         fflush(stderr);
+         _exit(EXIT_SUCCESS);
+      }
+      close(conn);
+   }
+}
+
+noreturn void remote_serve(struct eval *ev, const char *str)
+{
+   g_server.eval = ev;
+   remote_listen(str, serve_connection);
+}
@@ -0,0 +1,61 @@
+#ifndef BFSS_REMOTE_H
+#define BFSS_REMOTE_H
+
+#include <stddef.h>
+#include <stdnoreturn.h>
+
+struct column;
+struct conf_mat;
+struct eval;
+
+/* Remote evaluation. A search can hand its evaluations over to worker
+   processes, either forked from the current one, or started beforehand with
+   --listen and reached through Unix-domain or TCP sockets. Workers load the
+   dataset themselves and are sent subset descriptions: the original features
+   of each column, the one it is named after first. They reply with confusion
+   matrices, and the search itself runs in the coordinator as usual.
+
+   The protocol uses the byte order of the machine, so all processes must run
+   on machines of the same architecture. A worker refuses a coordinator whose
+   evaluation context differs from its own, see eval_context().
+ */
+
+/* Coordinator of the workers of a search, which evaluate as "ev" does. It must
+   outlive the coordinator.
+ */
+struct remote;
+
+struct remote *remote_new(struct eval *ev);
+
+/* Forks "num_processes" workers and connects to the workers listening on the
+   comma-separated addresses "addrs", which can be NULL. Addresses are either
+   "unix:PATH" or "HOST:PORT". Returns the number of workers.
+ */
+size_t remote_connect(struct remote *, size_t num_processes, const char *addrs);
+
+// Closes the connections and waits for the forked workers.
+void remote_free(struct remote *);
+
+// Zero if "remote" is NULL.
+size_t remote_size(const struct remote *);
+
+/* Evaluates the given columns with the worker "worker_no", which must not be
+   used by another thread in the meantime. "sample_size" is zero for a full
+   evaluation, see eval_columns_sample() otherwise. The matrix is copied into
+   "mat".
+ */
+void remote_eval(struct remote *, size_t worker_no, const struct column *const *columns,
+                 size_t num_columns, size_t sample_size, struct conf_mat *mat);
+
+/* Serves coordinators on "addr", each connection in its own process, which
+   evaluates with "ev". Doesn't return.
+ */
+noreturn void remote_serve(struct eval *ev, const char *addr);
+
+/* Listens on "addr" and calls "serve_conn" on each connection in its own
+   forked process, which exits once the function returns. Doesn't return.
+   Used by remote_serve() and by the "serve" command.
+ */
+noreturn void remote_listen(const char *addr, void (*serve_conn)(int fd));
+
+#endif
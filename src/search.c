@@ -1,69 +1,178 @@
 #include <signal.h>
 #include <errno.h>
 #include <ctype.h>
+#include <math.h>
 #include <stdio.h>
+#include <stdarg.h>
 #include <string.h>
+#include <pthread.h>
+#include <stdatomic.h>
 
 #include "search.h"
+#include "mutual.h"
 #include "dataset.h"
 #include "buffer.h"
 #include "measure.h"
 #include "common.h"
 #include "eval.h"
+#include "pool.h"
+#include "memo.h"
+#include "cache.h"
+#include "checkpoint.h"
+#include "subset.h"
+#include "stats.h"
+#include "memory.h"
+#include "verbose.h"
+#include "remote.h"
 #include "cmd.h"
+#include "bfss.h"
 
-extern struct config g_config;
-extern struct eval g_eval;
+#define INVALID_SCORE -333.
 
-static double g_stop;            // Termination flag.
+struct worker;
+struct candidate;
+struct beam_entry;
 
-#define INVALID_SCORE -333.
-static double g_best_score = INVALID_SCORE;
+/* State of the searches of a context. It is allocated by the first search and
+   kept for the following ones, which reuse the progress stream and possibly
+   the transposition table. Everything else is reset by search_reset().
+ */
+struct search {
+   struct bfss *bfss;
+   struct config config;   // Copy of the options, completed by search().
+   struct dataset *data;
+   struct eval *eval;      // That of the context, used by the first worker.
+   FILE *out;
+   double best_score;
+   
+   // Search state, for checkpoints.
+   struct {
+      uint32_t *start;     // Subset to start from (--resume, --init-subset),
+                           // or NULL.
+      size_t step;         // Number of steps done.
+      size_t prior_evals;  // Evaluations done before resuming.
+      uint32_t *origins;   // Buffer for writing checkpoints.
+   } resume;
+   
+   // Copies of the report formats, whitespace removed for --compact.
+   struct {
+      char *step, *full, *full_end, *progress;
+   } reports;
+   
+   struct pool *pool;
+   struct worker *workers;
+   struct remote *remote;
+   struct memo *memo;
+   struct cache *cache;
+   struct mutual *mutual;
+   struct verbose *verbose;
+   
+   struct {
+      double start;        // Time at which the search started.
+      double next_report;  // Time at which to print the next progress report.
+      atomic_size_t num_evals;   // Evaluations started, for --max-evals.
+   } budget;
+   
+   // Progress stream, see --progress. It is kept open for the following searches.
+   struct {
+      FILE *out;
+      atomic_size_t num_cands;   // Candidates evaluated by the search.
+      size_t step_cands;         // Value of "num_cands" when the step started.
+   } progress;
+   
+   struct {
+      unsigned long long samples;      // Samples tested while racing.
+      unsigned long long full_samples; // Samples that would have been tested
+                                       // without racing.
+      size_t dropped;                  // Number of candidates dropped.
+   } race;
+   
+   size_t num_pruned;      // Joins pruned with mutual information.
+   size_t num_over_budget; // Joins skipped because of size limits.
+   size_t num_duplicates;  // Beam candidates leading to the same subset as
+                           // another one.
+   
+   struct {
+      double *scores;      // Last known score of each candidate, see lazy_score().
+      size_t skipped;      // Number of evaluations skipped.
+      struct candidate **queue;
+      size_t queue_alloc;
+   } lazy;
+   
+   struct candidate *cands;
+   size_t num_cands, cands_alloc;
+   struct candidate **pending;   // See pending_candidates().
+   size_t pending_alloc;
+   
+   struct {
+      struct beam_entry **entries;
+      size_t num_entries, entries_alloc;
+      uint32_t *used;      // Original features used by an entry.
+      uint32_t *best;      // Origin of the group of each feature in the best
+                           // subset, or UINT32_MAX if unused.
+      const struct column **columns;
+      uint32_t *keys;      // Keys of the candidates, see beam_dedup_candidates().
+      size_t keys_alloc;
+      size_t *slots;       // Hash table of candidate numbers.
+      size_t slots_alloc;
+   } beam;
+   
+   /* Transposition table kept between searches, see search_share_memo().
+      "context" is the evaluation context its matrices were computed in, valid
+      if "ready" is set.
+    */
+   struct {
+      bool enabled;
+      bool ready;
+      uint64_t context;
+   } shared_memo;
+   
+   struct buffer subset;   // See subset_json().
+   struct buffer best;     // See report_progress().
+};
 
 static bool feature_active(const uint32_t *set, uint32_t feat_no)
 {
-   assert(feat_no < g_data.num_features);
    return set[feat_no >> 5] & (1 << (feat_no & 31));
 }
 
-static const char *current_subset(void)
+static const char *subset_json(struct search *s, const struct column *const *cols,
+                               size_t num_cols)
 {
-   static struct buffer buf = BUFFER_INIT;
+   struct buffer *buf = &s->subset;
    
-   struct column *cols = g_data.columns;
-   size_t nr = g_data.num_features;
+   size_t nr = s->data->num_features;
    
-   buffer_clear(&buf);   
-   buffer_catc(&buf, '[');
+   buffer_clear(buf);   
+   buffer_catc(buf, '[');
    
-   for (size_t i = 0; i <= nr; i++) {
-      const struct column *col = &cols[i];
-      if (col->state != COL_ACTIVE)
-         continue;
+   for (size_t i = 0; i < num_cols; i++) {
+      const struct column *col = cols[i];
       if (!col->num_links) {
-         buffer_cat(&buf, col->name.data, col->name.size);
+         buffer_cat(buf, col->name.data, col->name.size);
       } else {
-         buffer_catc(&buf, '[');
-         buffer_cat(&buf, col->name.data, col->name.size);
+         buffer_catc(buf, '[');
+         buffer_cat(buf, col->name.data, col->name.size);
          for (size_t j = 0; j < nr; j++) {
             if (feature_active(col->links, j)) {
-               buffer_catc(&buf, ',');
-               buffer_cat(&buf, cols[j].name.data, cols[j].name.size);
+               const struct buffer *name = &s->data->columns[j].name;
+               buffer_catc(buf, ',');
+               buffer_cat(buf, name->data, name->size);
             }
          }
-         buffer_catc(&buf, ']');
+         buffer_catc(buf, ']');
       }
-      buffer_catc(&buf, ',');
+      buffer_catc(buf, ',');
    }
    // Remove the trailing comma.
-   if (buf.size > 1)
-      buf.size--;
-   buffer_catc(&buf, ']');
+   if (buf->size > 1)
+      buf->size--;
+   buffer_catc(buf, ']');
    
-   return buf.data;
+   return buf->data;
 }
 
-static char g_step_report[] = 
+static const char g_step_report[] =
 "{\n"
 "   \"subset\": %s,\n"
 "   \"accuracy\": %f,\n"
@@ -72,58 +181,261 @@ static char g_step_report[] =
 "   \"F1\": %f\n"
 "}\n"
 ;
-static double eval_model_verbose(void)
+
+/* Candidates are evaluated concurrently by a pool of workers. Each one has its
+   own evaluator and its own column for trying joins. The first worker uses
+   the evaluator of the context, which is also used to evaluate the best subset
+   at the end.
+ */
+struct worker {
+   struct search *search;
+   struct eval *eval;
+   struct column *join_column;
+   const struct column **columns;   // Columns of the subset to evaluate.
+   uint32_t *key;                   // Key of this subset, see memo_key().
+};
+
+static void workers_init(struct search *s)
 {
-   double ret = eval_model();
+   size_t num_workers = pool_size(s->pool);
    
-   struct measures stats;
-   full_eval(&stats, g_eval.conf_mat);
+   s->workers = xcalloc(num_workers, sizeof *s->workers);
+   for (size_t i = 0; i < num_workers; i++) {
+      struct worker *w = &s->workers[i];
+      w->search = s;
+      if (i) {
+         w->eval = xcalloc(1, sizeof *w->eval);
+         eval_init(w->eval, s->bfss);
+      } else {
+         w->eval = s->eval;
+      }
+      w->join_column = column_alloc_joined(s->data);
+      w->columns = xmalloc((s->data->num_features + 1) * sizeof *w->columns);
+      w->key = xmalloc(s->data->num_features * sizeof *w->key);
+   }
+}
+
+static size_t total_evals(struct search *s)
+{
+   size_t total = 0;
+   for (size_t i = 0; i < pool_size(s->pool); i++)
+      total += s->workers[i].eval->num_evals;
+   return total;
+}
+
+// Looks for the matrix of a subset in the transposition table, then the cache.
+static bool known_subset(struct search *s, const uint32_t *key, struct conf_mat *mat)
+{
+   if (memo_lookup(s->memo, key, mat))
+      return true;
+   if (cache_lookup(s->cache, key, mat)) {
+      memo_insert(s->memo, key, mat);
+      return true;
+   }
+   return false;
+}
+
+static void report_progress(struct search *s);
+static void print_progress(struct search *s, const char *event);
+static void end_step(struct search *s);
+
+/* Stops the search if the time limit is reached. Progress reports and status
+   lines are printed from here by the first worker, which runs on the main
+   thread, so that the current subset is not modified in the meantime.
+ */
+static bool out_of_time(const struct worker *w)
+{
+   struct search *s = w->search;
    
-   printf(g_step_report,
-      current_subset(),
-      stats.accuracy * 100.,
-      stats.precision * 100.,
-      stats.recall * 100.,
-      stats.F1 * 100.
-   );
+   if (s->bfss->status_requested && w == s->workers) {
+      s->bfss->status_requested = false;
+      print_progress(s, "status");
+   }
+   if (s->config.time_limit == INFINITY && !s->config.report_every)
+      return false;
+   
+   double elapsed = now() - s->budget.start;
+   if (elapsed >= s->config.time_limit)
+      s->bfss->stop = true;
+   else if (s->config.report_every && w == s->workers && elapsed >= s->budget.next_report) {
+      report_progress(s);
+      s->budget.next_report = elapsed + s->config.report_every;
+   }
+   return s->bfss->stop;
+}
+
+/* Evaluates the subset in the worker's buffer, with the matching remote worker
+   if there are any. "sample_size" is as in eval_columns_sample().
+ */
+static double run_eval(struct worker *w, size_t num_columns, size_t sample_size)
+{
+   struct search *s = w->search;
+   
+   if (!remote_size(s->remote)) {
+      if (sample_size)
+         return eval_columns_sample(w->eval, w->columns, num_columns, sample_size);
+      return eval_columns(w->eval, w->columns, num_columns);
+   }
+   remote_eval(s->remote, w - s->workers, w->columns, num_columns, sample_size,
+               w->eval->conf_mat);
+   if (!sample_size)
+      w->eval->num_evals++;
+   return measure_score(w->eval->measure, w->eval->conf_mat);
+}
+
+/* Evaluates the subset in the worker's buffer, unless its confusion matrix is
+   already known. Returns INVALID_SCORE, and stops the search, if the time or
+   evaluations budget is exhausted.
+ */
+static double worker_eval(struct worker *w, size_t num_columns)
+{
+   struct search *s = w->search;
+   double score;
+   
+   if (out_of_time(w))
+      return INVALID_SCORE;
+   
+   memo_key(s->data, w->columns, num_columns, w->key);
+   if (known_subset(s, w->key, w->eval->conf_mat)) {
+      score = measure_score(w->eval->measure, w->eval->conf_mat);
+   } else {
+      if (atomic_fetch_add(&s->budget.num_evals, 1) >= s->config.max_evals) {
+         s->bfss->stop = true;
+         return INVALID_SCORE;
+      }
+      score = run_eval(w, num_columns, 0);
+      memo_insert(s->memo, w->key, w->eval->conf_mat);
+      cache_append(s->cache, w->key, w->eval->conf_mat);
+   }
+   if (s->config.verbose)
+      verbose_record(s->verbose, w->eval->conf_mat, w->columns, num_columns);
+   return score;
+}
+
+// Collects the active columns, in index order.
+static size_t active_columns(struct search *s, const struct column **cols)
+{
+   size_t nr = 0;
    
-   return ret;
+   for (size_t i = 0; i < s->data->num_features; i++) {
+      const struct column *col = &s->data->columns[i];
+      if (col->state == COL_ACTIVE)
+         cols[nr++] = col;
+   }
+   return nr;
+}
+
+// Evaluates the current feature subset with the first worker.
+static double eval_current(struct search *s)
+{
+   struct worker *w = &s->workers[0];
+   return worker_eval(w, active_columns(s, w->columns));
 }
 
-static char g_full_report[] = {
+static const char g_full_report[] = {
 "{\n"
 "   \"subset\": %s,\n"
 "   \"accuracy\": %f,\n"
 "   \"precision\": %f,\n"
 "   \"recall\": %f,\n"
 "   \"F1\": %f,\n"
+};
+static const char g_full_report_end[] = {
 "   \"subsets_evaluated\": %zu,\n"
 "   \"interrupted\": %s\n"
 "}\n"
 };
-static void print_best(void)
+
+// Prints an additional field of the full report.
+static void print_field(struct search *s, const char *name, const char *format, ...)
+{
+   fprintf(s->out, s->config.compact_json ? "\"%s\":" : "   \"%s\": ", name);
+   
+   va_list ap;
+   va_start(ap, format);
+   vfprintf(s->out, format, ap);
+   va_end(ap);
+   
+   fputs(s->config.compact_json ? "," : ",\n", s->out);
+}
+
+static void print_search_stats(struct search *s)
+{
+   if (s->config.race) {
+      print_field(s, "race_confidence", "%f", s->config.race_confidence);
+      print_field(s, "race_candidates_dropped", "%zu", s->race.dropped);
+      print_field(s, "race_samples_evaluated", "%llu", s->race.samples);
+      print_field(s, "race_samples_saved", "%lld",
+                  (long long)(s->race.full_samples - s->race.samples));
+   }
+   if (s->config.lazy)
+      print_field(s, "lazy_evaluations_skipped", "%zu", s->lazy.skipped);
+   if (s->config.max_join_cardinality != SIZE_MAX || s->config.max_model_bytes != SIZE_MAX)
+      print_field(s, "joins_over_budget", "%zu", s->num_over_budget);
+   if (!strcmp(s->config.search_mode, "beam")) {
+      print_field(s, "beam_width", "%zu", s->config.beam_width);
+      print_field(s, "beam_duplicates_skipped", "%zu", s->num_duplicates);
+   }
+   if (s->config.memo_entries) {
+      print_field(s, "memo_hits", "%zu", memo_hits(s->memo));
+      print_field(s, "memo_misses", "%zu", memo_misses(s->memo));
+   }
+   if (s->config.cache_dir) {
+      print_field(s, "cache_hits", "%zu", cache_hits(s->cache));
+      print_field(s, "cache_records_added", "%zu", cache_records_added(s->cache));
+   }
+   if (remote_size(s->remote))
+      print_field(s, "remote_workers", "%zu", remote_size(s->remote));
+   if (s->config.mutual_rank) {
+      print_field(s, "mutual_info_seconds", "%f", mutual_cost(s->mutual));
+      print_field(s, "join_candidates_pruned", "%zu", s->num_pruned);
+   }
+}
+
+static void print_best(struct search *s)
 {
-   if (g_best_score == INVALID_SCORE) {
+   if (s->best_score == INVALID_SCORE) {
       // Not enough time to do anything.
       return;
    }
 
-   eval_model();
+   // The best subset was evaluated during the search, and is normally still
+   // in the transposition table or in the cache.
+   struct worker *w = &s->workers[0];
+   size_t num_cols = active_columns(s, w->columns);
+   size_t num_evals = s->resume.prior_evals + total_evals(s);
+   memo_key(s->data, w->columns, num_cols, w->key);
+   if (!known_subset(s, w->key, s->eval->conf_mat))
+      eval_columns(s->eval, w->columns, num_cols);
+   
    struct measures stats;
-   full_eval(&stats, g_eval.conf_mat);
+   measure_full(s->eval->measure, &stats, s->eval->conf_mat);
 
-   printf(g_full_report,
-      current_subset(),
+   double start = stats_start(STATS_OUTPUT);
+   fprintf(s->out, s->reports.full,
+      subset_json(s, w->columns, num_cols),
       stats.accuracy * 100.,
       stats.precision * 100.,
       stats.recall * 100.,
-      stats.F1 * 100.,
-      g_eval.num_evals - 1,
-      g_stop ? "true" : "false");
+      stats.F1 * 100.);
+   print_search_stats(s);
+   fprintf(s->out, s->reports.full_end,
+      num_evals,
+      s->bfss->stop ? "true" : "false");
+   stats_stop(STATS_OUTPUT, start, 1);
 }
 
-static void compress_json(char *json)
+/* Returns a copy of a report format, with whitespace removed if --compact is
+   given. If "document" is set, the string is a full JSON document and must be
+   terminated with a newline.
+ */
+static char *report_format(struct search *s, const char *format, bool document)
 {
+   char *json = xstrdup(format);
+   
+   if (!s->config.compact_json)
+      return json;
+   
    assert(*json && json[strlen(json) - 1] == '\n');
    
    size_t i = 0;
@@ -134,50 +446,586 @@ static void compress_json(char *json)
          json[i++] = c;
    }
    
-   json[i++] = '\n';
+   if (document)
+      json[i++] = '\n';
    json[i] = '\0';
+   return json;
+}
+
+static void activate_features(struct search *s)
+{
+   for (size_t i = 0; i < s->data->num_features; i++)
+      s->data->columns[i].state = COL_ACTIVE;
+}
+
+/* Feature subsets given as arrays of origins, see struct checkpoint, can be
+   made the current one by replaying the joins on the original columns.
+ */
+static void apply_subset(struct search *s, const uint32_t *origins)
+{
+   struct column *columns = s->data->columns;
+   
+   for (size_t i = 0; i < s->data->num_features; i++)
+      if (origins[i] == i)
+         columns[i].state = COL_ACTIVE;
+   
+   for (size_t i = 0; i < s->data->num_features; i++) {
+      uint32_t origin = origins[i];
+      if (origin != UINT32_MAX && origin != i) {
+         column_merge(&columns[origin], &columns[i]);
+         columns[i].state = COL_MERGED;
+      }
+   }
 }
 
-static double (*run_eval)(void) = eval_model;
+static void get_subset(struct search *s, uint32_t *origins)
+{
+   const struct column *columns = s->data->columns;
+   
+   for (size_t i = 0; i < s->data->num_features; i++)
+      origins[i] = UINT32_MAX;
+   
+   for (size_t i = 0; i < s->data->num_features; i++) {
+      if (columns[i].state != COL_ACTIVE)
+         continue;
+      origins[i] = i;
+      for (size_t j = 0; j < s->data->num_features; j++)
+         if (feature_active(columns[i].links, j))
+            origins[j] = i;
+   }
+}
+
+static void write_checkpoint(struct search *s, const uint32_t *origins)
+{
+   if (!s->config.checkpoint_path)
+      return;
+   
+   if (!origins) {
+      get_subset(s, s->resume.origins);
+      origins = s->resume.origins;
+   }
+   struct checkpoint ckpt = {
+      .search_mode = s->config.search_mode,
+      .step = s->resume.step,
+      .num_evals = s->resume.prior_evals + total_evals(s),
+      .best_score = s->best_score,
+      .origins = (uint32_t *)origins,
+   };
+   checkpoint_write(s->data, s->config.checkpoint_path, &ckpt);
+}
 
-static void activate_features(void)
+static void read_checkpoint(struct search *s)
 {
-   for (size_t i = 0; i < g_data.num_features; i++)
-      g_data.columns[i].state = COL_ACTIVE;
+   struct checkpoint ckpt;
+   checkpoint_read(s->data, s->config.resume_path, &ckpt);
+   
+   if (strcmp(ckpt.search_mode, s->config.search_mode))
+      die("can't resume a '%s' search with the search mode '%s'",
+          ckpt.search_mode, s->config.search_mode);
+   free((char *)ckpt.search_mode);
+   
+   s->resume.start = ckpt.origins;
+   s->resume.step = ckpt.step;
+   s->resume.prior_evals = ckpt.num_evals;
+   s->best_score = ckpt.best_score;
 }
 
-static void search_none(void)
+/* Sets up the first subset of a search: the one given by the user if any, or
+   else the full feature set if "full" is set, and the empty one otherwise.
+   Returns its score, which is already known when resuming.
+ */
+static double start_search(struct search *s, bool full)
 {
-   activate_features();
-   g_best_score = run_eval();
+   if (s->resume.start)
+      apply_subset(s, s->resume.start);
+   else if (full)
+      activate_features(s);
+   
+   if (s->best_score != INVALID_SCORE)
+      return s->best_score;
+   return eval_current(s);
 }
 
-static void search_forward(void)
+// Number of active columns and, if "total" is set, of the features they join.
+static size_t count_active(struct search *s, bool total)
 {
-   g_best_score = run_eval();
+   size_t nr = 0;
+   
+   for (size_t i = 0; i < s->data->num_features; i++) {
+      const struct column *col = &s->data->columns[i];
+      if (col->state == COL_ACTIVE)
+         nr += total ? col->num_links + 1 : 1;
+   }
+   return nr;
+}
 
-   size_t num_active_features = 0;
-   size_t num_features = g_data.num_features;
-   struct column *columns = g_data.columns;
+/* Modifications of the current feature subset that can be made at each step of
+   the search.
+ */
+struct candidate {
+   enum candidate_type {
+      CAND_ADD,         // Add the inactive column col1.
+      CAND_REMOVE,      // Remove the active column col1.
+      CAND_ADD_JOINED,  // Join the inactive column col2 to the active col1.
+      CAND_JOIN,        // Join the active columns col1 and col2.
+   } type;
+   struct column *col1;
+   struct column *col2;
+   struct beam_entry *parent; // Subset the candidate applies to, for beam
+                              // search, instead of the current one.
+   double score;
+   double bound;        // Upper estimate of the score, for lazy search.
+   double info;         // Mutual information, for ordering candidates.
+   bool skipped;        // Not fully evaluated (racing, lazy search).
+};
 
-   size_t max_features = g_config.max_features;
-   while (num_active_features < max_features) {
-      num_active_features++;
-      double cur_best = 0.;
-      struct column *to_add = NULL;
+static struct candidate *add_candidate(struct search *s, enum candidate_type type,
+                                       struct column *col1, struct column *col2)
+{
+   ENLARGE(s->cands, s->num_cands + 1, s->cands_alloc, 16);
+   struct candidate *cand = &s->cands[s->num_cands++];
+   *cand = (struct candidate){
+      .type = type,
+      .col1 = col1,
+      .col2 = col2,
+      .score = INVALID_SCORE,
+   };
+   return cand;
+}
+
+static size_t entry_columns(const struct candidate *, struct worker *);
+
+/* Joins "col1" and "col2" into the worker's join column. Remote workers make
+   the join themselves from the features of the column, so only these are set.
+ */
+static const struct column *join_candidate(struct worker *w, const struct column *col1,
+                                           const struct column *col2)
+{
+   if (remote_size(w->search->remote))
+      column_join_links(w->join_column, col1, col2);
+   else
+      column_join(w->join_column, col1, col2);
+   return w->join_column;
+}
+
+/* Collects in the worker's buffer the columns of the subset a candidate leads
+   to. Columns are kept in index order, and joined columns are put last, so
+   that scores don't depend on the number of workers.
+ */
+static size_t candidate_columns(const struct candidate *cand, struct worker *w)
+{
+   struct search *s = w->search;
+   
+   if (cand->parent)
+      return entry_columns(cand, w);
+   
+   const struct column **cols = w->columns;
+   size_t nr = 0;
+   
+   for (size_t i = 0; i < s->data->num_features; i++) {
+      const struct column *col = &s->data->columns[i];
+      bool active = col->state == COL_ACTIVE;
+      if (col == cand->col1)
+         active = cand->type == CAND_ADD;
+      else if (col == cand->col2)
+         active = false;
+      if (active)
+         cols[nr++] = col;
+   }
+   
+   switch (cand->type) {
+   case CAND_ADD_JOINED:
+      cols[nr++] = join_candidate(w, cand->col1, cand->col2);
+      break;
+   case CAND_JOIN:
+      cols[nr++] = join_candidate(w, cand->col2, cand->col1);
+      break;
+   default:
+      break;
+   }
+   return nr;
+}
+
+static void candidate_commit(const struct candidate *cand)
+{
+   switch (cand->type) {
+   case CAND_ADD:
+      cand->col1->state = COL_ACTIVE;
+      break;
+   case CAND_REMOVE:
+      cand->col1->state = COL_INACTIVE;
+      break;
+   case CAND_JOIN:
+      cand->col2->state = COL_INACTIVE;
+      // Fall through.
+   case CAND_ADD_JOINED:
+      column_merge(cand->col1, cand->col2);
+      cand->col2->state = COL_MERGED;
+      break;
+   }
+}
+
+/* Evaluates a batch of candidates with the pool. If "sample_size" is not zero,
+   only an approximate evaluation is made, see eval_columns_sample().
+ */
+struct batch {
+   struct search *search;
+   struct candidate **cands;
+   size_t sample_size;
+};
+
+static void eval_task(size_t worker_no, size_t task_no, void *arg)
+{
+   const struct batch *batch = arg;
+   struct candidate *cand = batch->cands[task_no];
+   struct worker *w = &batch->search->workers[worker_no];
+   
+   if (batch->search->bfss->stop || out_of_time(w))
+      return;
+   
+   atomic_fetch_add_explicit(&batch->search->progress.num_cands, 1, memory_order_relaxed);
+   size_t nr = candidate_columns(cand, w);
+   if (batch->sample_size)
+      cand->score = run_eval(w, nr, batch->sample_size);
+   else
+      cand->score = worker_eval(w, nr);
+}
+
+static void eval_batch(struct search *s, struct candidate **cands, size_t num_cands,
+                       size_t sample_size)
+{
+   struct batch batch = {s, cands, sample_size};
+   pool_run(s->pool, num_cands, eval_task, &batch);
+}
+
+static double candidate_eval(struct search *s, struct candidate *cand)
+{
+   eval_batch(s, &cand, 1, 0);
+   return cand->score;
+}
+
+// Candidates that haven't been skipped, see select_candidate().
+static struct candidate **pending_candidates(struct search *s, size_t *num_pending)
+{
+   size_t nr = 0;
+   for (size_t i = 0; i < s->num_cands; i++) {
+      if (!s->cands[i].skipped) {
+         ENLARGE(s->pending, nr + 1, s->pending_alloc, 16);
+         s->pending[nr++] = &s->cands[i];
+      }
+   }
+   *num_pending = nr;
+   return s->pending;
+}
+
+static int cmp_info(const void *x_, const void *y_)
+{
+   const struct candidate *x = x_, *y = y_;
+   
+   if (x->type != y->type)
+      return x->type < y->type ? -1 : 1;
+   if (x->info != y->info)
+      return x->info < y->info ? 1 : -1;
+   if (x->col1 != y->col1)
+      return x->col1 < y->col1 ? -1 : 1;
+   return x->col2 < y->col2 ? -1 : x->col2 > y->col2;
+}
+
+/* Orders additions and joins by decreasing mutual information. Candidates of
+   different types are not mixed together.
+ */
+static void order_candidates(struct search *s)
+{
+   if (!s->config.mutual_rank)
+      return;
+   
+   for (size_t i = 0; i < s->num_cands; i++) {
+      struct candidate *cand = &s->cands[i];
+      switch (cand->type) {
+      case CAND_ADD:
+         cand->info = mutual_class(s->mutual, cand->col1);
+         break;
+      case CAND_REMOVE:
+         cand->info = 0.;
+         break;
+      case CAND_ADD_JOINED:
+      case CAND_JOIN:
+         cand->info = mutual_pair(s->mutual, cand->col1, cand->col2);
+         break;
+      }
+   }
+   qsort(s->cands, s->num_cands, sizeof *s->cands, cmp_info);
+}
+
+/* Estimated size of a column in a trained model: one log-probability per
+   feature value and label.
+ */
+static size_t model_bytes(struct search *s, size_t num_types)
+{
+   size_t row = s->data->num_labels * sizeof(double);
+   return num_types > SIZE_MAX / row ? SIZE_MAX : num_types * row;
+}
+
+// Estimated size of the model that uses the current feature subset.
+static size_t current_model_bytes(struct search *s)
+{
+   size_t total = model_bytes(s, 1);     // Priors.
+   
+   for (size_t i = 0; i < s->data->num_features; i++) {
+      const struct column *col = &s->data->columns[i];
+      if (col->state == COL_ACTIVE)
+         total += model_bytes(s, col->table.num_types);
+   }
+   return total;
+}
+
+// Upper bound of the number of types of a joined column.
+static size_t join_cardinality(struct search *s, const struct column *col1,
+                               const struct column *col2)
+{
+   size_t x = col1->table.num_types, y = col2->table.num_types;
+   size_t max = s->data->num_samples;
+   
+   if (y && x > max / y)
+      return max;
+   return x * y < max ? x * y : max;
+}
+
+/* Checks that joining two columns doesn't exceed the cardinality and model
+   size limits. "model_size" is the size of the model that uses the current
+   feature subset, without the columns to join.
+ */
+static bool join_within_budget(struct search *s, const struct column *col1,
+                               const struct column *col2, size_t model_size)
+{
+   size_t card = join_cardinality(s, col1, col2);
+   if (card > s->config.max_join_cardinality)
+      return false;
+   
+   if (s->config.max_model_bytes != SIZE_MAX) {
+      size_t joined = model_bytes(s, card);
+      if (joined > SIZE_MAX - model_size || model_size + joined > s->config.max_model_bytes)
+         return false;
+   }
+   return true;
+}
+
+static bool join_allowed(struct search *s, const struct column *col1,
+                         const struct column *col2, size_t model_size)
+{
+   if (!join_within_budget(s, col1, col2, model_size)) {
+      s->num_over_budget++;
+      return false;
+   }
+   if (s->config.join_candidates != SIZE_MAX && !mutual_pair_allowed(s->mutual, col1, col2)) {
+      s->num_pruned++;
+      return false;
+   }
+   return true;
+}
+
+/* Racing (Maron & Moore, 1994). All candidates are first evaluated on a small
+   sample of each fold. Those that perform significantly worse than the current
+   leader, according to Hoeffding's inequality, are dropped, and the remaining
+   ones are evaluated again on a larger sample, etc., until the full folds are
+   reached. Samples grow fast so that racing costs at most a third more than a
+   plain evaluation when no candidate can be dropped. This is an approximation,
+   because our measures are not averages of independent observations (except
+   accuracy).
+ */
+#define RACE_MIN_SAMPLES 64
+#define RACE_GROWTH_FACTOR 4
+
+static void race_candidates(struct search *s)
+{
+   const size_t fold_size = s->eval->fold_size;
+   const size_t num_folds = s->config.num_folds;
+   
+   size_t num_rounds = 0;
+   for (size_t size = fold_size; size / RACE_GROWTH_FACTOR >= RACE_MIN_SAMPLES;
+        size /= RACE_GROWTH_FACTOR)
+      num_rounds++;
+   
+   // Bonferroni correction over all the comparisons we might make.
+   double delta = (1. - s->config.race_confidence) / (s->num_cands * num_rounds + 1);
+   
+   for (size_t round = num_rounds; round && !s->bfss->stop; round--) {
+      size_t sample_size = fold_size;
+      for (size_t i = 0; i < round; i++)
+         sample_size /= RACE_GROWTH_FACTOR;
       
-      for (size_t i = 0; i < num_features && !g_stop; i++) {
-         struct column *col = &columns[i];
-         if (col->state == COL_ACTIVE)
-            continue;
-         col->state = COL_ACTIVE;
-         double cur = run_eval();
-         col->state = COL_INACTIVE;
-         if (cur >= cur_best) {
-            cur_best = cur;
-            to_add = col;
+      size_t num_pending;
+      struct candidate **pending = pending_candidates(s, &num_pending);
+      eval_batch(s, pending, num_pending, sample_size);
+      if (s->bfss->stop)
+         break;
+      s->race.samples += num_pending * num_folds * sample_size;
+      
+      double leader = 0.;
+      for (size_t i = 0; i < num_pending; i++)
+         if (pending[i]->score > leader)
+            leader = pending[i]->score;
+      
+      double eps = sqrt(log(2. / delta) / (2. * num_folds * sample_size));
+      for (size_t i = 0; i < num_pending; i++) {
+         struct candidate *cand = pending[i];
+         if (cand->score + 2. * eps < leader) {
+            cand->skipped = true;
+            s->race.dropped++;
          }
       }
+   }
+   
+   size_t num_pending;
+   struct candidate **pending = pending_candidates(s, &num_pending);
+   eval_batch(s, pending, num_pending, 0);
+   s->race.samples += num_pending * num_folds * fold_size;
+   s->race.full_samples += s->num_cands * num_folds * fold_size;
+}
+
+/* Lazy greedy search (Minoux, 1978). The score a candidate obtained at the
+   previous steps is assumed to be an upper bound of the score it can obtain at
+   the current step, which holds when features have diminishing returns.
+   Candidates are evaluated by decreasing bound, and we stop as soon as the best
+   score seen is at least as high as all remaining bounds.
+ */
+static double *lazy_score(struct search *s, const struct candidate *cand)
+{
+   size_t num_features = s->data->num_features;
+   size_t col1 = cand->col1 - s->data->columns;
+   size_t col2 = cand->col2 ? (size_t)(cand->col2 - s->data->columns) : num_features;
+   
+   return &s->lazy.scores[col1 * (num_features + 1) + col2];
+}
+
+/* Forgets the scores of the candidates that involve a column merged by the
+   last step: they describe other subsets, so they aren't bounds anymore.
+ */
+static void lazy_forget(struct search *s, const struct column *col)
+{
+   size_t num_features = s->data->num_features;
+   size_t col_no = col - s->data->columns;
+   
+   for (size_t i = 0; i <= num_features; i++)
+      s->lazy.scores[col_no * (num_features + 1) + i] = INFINITY;
+   for (size_t i = 0; i < num_features; i++)
+      s->lazy.scores[i * (num_features + 1) + col_no] = INFINITY;
+}
+
+static int cmp_bounds(const void *x_, const void *y_)
+{
+   const struct candidate *x = *(struct candidate *const *)x_;
+   const struct candidate *y = *(struct candidate *const *)y_;
+   
+   if (x->bound != y->bound)
+      return x->bound < y->bound ? 1 : -1;
+   return x < y ? -1 : x > y;
+}
+
+static void lazy_eval_candidates(struct search *s)
+{
+   ENLARGE(s->lazy.queue, s->num_cands, s->lazy.queue_alloc, 16);
+   struct candidate **queue = s->lazy.queue;
+   for (size_t i = 0; i < s->num_cands; i++) {
+      struct candidate *cand = &s->cands[i];
+      cand->bound = *lazy_score(s, cand);
+      cand->skipped = true;
+      queue[i] = cand;
+   }
+   qsort(queue, s->num_cands, sizeof *queue, cmp_bounds);
+   
+   double best = INVALID_SCORE;
+   size_t i;
+   for (i = 0; i < s->num_cands && !s->bfss->stop; i++) {
+      struct candidate *cand = queue[i];
+      if (best >= cand->bound)
+         break;
+      cand->skipped = false;
+      *lazy_score(s, cand) = candidate_eval(s, cand);
+      if (cand->score > best)
+         best = cand->score;
+   }
+   if (!s->bfss->stop)
+      s->lazy.skipped += s->num_cands - i;
+}
+
+/* Evaluates all candidates. The search must be stopped if the stop flag of the
+   context is set afterwards, since some candidates might not have been
+   evaluated.
+ */
+static void eval_candidates(struct search *s)
+{
+   if (!s->num_cands) {
+      return;
+   } else if (s->config.lazy) {
+      lazy_eval_candidates(s);
+   } else if (s->config.race && s->num_cands > 1) {
+      race_candidates(s);
+   } else {
+      size_t num_pending;
+      struct candidate **pending = pending_candidates(s, &num_pending);
+      eval_batch(s, pending, num_pending, 0);
+   }
+}
+
+/* Evaluates all candidates and returns the best one, or NULL if there is
+   none. If several candidates obtain the same score, the last one wins.
+ */
+static struct candidate *select_candidate(struct search *s)
+{
+   order_candidates(s);
+   eval_candidates(s);
+   
+   struct candidate *best = NULL;
+   for (size_t i = 0; i < s->num_cands; i++) {
+      struct candidate *cand = &s->cands[i];
+      if (!cand->skipped && (!best || cand->score >= best->score))
+         best = cand;
+   }
+   return best;
+}
+
+static void add_candidates(struct search *s, enum candidate_type type,
+                           enum column_state state)
+{
+   s->num_cands = 0;
+   for (size_t i = 0; i < s->data->num_features; i++) {
+      struct column *col = &s->data->columns[i];
+      if (col->state == state)
+         add_candidate(s, type, col, NULL);
+   }
+}
+
+static void search_none(struct search *s)
+{
+   s->best_score = start_search(s, true);
+}
+
+static void commit_step(struct search *s, const struct candidate *best)
+{
+   candidate_commit(best);
+   if (s->config.lazy && best->col2) {
+      lazy_forget(s, best->col1);
+      lazy_forget(s, best->col2);
+   }
+   s->best_score = best->score;
+   s->resume.step++;
+   write_checkpoint(s, NULL);
+   end_step(s);
+}
+
+static void search_forward(struct search *s)
+{
+   s->best_score = start_search(s, false);
+
+   size_t num_active_features = count_active(s, false);
+   size_t max_features = s->config.max_features;
+   
+   while (num_active_features < max_features) {
+      num_active_features++;
+      
+      add_candidates(s, CAND_ADD, COL_INACTIVE);
+      struct candidate *best = select_candidate(s);
       
       /* Ideally, if we obtain exactly the same score with the current subset
          and the best seen so far, we should select the simpler one (the one
@@ -187,114 +1035,68 @@ static void search_forward(void)
          afterwards if no improvement can be made. For now, we adopt the dirty
          solution, which is to choose a more complex subset.
        */
-      if (g_stop || cur_best < g_best_score)
+      if (s->bfss->stop || !best || best->score < s->best_score)
          break;
-      to_add->state = COL_ACTIVE;
-      g_best_score = cur_best;
+      commit_step(s, best);
    }
 }
 
-static void search_backward(void)
+static void search_backward(struct search *s)
 {
-   activate_features();
-   g_best_score = run_eval();
+   s->best_score = start_search(s, true);
    
-   size_t num_features = g_data.num_features;
-   size_t num_active_features = num_features;
-   struct column *columns = g_data.columns;
-   size_t max_features = g_config.max_features;
+   size_t num_active_features = count_active(s, false);
+   size_t max_features = s->config.max_features;
    
    while (num_active_features--) {
-      double cur_best = 0.;
-      struct column *to_remove = NULL;
+      add_candidates(s, CAND_REMOVE, COL_ACTIVE);
+      struct candidate *best = select_candidate(s);
       
-      for (size_t i = 0; i < num_features && !g_stop; i++) {
-         struct column *col = &columns[i];
-         if (col->state == COL_INACTIVE)
-            continue;
-         col->state = COL_INACTIVE;
-         double cur = run_eval();
-         col->state = COL_ACTIVE;
-         if (cur >= cur_best) {
-            cur_best = cur;
-            to_remove = col;
-         }
-      }
-      
-      if (g_stop || (cur_best < g_best_score && num_active_features < max_features))
+      if (s->bfss->stop || !best
+          || (best->score < s->best_score && num_active_features < max_features))
          break;
 
       // If even, prefer the shorter subset.
-      to_remove->state = COL_INACTIVE;
-      g_best_score = cur_best;
+      commit_step(s, best);
    }
 }
 
-static void search_forward_join(void)
+static void search_forward_join(struct search *s)
 {
-   g_best_score = run_eval();
+   s->best_score = start_search(s, false);
 
-   size_t num_active_features = 0;
-   size_t num_features = g_data.num_features;
-   struct column *columns = g_data.columns;
-   struct column *join_column = &columns[num_features];
-   size_t max_links = g_config.max_links;
+   size_t num_active_features = count_active(s, true);
+   size_t num_features = s->data->num_features;
+   struct column *columns = s->data->columns;
+   size_t max_links = s->config.max_links;
    
-   size_t max_features = g_config.max_features;
+   size_t max_features = s->config.max_features;
    
    while (num_active_features < max_features) {
       num_active_features++;
-      double cur_best = 0.;
-      struct column *to_add = NULL;
-      struct column *to_merge = NULL;
       
       // Addition of a new feature.
-      for (size_t i = 0; i < num_features && !g_stop; i++) {
-         struct column *col = &columns[i];
-         if (col->state != COL_INACTIVE)
-            continue;
-         col->state = COL_ACTIVE;
-         double cur = run_eval();
-         col->state = COL_INACTIVE;
-         if (cur >= cur_best) {
-            cur_best = cur;
-            to_add = col;
-         }
-      }
+      add_candidates(s, CAND_ADD, COL_INACTIVE);
       
       // Merging of an inactive feature with an active one.
-      join_column->state = COL_ACTIVE;
-      for (size_t i = 0; i < num_features && !g_stop; i++) {
+      size_t model_size = current_model_bytes(s);
+      for (size_t i = 0; i < num_features; i++) {
          struct column *col1 = &columns[i];
          if (col1->state != COL_ACTIVE || col1->num_links >= max_links)
             continue;
-         col1->state = COL_INACTIVE;
+         size_t others_size = model_size - model_bytes(s, col1->table.num_types);
          for (size_t j = 0; j < num_features; j++) {
             struct column *col2 = &columns[j];
-            if (col2 == col1 || col2->state != COL_INACTIVE)
-               continue;
-            column_join(join_column, col1, col2);
-            double cur = run_eval();
-            if (cur >= cur_best) {
-                cur_best = cur;
-                to_add = col1;
-                to_merge = col2;
-            }
+            if (col2 != col1 && col2->state == COL_INACTIVE
+                && join_allowed(s, col1, col2, others_size))
+               add_candidate(s, CAND_ADD_JOINED, col1, col2);
          }
-         col1->state = COL_ACTIVE;
       }
-      join_column->state = COL_INACTIVE;
       
-      if (g_stop || cur_best < g_best_score)
+      struct candidate *best = select_candidate(s);
+      if (s->bfss->stop || !best || best->score < s->best_score)
          break;
-         
-      if (!to_merge) {
-         to_add->state = COL_ACTIVE;
-      } else {
-         column_merge(to_add, to_merge);
-         to_merge->state = COL_MERGED;
-      }
-      g_best_score = cur_best;
+      commit_step(s, best);
    }
 }
 
@@ -308,127 +1110,825 @@ static void search_forward_join(void)
  * but requires a) to check for cycles b) to preserve the original columns (and
  * maybe also the most recently joined column, for increased efficiency).
  */
-static void search_backward_join(void)
+static void search_backward_join(struct search *s)
 {
-   activate_features();
-   g_best_score = run_eval();
+   s->best_score = start_search(s, true);
    
-   struct column *columns = g_data.columns;
-   size_t num_features = g_data.num_features;
-   size_t num_active_features = num_features;
-   struct column *join_column = &columns[num_features];
-   size_t max_links = g_config.max_links;
-   size_t max_features = g_config.max_features;
-   size_t num_features_used = num_active_features;
+   struct column *columns = s->data->columns;
+   size_t num_features = s->data->num_features;
+   size_t num_active_features = count_active(s, false);
+   size_t max_links = s->config.max_links;
+   size_t max_features = s->config.max_features;
+   size_t num_features_used = count_active(s, true);
 
    while (num_active_features--) {
-      double cur_best = 0.;
-      struct column *to_remove = NULL;
-      struct column *to_merge = NULL;
-      
       // Removal of an active feature.
-      for (size_t i = 0; i < num_features && !g_stop; i++) {
-         struct column *column = &columns[i];
-         if (column->state != COL_ACTIVE)
-            continue;
-         column->state = COL_INACTIVE;
-         double cur = run_eval();
-         column->state = COL_ACTIVE;
-         if (cur >= cur_best) {
-            cur_best = cur;
-            to_remove = column;
-         }
-      }
+      add_candidates(s, CAND_REMOVE, COL_ACTIVE);
       
       // Merging of two active features.
-      join_column->state = COL_ACTIVE;
-      for (size_t i = 0; i < num_features && !g_stop; i++) {
+      size_t model_size = current_model_bytes(s);
+      for (size_t i = 0; i < num_features; i++) {
          struct column *col1 = &columns[i];
          if (col1->state != COL_ACTIVE || col1->num_links >= max_links)
             continue;
-         col1->state = COL_INACTIVE;
          for (size_t j = i + 1; j < num_features; j++) {
             struct column *col2 = &columns[j];
             if (col2->state != COL_ACTIVE || col1->num_links + col2->num_links >= max_links)
                continue;
-            col2->state = COL_INACTIVE;
-            column_join(join_column, col2, col1);
-            double cur = run_eval();
-            col2->state = COL_ACTIVE;
-            if (cur >= cur_best) {
-                cur_best = cur;
-                to_merge = col1;
-                to_remove = col2;
-            }
+            size_t others_size = model_size - model_bytes(s, col1->table.num_types)
+                                            - model_bytes(s, col2->table.num_types);
+            if (join_allowed(s, col1, col2, others_size))
+               add_candidate(s, CAND_JOIN, col1, col2);
          }
-         col1->state = COL_ACTIVE;
       }
-      join_column->state = COL_INACTIVE;
-
-      if (g_stop || (cur_best < g_best_score && num_features_used <= max_features))
+      
+      struct candidate *best = select_candidate(s);
+      if (s->bfss->stop || !best
+          || (best->score < s->best_score && num_features_used <= max_features))
          break;
 
-      to_remove->state = COL_INACTIVE;
-      if (to_merge)
-         column_merge(to_merge, to_remove);
-      else
-         num_features_used -= to_remove->num_links + 1;
-      g_best_score = cur_best;
+      if (best->type == CAND_REMOVE)
+         num_features_used -= best->col1->num_links + 1;
+      commit_step(s, best);
+   }
+}
+
+/* Beam search. Instead of keeping only the best subset at each step, we keep
+   the "beam_width" best ones, and try on each of them the moves of the
+   forward-join search: adding a feature, or joining an unused feature to a
+   group of features. Subsets are not represented with column states but with
+   lists of groups, so that they can be evaluated concurrently. A group is
+   either an original column, or a joined column it owns.
+ */
+struct group {
+   struct column *column;
+   size_t refs;            // Number of beam entries that use the group.
+};
+
+struct beam_entry {
+   struct group **groups;  // Sorted by origin.
+   size_t num_groups;
+   size_t num_features;    // Number of original features used.
+   size_t model_size;      // See current_model_bytes(s).
+   uint32_t *key;          // See memo_key().
+   double score;
+};
+
+#define BEAM_DEFAULT_WIDTH 4
+
+static struct group *group_new(struct column *column)
+{
+   struct group *group = xmalloc(sizeof *group);
+   *group = (struct group){
+      .column = column,
+      .refs = 1,
+   };
+   return group;
+}
+
+static void group_release(struct group *group)
+{
+   if (--group->refs)
+      return;
+   if (group->column->num_links)
+      column_free_joined(group->column);
+   free(group);
+}
+
+static void entry_free(struct beam_entry *entry)
+{
+   for (size_t i = 0; i < entry->num_groups; i++)
+      group_release(entry->groups[i]);
+   free(entry->groups);
+   free(entry->key);
+   free(entry);
+}
+
+static size_t entry_columns(const struct candidate *cand, struct worker *w)
+{
+   const struct beam_entry *entry = cand->parent;
+   const struct column **cols = w->columns;
+   size_t nr = 0;
+   
+   for (size_t i = 0; i < entry->num_groups; i++) {
+      const struct column *col = entry->groups[i]->column;
+      if (col != cand->col1)
+         cols[nr++] = col;
+   }
+   
+   if (cand->type == CAND_ADD) {
+      cols[nr++] = cand->col1;
+   } else {
+      assert(cand->type == CAND_ADD_JOINED);
+      cols[nr++] = join_candidate(w, cand->col1, cand->col2);
+   }
+   return nr;
+}
+
+static void beam_add_candidates(struct search *s, struct beam_entry *entry)
+{
+   if (entry->num_features >= s->config.max_features)
+      return;
+   
+   uint32_t *used = s->beam.used;
+   memset(used, 0, s->data->links_size * sizeof *used);
+   for (size_t i = 0; i < entry->num_groups; i++) {
+      const struct column *col = entry->groups[i]->column;
+      for (size_t j = 0; j < s->data->links_size; j++)
+         used[j] |= col->links[j];
+      used[col->origin >> 5] |= 1u << (col->origin & 31);
+   }
+   
+   struct column *columns = s->data->columns;
+   size_t num_features = s->data->num_features;
+   
+   for (size_t i = 0; i < num_features; i++) {
+      if (!feature_active(used, i)) {
+         struct candidate *cand = add_candidate(s, CAND_ADD, &columns[i], NULL);
+         cand->parent = entry;
+      }
+   }
+   
+   for (size_t i = 0; i < entry->num_groups; i++) {
+      struct group *group = entry->groups[i];
+      struct column *col1 = group->column;
+      if (col1->num_links >= s->config.max_links)
+         continue;
+      size_t others_size = entry->model_size - model_bytes(s, col1->table.num_types);
+      for (size_t j = 0; j < num_features; j++) {
+         struct column *col2 = &columns[j];
+         if (feature_active(used, j) || !join_allowed(s, col1, col2, others_size))
+            continue;
+         struct candidate *cand = add_candidate(s, CAND_ADD_JOINED, col1, col2);
+         cand->parent = entry;
+      }
+   }
+}
+
+static void entry_set_key(struct search *s, struct beam_entry *entry)
+{
+   for (size_t i = 0; i < entry->num_groups; i++)
+      s->beam.columns[i] = entry->groups[i]->column;
+   entry->key = xmalloc(s->data->num_features * sizeof *entry->key);
+   memo_key(s->data, s->beam.columns, entry->num_groups, entry->key);
+}
+
+// Key of the subset a candidate leads to, from the key of its parent.
+static void candidate_key(struct search *s, const struct candidate *cand, uint32_t *key)
+{
+   memcpy(key, cand->parent->key, s->data->num_features * sizeof *key);
+   if (cand->type == CAND_ADD) {
+      key[cand->col1->origin] = cand->col1->origin;
+      return;
+   }
+   
+   assert(cand->type == CAND_ADD_JOINED);
+   uint32_t leader = key[cand->col1->origin];
+   uint32_t origin = cand->col2->origin;
+   if (origin < leader) {
+      for (size_t i = 0; i < s->data->num_features; i++)
+         if (key[i] == leader)
+            key[i] = origin;
+      leader = origin;
+   }
+   key[origin] = leader;
+}
+
+/* Drops the candidates that lead to the same subset as a previous one. Their
+   keys are compared in full, the hash table only narrows down the search.
+ */
+static void beam_dedup_candidates(struct search *s)
+{
+   size_t num_features = s->data->num_features;
+   ENLARGE(s->beam.keys, s->num_cands * num_features + 1, s->beam.keys_alloc, 256);
+   
+   size_t size = 16;
+   while (size < 2 * s->num_cands)
+      size *= 2;
+   ENLARGE(s->beam.slots, size, s->beam.slots_alloc, 16);
+   for (size_t i = 0; i < size; i++)
+      s->beam.slots[i] = SIZE_MAX;
+   
+   size_t nr = 0;
+   for (size_t i = 0; i < s->num_cands; i++) {
+      uint32_t *key = &s->beam.keys[nr * num_features];
+      candidate_key(s, &s->cands[i], key);
+      size_t pos = memo_hash(key, num_features) & (size - 1);
+      while (s->beam.slots[pos] != SIZE_MAX
+             && memcmp(&s->beam.keys[s->beam.slots[pos] * num_features], key,
+                       num_features * sizeof *key))
+         pos = (pos + 1) & (size - 1);
+      if (s->beam.slots[pos] != SIZE_MAX) {
+         s->num_duplicates++;
+         continue;
+      }
+      s->beam.slots[pos] = nr;
+      s->cands[nr++] = s->cands[i];
+   }
+   s->num_cands = nr;
+}
+
+static int cmp_scores(const void *x_, const void *y_)
+{
+   const struct candidate *x = *(struct candidate *const *)x_;
+   const struct candidate *y = *(struct candidate *const *)y_;
+   
+   if (x->score != y->score)
+      return x->score < y->score ? 1 : -1;
+   // As in select_candidate(s), the last candidate wins ties.
+   return x < y ? 1 : -(x > y);
+}
+
+static struct beam_entry *entry_child(struct search *s, const struct candidate *cand)
+{
+   const struct beam_entry *parent = cand->parent;
+   struct beam_entry *entry = xmalloc(sizeof *entry);
+   *entry = (struct beam_entry){
+      .groups = xmalloc((parent->num_groups + 1) * sizeof *entry->groups),
+      .num_features = parent->num_features + 1,
+      .model_size = parent->model_size,
+      .score = cand->score,
+   };
+   
+   struct group *new;
+   if (cand->type == CAND_ADD) {
+      new = group_new(cand->col1);
+   } else {
+      struct column *joined = column_alloc_joined(s->data);
+      column_join(joined, cand->col1, cand->col2);
+      new = group_new(joined);
+      entry->model_size -= model_bytes(s, cand->col1->table.num_types);
+   }
+   entry->model_size += model_bytes(s, new->column->table.num_types);
+   
+   for (size_t i = 0; i < parent->num_groups; i++) {
+      struct group *group = parent->groups[i];
+      if (group->column == cand->col1)
+         continue;
+      if (new && new->column->origin < group->column->origin) {
+         entry->groups[entry->num_groups++] = new;
+         new = NULL;
+      }
+      group->refs++;
+      entry->groups[entry->num_groups++] = group;
+   }
+   if (new)
+      entry->groups[entry->num_groups++] = new;
+   
+   entry_set_key(s, entry);
+   return entry;
+}
+
+static void entry_save_best(struct search *s, const struct beam_entry *entry)
+{
+   for (size_t i = 0; i < s->data->num_features; i++)
+      s->beam.best[i] = UINT32_MAX;
+   
+   for (size_t i = 0; i < entry->num_groups; i++) {
+      const struct column *col = entry->groups[i]->column;
+      s->beam.best[col->origin] = col->origin;
+      for (size_t j = 0; j < s->data->num_features; j++)
+         if (feature_active(col->links, j))
+            s->beam.best[j] = col->origin;
    }
 }
 
-static void (*search_method(void))(void)
+// Entry of the subset to resume from, with one joined column per group.
+static struct beam_entry *entry_from_subset(struct search *s, const uint32_t *origins)
+{
+   size_t num_features = s->data->num_features;
+   struct column *columns = s->data->columns;
+   
+   struct beam_entry *entry = xcalloc(1, sizeof *entry);
+   entry->groups = xmalloc(num_features * sizeof *entry->groups);
+   entry->model_size = model_bytes(s, 1);
+   
+   for (size_t i = 0; i < num_features; i++) {
+      if (origins[i] != i)
+         continue;
+      struct column *col = &columns[i];
+      for (size_t j = 0; j < num_features; j++) {
+         if (j == i || origins[j] != i)
+            continue;
+         struct column *joined = column_alloc_joined(s->data);
+         column_join(joined, col, &columns[j]);
+         if (col->num_links)
+            column_free_joined(col);
+         col = joined;
+      }
+      struct group *group = group_new(col);
+      entry->groups[entry->num_groups++] = group;
+      entry->num_features += col->num_links + 1;
+      entry->model_size += model_bytes(s, col->table.num_types);
+   }
+   entry_set_key(s, entry);
+   return entry;
+}
+
+static void search_beam(struct search *s)
+{
+   size_t num_features = s->data->num_features;
+   size_t width = s->config.beam_width;
+   
+   s->beam.used = xmalloc(s->data->links_size * sizeof *s->beam.used);
+   s->beam.best = xmalloc(num_features * sizeof *s->beam.best);
+   s->beam.columns = xmalloc(num_features * sizeof *s->beam.columns);
+   for (size_t i = 0; i < num_features; i++)
+      s->beam.best[i] = UINT32_MAX;
+   
+   struct beam_entry *root;
+   if (s->resume.start) {
+      root = entry_from_subset(s, s->resume.start);
+      memcpy(s->beam.best, s->resume.start, num_features * sizeof *s->beam.best);
+   } else {
+      root = xcalloc(1, sizeof *root);
+      root->model_size = model_bytes(s, 1);
+      entry_set_key(s, root);
+   }
+   if (s->best_score == INVALID_SCORE) {
+      struct worker *w = &s->workers[0];
+      for (size_t i = 0; i < root->num_groups; i++)
+         w->columns[i] = root->groups[i]->column;
+      s->best_score = worker_eval(w, root->num_groups);
+   }
+   root->score = s->best_score;
+   ENLARGE(s->beam.entries, 1, s->beam.entries_alloc, 16);
+   s->beam.entries[s->beam.num_entries++] = root;
+   
+   struct candidate **ranked = NULL;
+   size_t ranked_alloc = 0;
+   struct beam_entry **next = xmalloc(width * sizeof *next);
+   
+   while (!s->bfss->stop) {
+      s->num_cands = 0;
+      for (size_t i = 0; i < s->beam.num_entries; i++)
+         beam_add_candidates(s, s->beam.entries[i]);
+      beam_dedup_candidates(s);
+      eval_candidates(s);
+      if (s->bfss->stop)
+         break;
+      
+      size_t num_ranked = 0;
+      for (size_t i = 0; i < s->num_cands; i++) {
+         if (!s->cands[i].skipped) {
+            ENLARGE(ranked, num_ranked + 1, ranked_alloc, 16);
+            ranked[num_ranked++] = &s->cands[i];
+         }
+      }
+      qsort(ranked, num_ranked, sizeof *ranked, cmp_scores);
+      if (!num_ranked || ranked[0]->score < s->best_score)
+         break;
+      
+      size_t num_next = num_ranked < width ? num_ranked : width;
+      for (size_t i = 0; i < num_next; i++)
+         next[i] = entry_child(s, ranked[i]);
+      s->best_score = next[0]->score;
+      entry_save_best(s, next[0]);
+      s->resume.step++;
+      write_checkpoint(s, s->beam.best);
+      end_step(s);
+      
+      for (size_t i = 0; i < s->beam.num_entries; i++)
+         entry_free(s->beam.entries[i]);
+      ENLARGE(s->beam.entries, num_next, s->beam.entries_alloc, 16);
+      memcpy(s->beam.entries, next, num_next * sizeof *next);
+      s->beam.num_entries = num_next;
+   }
+   
+   for (size_t i = 0; i < s->beam.num_entries; i++)
+      entry_free(s->beam.entries[i]);
+   s->beam.num_entries = 0;
+   free(next);
+   free(ranked);
+   
+   apply_subset(s, s->beam.best);
+}
+
+static void (*search_method(struct search *s))(struct search *)
 {
    const struct {
       const char *name;
-      void (*func)(void);
+      void (*func)(struct search *);
    } methods[] = {
       {"none",          search_none         },
       {"forward",       search_forward      },
       {"backward",      search_backward     },
       {"forward-join",  search_forward_join },
       {"backward-join", search_backward_join},
+      {"beam",          search_beam         },
       {0,               0,                  },
    };
    
    for (size_t i = 0; methods[i].name; i++)
-      if (!strcmp(methods[i].name, g_config.search_mode))
+      if (!strcmp(methods[i].name, s->config.search_mode))
          return methods[i].func;
    
-   die("unkown search mode: %s", g_config.search_mode);
+   die("unkown search mode: %s", s->config.search_mode);
 }
 
-static void handle_signal(int sig)
+static const char g_progress_report[] =
+"{\n"
+"   \"best_subset\": %s,\n"
+"   \"%s\": %f,\n"
+"   \"subsets_evaluated\": %zu,\n"
+"   \"elapsed_seconds\": %f\n"
+"}\n"
+;
+
+static void report_progress(struct search *s)
 {
-   (void)sig;
-   g_stop = true;
+   struct buffer *buf = &s->best;
+   uint32_t *origins;
+   
+   if (s->best_score == INVALID_SCORE)
+      return;
+   
+   if (!strcmp(s->config.search_mode, "beam")) {
+      origins = s->beam.best;
+   } else {
+      origins = xmalloc(s->data->num_features * sizeof *origins);
+      get_subset(s, origins);
+   }
+   
+   buffer_clear(buf);
+   buffer_catc(buf, '[');
+   for (size_t i = 0; i < s->data->num_features; i++) {
+      if (origins[i] != i)
+         continue;
+      const struct column *col = &s->data->columns[i];
+      bool joined = false;
+      for (size_t j = 0; j < s->data->num_features && !joined; j++)
+         joined = j != i && origins[j] == i;
+      if (buf->size > 1)
+         buffer_catc(buf, ',');
+      if (joined)
+         buffer_catc(buf, '[');
+      buffer_cat(buf, col->name.data, col->name.size);
+      for (size_t j = 0; j < s->data->num_features && joined; j++) {
+         if (j != i && origins[j] == i) {
+            buffer_catc(buf, ',');
+            buffer_cat(buf, s->data->columns[j].name.data, s->data->columns[j].name.size);
+         }
+      }
+      if (joined)
+         buffer_catc(buf, ']');
+   }
+   buffer_catc(buf, ']');
+   
+   verbose_flush(s->verbose);
+   double start = stats_start(STATS_OUTPUT);
+   fprintf(s->out, s->reports.progress, buf->data, s->config.measure_name,
+           s->best_score * 100.,
+           s->resume.prior_evals + atomic_load(&s->budget.num_evals),
+           now() - s->budget.start);
+   fflush(s->out);
+   stats_stop(STATS_OUTPUT, start, 1);
+   
+   if (origins != s->beam.best)
+      free(origins);
 }
 
-void search(void)
+/* Upper estimate of the number of candidates the search has left to
+   evaluate: steps are assumed to have as many candidates as the current one,
+   and the search to go on until no feature can be added or removed.
+ */
+static size_t remaining_candidates(struct search *s)
 {
-   void (*func)(void) = search_method();
+   size_t num_steps;
    
-   if (g_config.max_links != SIZE_MAX
-       && strcmp(g_config.search_mode, "forward-join")
-       && strcmp(g_config.search_mode, "backward-join"))
-      die("--max-links only applies when the search mode is 'forward-join' or 'backward-join', have '%s'",
-          g_config.search_mode);
+   if (!strcmp(s->config.search_mode, "none")) {
+      return 0;
+   } else if (!strcmp(s->config.search_mode, "beam")) {
+      size_t depth = 0;
+      for (size_t i = 0; s->beam.best && i < s->data->num_features; i++)
+         depth += s->beam.best[i] != UINT32_MAX;
+      num_steps = s->config.max_features - depth;
+   } else if (!strncmp(s->config.search_mode, "forward", 7)) {
+      num_steps = s->config.max_features - count_active(s, true);
+   } else {
+      num_steps = count_active(s, false);
+   }
    
-   if (g_config.max_features > g_data.num_features)
-      g_config.max_features = g_data.num_features;
+   size_t step_done = atomic_load(&s->progress.num_cands) - s->progress.step_cands;
+   size_t total = num_steps * s->num_cands;
+   return total > step_done ? total - step_done : 0;
+}
+
+// Writes a line to the progress stream, or to the standard error.
+static void print_progress(struct search *s, const char *event)
+{
+   FILE *out = s->progress.out ? s->progress.out : stderr;
+   double elapsed = now() - s->budget.start;
+   size_t num_evals = atomic_load(&s->budget.num_evals);
+   size_t num_cands = atomic_load(&s->progress.num_cands);
    
-   if (g_config.compact_json) {
-      compress_json(g_full_report);
-      compress_json(g_step_report);
+   double start = stats_start(STATS_OUTPUT);
+   struct buffer buf = BUFFER_INIT;
+   fprintf(out, "{\"event\":\"%s\",", event);
+   if (s->config.targets) {
+      buffer_set_json(&buf, s->data->targets[s->data->target_no].name);
+      fprintf(out, "\"target\":%s,", buf.data);
    }
+   fprintf(out, "\"step\":%zu,\"evaluations\":%zu,", s->resume.step,
+           s->resume.prior_evals + num_evals);
+   buffer_set_json(&buf, s->config.measure_name);
+   if (s->best_score == INVALID_SCORE)
+      fprintf(out, "%s:null,", buf.data);
+   else
+      fprintf(out, "%s:%f,", buf.data, s->best_score * 100.);
+   fprintf(out, "\"evaluations_per_second\":%f,\"elapsed_seconds\":%f,",
+           elapsed > 0. ? num_evals / elapsed : 0., elapsed);
    
-   if (g_config.verbose)
-      run_eval = eval_model_verbose;
+   // Extrapolate from the rate of candidates, some of which are memoized.
+   size_t remaining = remaining_candidates(s);
+   fprintf(out, "\"remaining_candidates\":%zu,\"eta_seconds\":", remaining);
+   if (num_cands)
+      fprintf(out, "%f}\n", remaining * elapsed / num_cands);
+   else
+      fputs("null}\n", out);
+   fflush(out);
+   buffer_fini(&buf);
+   stats_stop(STATS_OUTPUT, start, 1);
+}
+
+static void end_step(struct search *s)
+{
+   s->progress.step_cands = atomic_load(&s->progress.num_cands);
+   if (s->progress.out)
+      print_progress(s, "step");
+}
 
-   if (signal(SIGINT, handle_signal) == SIG_ERR ||
-       signal(SIGTERM, handle_signal) == SIG_ERR)
-      die("can't install signal handler: %s", strerror(errno));
+static void open_progress(struct search *s)
+{
+   if (s->progress.out)
+      return;
+   if (s->config.progress_path) {
+      s->progress.out = fopen(s->config.progress_path, "w");
+      if (!s->progress.out)
+         die("can't open progress file at %s: %s", s->config.progress_path,
+             strerror(errno));
+   } else if (s->config.progress_fd != SIZE_MAX) {
+      s->progress.out = fdopen(s->config.progress_fd, "w");
+      if (!s->progress.out)
+         die("can't open progress stream on file descriptor %zu: %s",
+             s->config.progress_fd, strerror(errno));
+   }
+}
+
+void search_stop(struct bfss *bfss)
+{
+   bfss->stop = true;
+}
 
-   func();
-   print_best();
+void search_status(struct bfss *bfss)
+{
+   bfss->status_requested = true;
+}
+
+static struct search *get_search(struct bfss *bfss)
+{
+   if (!bfss->search) {
+      bfss->search = xmalloc(sizeof *bfss->search);
+      *bfss->search = (struct search){
+         .bfss = bfss,
+         .subset = BUFFER_INIT,
+         .best = BUFFER_INIT,
+      };
+   }
+   return bfss->search;
+}
+
+void search_share_memo(struct bfss *bfss, bool share)
+{
+   struct search *s = get_search(bfss);
+   
+   s->shared_memo.enabled = share;
+   if (!share) {
+      s->shared_memo.ready = false;
+      memo_free(s->memo);
+      s->memo = NULL;
+   }
+}
+
+static void open_memo(struct search *s)
+{
+   uint64_t context = eval_context(s->eval);
+   
+   if (s->shared_memo.ready && s->shared_memo.context == context) {
+      memo_reuse(s->memo, s->config.memo_entries);
+      return;
+   }
+   memo_free(s->memo);
+   s->memo = memo_new(s->data->num_features, s->config.memo_entries,
+                      s->eval->conf_mat_size);
+   s->shared_memo.ready = s->shared_memo.enabled;
+   s->shared_memo.context = context;
+}
+
+static void note_memory(struct search *s)
+{
+   size_t num_workers = pool_size(s->pool);
+   const struct eval *evals[num_workers];
+   const struct column *join_columns[num_workers];
+   for (size_t i = 0; i < num_workers; i++) {
+      evals[i] = s->workers[i].eval;
+      join_columns[i] = s->workers[i].join_column;
+   }
+   memory_note_search(s->memo, evals, join_columns, num_workers);
+}
+
+/* Frees the search state, so that another search can be run. This is also done
+   before starting a search, in case the previous one was aborted by an error,
+   see struct die_handler.
+ */
+static void search_reset(struct search *s)
+{
+   for (size_t i = 0; s->workers && i < pool_size(s->pool); i++) {
+      struct worker *w = &s->workers[i];
+      if (i) {
+         eval_fini(w->eval);
+         free(w->eval);
+      }
+      column_free_joined(w->join_column);
+      free(w->columns);
+      free(w->key);
+   }
+   free(s->workers);
+   s->workers = NULL;
+   
+   pool_free(s->pool);
+   s->pool = NULL;
+   remote_free(s->remote);
+   s->remote = NULL;
+   if (!s->shared_memo.enabled) {
+      memo_free(s->memo);
+      s->memo = NULL;
+   }
+   cache_close(s->cache);
+   s->cache = NULL;
+   mutual_free(s->mutual);
+   s->mutual = NULL;
+   
+   free(s->cands);
+   s->cands = NULL;
+   s->num_cands = s->cands_alloc = 0;
+   free(s->pending);
+   s->pending = NULL;
+   s->pending_alloc = 0;
+   free(s->lazy.scores);
+   free(s->lazy.queue);
+   memset(&s->lazy, 0, sizeof s->lazy);
+   free(s->beam.entries);
+   free(s->beam.used);
+   free(s->beam.best);
+   free(s->beam.columns);
+   free(s->beam.keys);
+   free(s->beam.slots);
+   memset(&s->beam, 0, sizeof s->beam);
+   free(s->resume.start);
+   free(s->resume.origins);
+   memset(&s->resume, 0, sizeof s->resume);
+   memset(&s->race, 0, sizeof s->race);
+   s->num_pruned = s->num_over_budget = s->num_duplicates = 0;
+   
+   verbose_stop(s->verbose);
+   s->verbose = NULL;
+   free(s->reports.full);
+   free(s->reports.full_end);
+   free(s->reports.step);
+   free(s->reports.progress);
+   memset(&s->reports, 0, sizeof s->reports);
+}
+
+void search(struct bfss *bfss, FILE *out)
+{
+   double start = stats_start(STATS_SEARCH);
+   struct search *s = get_search(bfss);
+   search_reset(s);
+   
+   // The defaults completed below only apply to this search.
+   s->config = bfss->config;
+   s->data = &bfss->data;
+   s->eval = &bfss->eval;
+   void (*func)(struct search *) = search_method(s);
+   
+   s->out = out;
+   bfss->stop = false;
+   s->best_score = INVALID_SCORE;
+   
+   if (s->config.lazy) {
+      if (strcmp(s->config.search_mode, "forward")
+          && strcmp(s->config.search_mode, "forward-join"))
+         die("--lazy only applies when the search mode is 'forward' or 'forward-join', have '%s'",
+             s->config.search_mode);
+      if (s->config.race)
+         die("--lazy and --race can't be used together");
+      
+      size_t num_features = s->data->num_features;
+      s->lazy.scores = xmalloc(num_features * (num_features + 1) * sizeof *s->lazy.scores);
+      for (size_t i = 0; i < num_features * (num_features + 1); i++)
+         s->lazy.scores[i] = INFINITY;
+   }
+   
+   const struct {
+      const char *name;
+      size_t value;
+   } join_options[] = {
+      {"max-links",            s->config.max_links           },
+      {"join-candidates",      s->config.join_candidates     },
+      {"max-join-cardinality", s->config.max_join_cardinality},
+      {"max-model-bytes",      s->config.max_model_bytes     },
+   };
+   for (size_t i = 0; i < sizeof join_options / sizeof *join_options; i++) {
+      if (join_options[i].value != SIZE_MAX
+          && strcmp(s->config.search_mode, "forward-join")
+          && strcmp(s->config.search_mode, "backward-join")
+          && strcmp(s->config.search_mode, "beam"))
+         die("--%s only applies when the search mode is 'forward-join', 'backward-join' or 'beam', have '%s'",
+             join_options[i].name, s->config.search_mode);
+   }
+   
+   if (!strcmp(s->config.search_mode, "beam")) {
+      if (s->config.beam_width == SIZE_MAX)
+         s->config.beam_width = BEAM_DEFAULT_WIDTH;
+   } else if (s->config.beam_width != SIZE_MAX) {
+      die("--beam-width only applies when the search mode is 'beam', have '%s'",
+          s->config.search_mode);
+   }
+   
+   if (s->config.join_candidates != SIZE_MAX)
+      s->config.mutual_rank = true;
+   if (s->config.mutual_rank)
+      s->mutual = mutual_new(s->data, s->config.join_candidates);
+   
+   if (s->config.max_features > s->data->num_features)
+      s->config.max_features = s->data->num_features;
+   
+   s->reports.full = report_format(s, g_full_report, false);
+   s->reports.full_end = report_format(s, g_full_report_end, true);
+   s->reports.step = report_format(s, g_step_report, true);
+   s->reports.progress = report_format(s, g_progress_report, true);
+   
+   if (s->config.resume_path) {
+      if (!strcmp(s->config.search_mode, "none"))
+         die("--resume doesn't apply when the search mode is 'none'");
+      if (s->config.init_subset)
+         die("--resume and --init-subset can't be used together");
+      read_checkpoint(s);
+   } else if (s->config.init_subset) {
+      s->resume.start = subset_parse(s->data, s->config.init_subset);
+   }
+   if (s->config.checkpoint_path)
+      s->resume.origins = xmalloc(s->data->num_features * sizeof *s->resume.origins);
+   
+   s->budget.start = now();
+   s->budget.next_report = s->config.report_every;
+   atomic_store(&s->budget.num_evals, 0);
+   open_progress(s);
+   atomic_store(&s->progress.num_cands, 0);
+   s->progress.step_cands = 0;
+   
+   // With remote workers, threads only wait for replies, one per worker.
+   s->remote = remote_new(s->eval);
+   size_t num_remote = remote_connect(s->remote, s->config.num_processes,
+                                      s->config.connect_addrs);
+   s->pool = pool_new(num_remote ? num_remote : s->config.num_threads);
+   workers_init(s);
+   open_memo(s);
+   if (s->config.cache_dir)
+      s->cache = cache_open(s->config.cache_dir, s->eval);
+   if (s->config.verbose)
+      s->verbose = verbose_start(s->out, s->reports.step, s->data, s->eval->measure,
+                                 s->eval->conf_mat_size);
+   
+   size_t start_step = s->resume.step;
+   func(s);
+   verbose_stop(s->verbose);
+   s->verbose = NULL;
+   if (strcmp(s->config.search_mode, "none") && s->best_score != INVALID_SCORE)
+      write_checkpoint(s, NULL);
+   stats_steps(s->resume.step - start_step);
+   print_best(s);
+   fflush(s->out);
+   
+   if (s->config.memory_report)
+      note_memory(s);
+   search_reset(s);
+   stats_stop(STATS_SEARCH, start, 1);
+}
+
+void search_fini(struct bfss *bfss)
+{
+   struct search *s = bfss->search;
+   
+   if (!s)
+      return;
+   search_reset(s);
+   memo_free(s->memo);
+   if (s->progress.out)
+      fclose(s->progress.out);
+   buffer_fini(&s->subset);
+   buffer_fini(&s->best);
+   free(s);
+   bfss->search = NULL;
 }
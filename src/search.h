@@ -1,6 +1,41 @@
 #ifndef BFSS_SEARCH_H
 #define BFSS_SEARCH_H
 
-void search(void);
+#include <stdbool.h>
+#include <stdio.h>
+
+struct bfss;
+
+/* Runs the search configured by the options of "bfss" on its dataset, and
+   writes the report to "out". Can be called several times, on distinct
+   datasets. The options are left untouched.
+ */
+void search(struct bfss *, FILE *out);
+
+/* Makes the current search of "bfss" stop after the evaluation in progress, as
+   if its time limit was reached. Can be called from a signal handler or from
+   another thread.
+ */
+void search_stop(struct bfss *);
+
+/* Makes the current search of "bfss" write its progress to the stream given
+   with --progress or --progress-file, or to the standard error, as soon as an
+   evaluation starts. Can be called from a signal handler or from another
+   thread.
+ */
+void search_status(struct bfss *);
+
+/* Keeps the confusion matrices computed by a search for the following ones,
+   as long as they are made in the same evaluation context, see eval_context().
+   Searches that differ only in the measure to maximize or in the search
+   options then don't evaluate the same subsets twice. The matrices are freed
+   once this is disabled.
+ */
+void search_share_memo(struct bfss *, bool share);
+
+/* Frees the state kept between the searches of "bfss", and closes its progress
+   stream. Also cleans up after a search aborted by an error.
+ */
+void search_fini(struct bfss *);
 
 #endif
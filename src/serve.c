@@ -0,0 +1,241 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <setjmp.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "serve.h"
+#include "config.h"
+#include "dataset.h"
+#include "eval.h"
+#include "measure.h"
+#include "search.h"
+#include "bfss.h"
+#include "remote.h"
+#include "json.h"
+#include "common.h"
+#include "cmd.h"
+
+static const char *g_socket_path;
+static struct bfss g_bfss;
+static struct config g_base_config;    // Options given on the command line.
+static struct die_handler g_handler;
+
+// State of the request being handled. Strings are freed once it is done.
+static struct {
+   struct json_reader rd;
+   char **strings;
+   size_t num_strings, strings_alloc;
+   char *report;
+   size_t report_size;
+   FILE *out;
+} g_request;
+
+static const char *keep_string(const char *str, size_t len)
+{
+   ENLARGE(g_request.strings, g_request.num_strings + 1, g_request.strings_alloc, 8);
+   char *copy = xmalloc(len + 1);
+   memcpy(copy, str, len);
+   copy[len] = '\0';
+   return g_request.strings[g_request.num_strings++] = copy;
+}
+
+static void parse_options_object(struct json_reader *rd)
+{
+   json_expect(rd, '{');
+   if (json_accept(rd, '}'))
+      return;
+
+   struct option *options = config_options(&g_bfss.config);
+   do {
+      const char *name = json_string(rd);
+      name = keep_string(name, strlen(name));
+      json_expect(rd, ':');
+      const char *value = json_skip(rd);
+      if (*value == '"')
+         value = keep_string(rd->str.data, rd->str.size);
+      else if (*value == '[' || *value == '{' || !strncmp(value, "null", 4))
+         die("invalid value for option \"%s\": expected a string, a number or a boolean",
+             name);
+      else
+         value = keep_string(value, rd->pos - value);
+      set_option(options, name, value);
+   } while (json_accept(rd, ','));
+   json_expect(rd, '}');
+   free(options);
+}
+
+static void parse_request(const char *line)
+{
+   struct json_reader *rd = &g_request.rd;
+   json_init(rd, "request", line);
+
+   const char *subset = NULL, *mode = NULL;
+   json_expect(rd, '{');
+   if (!json_accept(rd, '}')) {
+      do {
+         const char *key = json_string(rd);
+         if (!strcmp(key, "eval")) {
+            json_expect(rd, ':');
+            const char *start = json_skip(rd);
+            subset = keep_string(start, rd->pos - start);
+         } else if (!strcmp(key, "search")) {
+            json_expect(rd, ':');
+            const char *str = json_string(rd);
+            mode = keep_string(str, strlen(str));
+         } else if (!strcmp(key, "options")) {
+            json_expect(rd, ':');
+            parse_options_object(rd);
+         } else {
+            die("unknown request member \"%s\"", key);
+         }
+      } while (json_accept(rd, ','));
+      json_expect(rd, '}');
+   }
+   json_end(rd);
+
+   if (!subset == !mode)
+      die("a request must have either an \"eval\" or a \"search\" member");
+   if (subset) {
+      g_bfss.config.search_mode = "none";
+      g_bfss.config.init_subset = subset;
+   } else {
+      g_bfss.config.search_mode = mode;
+   }
+}
+
+static void check_options(void)
+{
+   config_check(&g_bfss.config);
+
+   // Replies are made of a single report.
+   if (g_bfss.config.verbose || g_bfss.config.report_every)
+      die("--verbose and --report-every can't be used with the serve command");
+   if (g_bfss.config.listen_addr || g_bfss.config.sweep || g_bfss.config.targets)
+      die("--listen, --sweep and --targets can't be used with the serve command");
+   if (g_bfss.config.save_model_path)
+      die("--save-model can't be used with the serve command");
+}
+
+// Writes the report of the search or evaluation described by "line".
+static void run_request(const char *line)
+{
+   parse_request(line);
+   check_options();
+   g_bfss.config.compact_json = true;
+
+   restore_columns(&g_bfss.data);
+   find_positive_label(&g_bfss);
+   eval_init(&g_bfss.eval, &g_bfss);
+   measure_init(&g_bfss.measure, &g_bfss.config, g_bfss.data.num_labels);
+
+   g_request.out = open_memstream(&g_request.report, &g_request.report_size);
+   if (!g_request.out)
+      die("can't allocate report: %s", strerror(errno));
+   search(&g_bfss, g_request.out);
+   fclose(g_request.out);
+   g_request.out = NULL;
+}
+
+static void end_request(void)
+{
+   if (g_request.out) {
+      fclose(g_request.out);
+      g_request.out = NULL;
+   }
+   free(g_request.report);
+   g_request.report = NULL;
+
+   eval_fini(&g_bfss.eval);
+   g_bfss.eval = (struct eval){0};
+
+   json_fini(&g_request.rd);
+   for (size_t i = 0; i < g_request.num_strings; i++)
+      free(g_request.strings[i]);
+   g_request.num_strings = 0;
+   g_bfss.config = g_base_config;
+}
+
+static void serve_connection(int fd)
+{
+   FILE *in = fdopen(fd, "r");
+   int out_fd = dup(fd);
+   FILE *out = out_fd < 0 ? NULL : fdopen(out_fd, "w");
+   if (!in || !out) {
+      warn("can't open connection: %s", strerror(errno));
+      return;
+   }
+
+   g_die_handler = &g_handler;
+
+   char *line = NULL;
+   size_t line_alloc = 0;
+   while (getline(&line, &line_alloc, in) >= 0) {
+      if (!line[strspn(line, " \t\r\n")])
+         continue;
+
+      if (setjmp(g_handler.env)) {
+         struct buffer msg = BUFFER_INIT;
+         buffer_set_json(&msg, g_handler.msg);
+         fprintf(out, "{\"error\":%s}\n", msg.data);
+         buffer_fini(&msg);
+      } else {
+         run_request(line);
+         fputs(g_request.report, out);
+      }
+      end_request();
+      if (fflush(out))
+         break;
+   }
+
+   g_die_handler = NULL;
+   free(line);
+   fclose(in);
+   fclose(out);
+}
+
+// Options table of the serve command: --socket and those of config_options().
+static struct option *serve_options(void)
+{
+   struct option *options = config_options(&g_bfss.config);
+   size_t num_options = 0;
+   while (options[num_options].name)
+      num_options++;
+
+   struct option *all = xcalloc(num_options + 2, sizeof *all);
+   all[0] = (struct option){'\0', "socket", OPT_STR(g_socket_path)};
+   memcpy(&all[1], options, num_options * sizeof *options);
+   free(options);
+   return all;
+}
+
+noreturn void serve(int argc, char **argv, const char *help)
+{
+   // Drop the command name.
+   argv[1] = argv[0];
+   argc--;
+   argv++;
+
+   config_init(&g_bfss.config);
+   struct option *options = serve_options();
+   parse_options(options, help, &argc, &argv);
+   free(options);
+
+   if (!g_socket_path)
+      die("the serve command requires --socket");
+   if (argc > 1)
+      die("excess arguments");
+   if (!argc)
+      die("no dataset specified");
+   g_bfss.config.dataset_path = *argv;
+   check_options();
+
+   load_dataset(&g_bfss);
+   save_columns(&g_bfss.data);
+   g_base_config = g_bfss.config;
+
+   char *addr = xmalloc(strlen(g_socket_path) + sizeof "unix:");
+   sprintf(addr, "unix:%s", g_socket_path);
+   remote_listen(addr, serve_connection);
+}
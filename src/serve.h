@@ -0,0 +1,30 @@
+#ifndef BFSS_SERVE_H
+#define BFSS_SERVE_H
+
+#include <stdnoreturn.h>
+
+/* The serve command: "bayes_fss serve --socket=PATH [OPTIONS] DATASET" loads
+   the dataset once and answers requests on a Unix-domain socket. Requests and
+   replies are JSON documents, one per line. A request either evaluates a
+   subset:
+
+      {"eval": [["a", "b"], "c"], "options": {"measure": "accuracy"}}
+
+   or runs a search:
+
+      {"search": "forward", "options": {"max-features": 5, "lazy": true}}
+
+   Options are those of the command line, given as strings, numbers or
+   booleans, and apply on top of the options the server was started with, for
+   this request only. The reply is the report the command-line program would
+   print with --compact, or {"error": MESSAGE}.
+
+   Each connection is served by its own forked process, with its own copy of
+   the columns, so that requests made on different connections run
+   concurrently. Requests made on the same connection are answered in order.
+   "argv" is the full argument vector of the program, and "help" its help
+   screen.
+ */
+noreturn void serve(int argc, char **argv, const char *help);
+
+#endif
@@ -0,0 +1,326 @@
+#define _DEFAULT_SOURCE
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#endif
+#include "stats.h"
+#include "bfss.h"
+#include "buffer.h"
+#include "cmd.h"
+
+static const char *const g_phase_names[STATS_NUM_PHASES] = {
+   [STATS_LOAD]        = "load",
+   [STATS_HASH]        = "hash",
+   [STATS_COUNT]       = "count",
+   [STATS_JOIN]        = "join",
+   [STATS_MERGE]       = "merge",
+   [STATS_PROBS]       = "probs",
+   [STATS_UPDATE_MAT]  = "update_mat",
+   [STATS_EVAL]        = "eval",
+   [STATS_EVAL_SAMPLE] = "eval_sample",
+   [STATS_OUTPUT]      = "output",
+   [STATS_SEARCH]      = "search",
+};
+
+static struct {
+   _Atomic uint64_t nanoseconds;
+   _Atomic uint64_t calls;
+} g_phases[STATS_NUM_PHASES];
+
+static atomic_size_t g_num_steps;
+
+bool g_stats_enabled;
+bool g_stats_counters;
+
+// Phases around which performance counters are read.
+static const bool g_counted_phases[STATS_NUM_PHASES] = {
+   [STATS_LOAD]       = true,
+   [STATS_COUNT]      = true,
+   [STATS_JOIN]       = true,
+   [STATS_PROBS]      = true,
+   [STATS_UPDATE_MAT] = true,
+};
+
+enum { NUM_EVENTS = 5 };
+
+static const char *const g_event_names[NUM_EVENTS] = {
+   "cycles", "instructions", "l1d_misses", "llc_misses", "branch_misses",
+};
+
+static _Atomic uint64_t g_counts[STATS_NUM_PHASES][NUM_EVENTS];
+static _Atomic bool g_opened_events[NUM_EVENTS];  // Opened by some thread.
+static atomic_flag g_warned = ATOMIC_FLAG_INIT;
+static char g_counters_error[128];                // Set with g_warned.
+
+// Layout of a read of a group of counters.
+struct counters {
+   uint64_t num_events;    // Zero if the read failed.
+   uint64_t time_enabled;
+   uint64_t time_running;
+   uint64_t values[NUM_EVENTS];
+};
+
+// Counters of the calling thread.
+static _Thread_local struct {
+   bool opened;
+   int fds[NUM_EVENTS];          // -1 for events that couldn't be opened.
+   int leader;                   // First opened counter, -1 if none.
+   int positions[NUM_EVENTS];    // Position of each event in reads.
+   size_t num_opened;
+   struct counters start[STATS_NUM_PHASES];
+} t_counters;
+
+static void counters_error(const char *event, int err)
+{
+   if (atomic_flag_test_and_set(&g_warned))
+      return;
+   snprintf(g_counters_error, sizeof g_counters_error, "%s%s%s", event ? event : "",
+            event ? ": " : "", strerror(err));
+   warn("can't open performance counters (%s), continuing without them",
+        g_counters_error);
+}
+
+// The counters of the parent's thread are meaningless in a child process.
+static void close_counters(void)
+{
+   for (size_t i = 0; i < NUM_EVENTS; i++)
+      if (t_counters.opened && t_counters.fds[i] >= 0)
+         close(t_counters.fds[i]);
+   t_counters.opened = false;
+}
+
+static void register_fork_handler(void)
+{
+   pthread_atfork(NULL, NULL, close_counters);
+}
+
+#ifdef __linux__
+
+static void open_counters(void)
+{
+   static pthread_once_t once = PTHREAD_ONCE_INIT;
+   pthread_once(&once, register_fork_handler);
+
+#define CACHE_MISSES(cache) ((cache) | PERF_COUNT_HW_CACHE_OP_READ << 8        \
+                             | PERF_COUNT_HW_CACHE_RESULT_MISS << 16)
+   static const struct {
+      uint32_t type;
+      uint64_t config;
+   } events[NUM_EVENTS] = {
+      {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+      {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+      {PERF_TYPE_HW_CACHE, CACHE_MISSES(PERF_COUNT_HW_CACHE_L1D)},
+      {PERF_TYPE_HW_CACHE, CACHE_MISSES(PERF_COUNT_HW_CACHE_LL)},
+      {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+   };
+#undef CACHE_MISSES
+
+   t_counters.opened = true;
+   t_counters.leader = -1;
+   t_counters.num_opened = 0;
+   for (size_t i = 0; i < NUM_EVENTS; i++) {
+      struct perf_event_attr attr = {
+         .size = sizeof attr,
+         .type = events[i].type,
+         .config = events[i].config,
+         .exclude_kernel = 1,
+         .exclude_hv = 1,
+         .read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED
+                        | PERF_FORMAT_TOTAL_TIME_RUNNING,
+      };
+      // Count the calling thread only, on any CPU.
+      int fd = syscall(SYS_perf_event_open, &attr, 0, -1, t_counters.leader,
+                       PERF_FLAG_FD_CLOEXEC);
+      t_counters.fds[i] = fd;
+      if (fd < 0) {
+         counters_error(g_event_names[i], errno);
+         continue;
+      }
+      if (t_counters.leader < 0)
+         t_counters.leader = fd;
+      t_counters.positions[i] = t_counters.num_opened++;
+      atomic_store(&g_opened_events[i], true);
+   }
+}
+
+#else
+
+static void open_counters(void)
+{
+   t_counters.opened = true;
+   t_counters.leader = -1;
+   for (size_t i = 0; i < NUM_EVENTS; i++)
+      t_counters.fds[i] = -1;
+   counters_error(NULL, ENOSYS);
+}
+
+#endif
+
+static void read_counters(struct counters *counters)
+{
+   size_t size = offsetof(struct counters, values)
+               + t_counters.num_opened * sizeof *counters->values;
+   if (read(t_counters.leader, counters, size) != (ssize_t)size)
+      counters->num_events = 0;
+}
+
+void stats_read_counters(enum stats_phase phase)
+{
+   if (!g_counted_phases[phase])
+      return;
+   if (!t_counters.opened)
+      open_counters();
+   if (t_counters.leader >= 0)
+      read_counters(&t_counters.start[phase]);
+}
+
+static void add_counters(enum stats_phase phase)
+{
+   struct counters *start = &t_counters.start[phase], end;
+   if (!start->num_events)
+      return;
+   read_counters(&end);
+   if (!end.num_events || end.time_running == start->time_running)
+      return;
+
+   // Extrapolate if the counters were multiplexed with others.
+   double scale = (double)(end.time_enabled - start->time_enabled)
+                  / (end.time_running - start->time_running);
+   for (size_t i = 0; i < NUM_EVENTS; i++) {
+      if (t_counters.fds[i] < 0)
+         continue;
+      size_t pos = t_counters.positions[i];
+      uint64_t count = (end.values[pos] - start->values[pos]) * scale;
+      atomic_fetch_add_explicit(&g_counts[phase][i], count, memory_order_relaxed);
+   }
+   start->num_events = 0;
+}
+
+void stats_add(enum stats_phase phase, double start, uint64_t calls)
+{
+   uint64_t ns = (now() - start) * 1e9;
+   atomic_fetch_add_explicit(&g_phases[phase].nanoseconds, ns, memory_order_relaxed);
+   atomic_fetch_add_explicit(&g_phases[phase].calls, calls, memory_order_relaxed);
+   if (g_stats_counters && g_counted_phases[phase] && t_counters.leader >= 0)
+      add_counters(phase);
+}
+
+void stats_enable(bool perf_counters)
+{
+   g_stats_enabled = true;
+   g_stats_counters = perf_counters;
+}
+
+void stats_steps(size_t num_steps)
+{
+   atomic_fetch_add(&g_num_steps, num_steps);
+}
+
+static double seconds(enum stats_phase phase)
+{
+   return atomic_load(&g_phases[phase].nanoseconds) / 1e9;
+}
+
+static double ratio(double num, double denom)
+{
+   return denom > 0. ? num / denom : 0.;
+}
+
+// Writes the counters of a phase, and their averages per evaluation.
+static void print_counters(FILE *out, bool compact, enum stats_phase phase,
+                           uint64_t num_evals)
+{
+   const char *sp = compact ? "" : " ";
+   uint64_t counts[NUM_EVENTS];
+   for (size_t i = 0; i < NUM_EVENTS; i++)
+      counts[i] = atomic_load(&g_counts[phase][i]);
+
+   for (int per_eval = 0; per_eval < 2; per_eval++) {
+      if (per_eval)
+         fprintf(out, ",%s\"per_evaluation\":%s", sp, sp);
+      putc('{', out);
+      const char *comma = "";
+      for (size_t i = 0; i < NUM_EVENTS; i++) {
+         if (!atomic_load(&g_opened_events[i]))
+            continue;
+         fprintf(out, "%s\"%s\":%s", comma, g_event_names[i], sp);
+         if (per_eval)
+            fprintf(out, "%f", ratio(counts[i], num_evals));
+         else
+            fprintf(out, "%llu", (unsigned long long)counts[i]);
+         comma = compact ? "," : ", ";
+      }
+      if (!per_eval && atomic_load(&g_opened_events[0]) && atomic_load(&g_opened_events[1]))
+         fprintf(out, "%s\"instructions_per_cycle\":%s%f", comma, sp,
+                 ratio(counts[1], counts[0]));
+      if (per_eval)
+         putc('}', out);
+   }
+   putc('}', out);
+}
+
+void stats_print(FILE *out, const struct bfss *bfss)
+{
+   bool compact = bfss->config.compact_json;
+   const char *nl = compact ? "" : "\n";
+   const char *indent = compact ? "" : "   ";
+   const char *sep = compact ? ":" : ": ";
+   
+   size_t num_steps = atomic_load(&g_num_steps);
+   uint64_t num_evals = atomic_load(&g_phases[STATS_EVAL].calls);
+   double eval_secs = seconds(STATS_EVAL);
+   double search_secs = seconds(STATS_SEARCH);
+   
+   fprintf(out, "{%s", nl);
+   fprintf(out, "%s\"evaluations\"%s%llu,%s", indent, sep,
+           (unsigned long long)num_evals, nl);
+   fprintf(out, "%s\"evaluations_per_second\"%s%f,%s", indent, sep,
+           ratio(num_evals, eval_secs), nl);
+   fprintf(out, "%s\"samples_per_second\"%s%f,%s", indent, sep,
+           ratio((double)num_evals * bfss->data.num_samples, eval_secs), nl);
+   fprintf(out, "%s\"search_steps\"%s%zu,%s", indent, sep, num_steps, nl);
+   fprintf(out, "%s\"seconds_per_step\"%s%f,%s", indent, sep,
+           ratio(search_secs, num_steps), nl);
+   fprintf(out, "%s\"phases\"%s{%s", indent, sep, nl);
+   for (size_t i = 0; i < STATS_NUM_PHASES; i++) {
+      fprintf(out, "%s%s\"%s\"%s{\"seconds\"%s%f,%s\"calls\"%s%llu}%s%s",
+              indent, indent, g_phase_names[i], sep, sep, seconds(i),
+              compact ? "" : " ", sep,
+              (unsigned long long)atomic_load(&g_phases[i].calls),
+              i + 1 < STATS_NUM_PHASES ? "," : "", nl);
+   }
+   fprintf(out, "%s}", indent);
+
+   if (g_stats_counters) {
+      fprintf(out, ",%s%s\"perf_counters\"%s{%s", nl, indent, sep, nl);
+      bool opened = false;
+      for (size_t i = 0; i < NUM_EVENTS; i++)
+         opened |= atomic_load(&g_opened_events[i]);
+      if (!opened) {
+         struct buffer error = BUFFER_INIT;
+         buffer_set_json(&error, g_counters_error);
+         fprintf(out, "%s%s\"error\"%s%s%s", indent, indent, sep, error.data, nl);
+         buffer_fini(&error);
+      } else {
+         const char *comma = "";
+         for (size_t i = 0; i < STATS_NUM_PHASES; i++) {
+            if (!g_counted_phases[i])
+               continue;
+            fprintf(out, "%s%s%s%s\"%s\"%s", comma, *comma ? nl : "", indent, indent,
+                    g_phase_names[i], sep);
+            print_counters(out, compact, i, num_evals);
+            comma = ",";
+         }
+         fputs(nl, out);
+      }
+      fprintf(out, "%s}", indent);
+   }
+   fprintf(out, "%s}\n", nl);
+}
@@ -0,0 +1,67 @@
+#ifndef BFSS_STATS_H
+#define BFSS_STATS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "common.h"
+
+struct bfss;
+
+/* Timing statistics, enabled with --stats. The time spent in each phase and
+   the number of calls are accumulated over all threads, and over all contexts,
+   so that the time of a phase can exceed the elapsed time. They are only
+   enabled by the command-line program. When disabled, measuring a phase costs
+   a test of g_stats_enabled.
+
+   With --perf-counters, hardware performance counters are also read around
+   the phases listed in stats.c, on Linux. Each thread opens its own counters
+   the first time it enters such a phase.
+ */
+enum stats_phase {
+   STATS_LOAD,          // load_dataset()
+   STATS_HASH,          // column_add(), per line while loading
+   STATS_COUNT,         // column_count(), once per fold
+   STATS_JOIN,          // column_join()
+   STATS_MERGE,         // column_merge()
+   STATS_PROBS,         // compute_probs(), once per fold
+   STATS_UPDATE_MAT,    // update_mat(), once per fold
+   STATS_EVAL,          // eval_columns()
+   STATS_EVAL_SAMPLE,   // eval_columns_sample()
+   STATS_OUTPUT,        // Reports.
+   STATS_SEARCH,        // search()
+   STATS_NUM_PHASES
+};
+
+extern bool g_stats_enabled;
+extern bool g_stats_counters;
+
+// Must be called before any phase is measured.
+void stats_enable(bool perf_counters);
+
+void stats_add(enum stats_phase, double start, uint64_t calls);
+
+void stats_read_counters(enum stats_phase);
+
+static inline double stats_start(enum stats_phase phase)
+{
+   if (!g_stats_enabled)
+      return 0.;
+   if (g_stats_counters)
+      stats_read_counters(phase);
+   return now();
+}
+
+static inline void stats_stop(enum stats_phase phase, double start, uint64_t calls)
+{
+   if (g_stats_enabled)
+      stats_add(phase, start, calls);
+}
+
+// Counts the steps made by searches.
+void stats_steps(size_t num_steps);
+
+// Writes the statistics as a JSON document, in the output format of "bfss".
+void stats_print(FILE *, const struct bfss *bfss);
+
+#endif
@@ -0,0 +1,79 @@
+#include <string.h>
+#include "subset.h"
+#include "column.h"
+#include "dataset.h"
+#include "buffer.h"
+#include "json.h"
+#include "common.h"
+#include "cmd.h"
+
+/* Per thread, as several library contexts can parse subsets at the same time.
+   Everything is freed on success, or by the next call on the same thread if an
+   error interrupted this one.
+ */
+static _Thread_local struct {
+   struct json_reader rd;
+   struct buffer name;     // Last string read, encoded as feature names are.
+   uint32_t *origins;      // Result being built.
+} g_parser = {
+   .name = BUFFER_INIT,
+};
+
+// Parses a feature name and returns the matching column number.
+static uint32_t parse_feature(const struct dataset *data, uint32_t *origins)
+{
+   buffer_set_json(&g_parser.name, json_string(&g_parser.rd));
+   
+   for (size_t i = 0; i < data->num_features; i++) {
+      if (!strcmp(data->columns[i].name.data, g_parser.name.data)) {
+         if (origins[i] != UINT32_MAX)
+            die("feature %s given twice in the subset", g_parser.name.data);
+         return i;
+      }
+   }
+   die("no feature named %s in the dataset", g_parser.name.data);
+}
+
+static void parse_group(const struct dataset *data, uint32_t *origins)
+{
+   uint32_t origin = parse_feature(data, origins);
+   origins[origin] = origin;
+   
+   while (json_accept(&g_parser.rd, ','))
+      origins[parse_feature(data, origins)] = origin;
+   json_expect(&g_parser.rd, ']');
+}
+
+uint32_t *subset_parse(const struct dataset *data, const char *json)
+{
+   json_fini(&g_parser.rd);
+   free(g_parser.origins);
+   
+   uint32_t *origins = xmalloc(data->num_features * sizeof *origins);
+   g_parser.origins = origins;
+   for (size_t i = 0; i < data->num_features; i++)
+      origins[i] = UINT32_MAX;
+   
+   struct json_reader *rd = &g_parser.rd;
+   json_init(rd, "subset", json);
+   
+   json_expect(rd, '[');
+   if (!json_accept(rd, ']')) {
+      do {
+         if (json_accept(rd, '[')) {
+            parse_group(data, origins);
+         } else {
+            uint32_t feat_no = parse_feature(data, origins);
+            origins[feat_no] = feat_no;
+         }
+      } while (json_accept(rd, ','));
+      json_expect(rd, ']');
+   }
+   json_end(rd);
+   
+   json_fini(rd);
+   buffer_fini(&g_parser.name);
+   g_parser.name = (struct buffer)BUFFER_INIT;
+   g_parser.origins = NULL;
+   return origins;
+}
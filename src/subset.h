@@ -0,0 +1,15 @@
+#ifndef BFSS_SUBSET_H
+#define BFSS_SUBSET_H
+
+#include <stdint.h>
+
+struct dataset;
+
+/* Parses a feature subset in the format of the "subset" field of the program
+   output, e.g. ["tail",["num_legs","wings"],"continent"]. Returns an array of
+   origins, as described in checkpoint.h. The first feature of a nested array
+   names the group.
+ */
+uint32_t *subset_parse(const struct dataset *, const char *json);
+
+#endif
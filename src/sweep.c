@@ -0,0 +1,198 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <ctype.h>
+#include <errno.h>
+#include <math.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sweep.h"
+#include "config.h"
+#include "dataset.h"
+#include "eval.h"
+#include "measure.h"
+#include "search.h"
+#include "bfss.h"
+#include "buffer.h"
+#include "common.h"
+#include "cmd.h"
+
+// An option and the values it takes.
+struct axis {
+   const char *name;
+   const char **values;
+   size_t num_values;
+};
+
+static struct {
+   struct axis *axes;
+   size_t num_axes;
+   size_t num_configs;     // Product of the numbers of values.
+   struct config base;     // Options given on the command line.
+   char *report;
+   size_t report_size;
+} g_sweep;
+
+static volatile sig_atomic_t g_stop;
+
+// Options that determine the evaluation context, see eval_context().
+static bool changes_context(const char *name)
+{
+   static const char *const names[] = {
+      "folds", "smooth", "mode", "truth", "average",
+   };
+   for (size_t i = 0; i < sizeof names / sizeof *names; i++)
+      if (!strcmp(name, names[i]))
+         return true;
+   return false;
+}
+
+/* Parses "name=value,value;name=value...". The grid string is modified and
+   kept, values point into it.
+ */
+static void parse_grid(char *grid)
+{
+   size_t axes_alloc = 0;
+
+   for (char *item = strtok(grid, ";"); item; item = strtok(NULL, ";")) {
+      char *eq = strchr(item, '=');
+      if (!eq || eq == item || !eq[1])
+         die("invalid --sweep item '%s' (expected 'option=value,value...')", item);
+      *eq = '\0';
+
+      ENLARGE(g_sweep.axes, g_sweep.num_axes + 1, axes_alloc, 4);
+      struct axis *axis = &g_sweep.axes[g_sweep.num_axes++];
+      *axis = (struct axis){.name = item};
+
+      size_t values_alloc = 0;
+      char *value = eq + 1;
+      for (;;) {
+         char *comma = strchr(value, ',');
+         if (comma)
+            *comma = '\0';
+         if (!*value)
+            die("empty value for option '%s' in --sweep", item);
+         ENLARGE(axis->values, axis->num_values + 1, values_alloc, 4);
+         axis->values[axis->num_values++] = value;
+         if (!comma)
+            break;
+         value = comma + 1;
+      }
+
+      for (size_t i = 0; i + 1 < g_sweep.num_axes; i++)
+         if (!strcmp(g_sweep.axes[i].name, item))
+            die("option '%s' given twice in --sweep", item);
+      if (!strcmp(item, "sweep"))
+         die("--sweep can't be swept");
+   }
+   if (!g_sweep.num_axes)
+      die("--sweep requires at least one option");
+
+   /* Vary the options that change the evaluation context last, so that
+      consecutive configurations share their confusion matrices.
+    */
+   for (size_t i = 0, j = 0; i < g_sweep.num_axes; i++) {
+      if (changes_context(g_sweep.axes[i].name)) {
+         struct axis axis = g_sweep.axes[i];
+         memmove(&g_sweep.axes[j + 1], &g_sweep.axes[j], (i - j) * sizeof axis);
+         g_sweep.axes[j++] = axis;
+      }
+   }
+
+   g_sweep.num_configs = 1;
+   for (size_t i = 0; i < g_sweep.num_axes; i++)
+      g_sweep.num_configs *= g_sweep.axes[i].num_values;
+}
+
+/* Sets the options of "bfss" to the configuration "config_no", the last option
+   varying fastest.
+ */
+static void set_config(struct bfss *bfss, size_t config_no)
+{
+   bfss->config = g_sweep.base;
+   struct option *options = config_options(&bfss->config);
+   for (size_t i = g_sweep.num_axes; i-- > 0; ) {
+      const struct axis *axis = &g_sweep.axes[i];
+      set_option(options, axis->name, axis->values[config_no % axis->num_values]);
+      config_no /= axis->num_values;
+   }
+   free(options);
+   bfss->config.compact_json = true;
+   config_check(&bfss->config);
+}
+
+// Writes the swept options of the configuration "config_no" as a JSON object.
+static void print_config(FILE *out, size_t config_no)
+{
+   size_t indexes[g_sweep.num_axes];
+   for (size_t i = g_sweep.num_axes; i-- > 0; ) {
+      indexes[i] = config_no % g_sweep.axes[i].num_values;
+      config_no /= g_sweep.axes[i].num_values;
+   }
+
+   struct buffer buf = BUFFER_INIT;
+   fputs("{\"config\":{", out);
+   for (size_t i = 0; i < g_sweep.num_axes; i++) {
+      const char *value = g_sweep.axes[i].values[indexes[i]];
+      char *end;
+      double number = strtod(value, &end);
+      buffer_set_json(&buf, g_sweep.axes[i].name);
+      fprintf(out, "%s%s:", i ? "," : "", buf.data);
+      // Numbers are printed as parsed, so that ".5" or "01" give valid JSON.
+      if (*value && !*end && !isspace((unsigned char)*value) && isfinite(number)) {
+         fprintf(out, "%.17g", number);
+      } else if (!strcmp(value, "true") || !strcmp(value, "false")) {
+         fputs(value, out);
+      } else {
+         buffer_set_json(&buf, value);
+         fputs(buf.data, out);
+      }
+   }
+   fputs("},", out);
+   buffer_fini(&buf);
+}
+
+void sweep(struct bfss *bfss, FILE *out)
+{
+   g_sweep.base = bfss->config;
+   parse_grid(xstrdup(bfss->config.sweep));
+
+   // Check all the configurations before running any.
+   for (size_t i = 0; i < g_sweep.num_configs; i++)
+      set_config(bfss, i);
+
+   search_share_memo(bfss, true);
+   for (size_t i = 0; i < g_sweep.num_configs && !g_stop; i++) {
+      set_config(bfss, i);
+      restore_columns(&bfss->data);
+      find_positive_label(bfss);
+      eval_fini(&bfss->eval);
+      eval_init(&bfss->eval, bfss);
+      measure_init(&bfss->measure, &bfss->config, bfss->data.num_labels);
+
+      FILE *report = open_memstream(&g_sweep.report, &g_sweep.report_size);
+      if (!report)
+         die("can't allocate report: %s", strerror(errno));
+      search(bfss, report);
+      fclose(report);
+
+      // Nothing is printed if the search was interrupted before any result.
+      if (g_sweep.report_size > 0) {
+         // Insert the configuration at the start of the report.
+         print_config(out, i);
+         fputs(g_sweep.report + 1, out);
+         fflush(out);
+      } else if (!g_stop) {
+         warn("no result for configuration %zu", i);
+      }
+      free(g_sweep.report);
+   }
+   search_share_memo(bfss, false);
+}
+
+void sweep_stop(struct bfss *bfss)
+{
+   g_stop = true;
+   search_stop(bfss);
+}
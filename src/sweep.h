@@ -0,0 +1,24 @@
+#ifndef BFSS_SWEEP_H
+#define BFSS_SWEEP_H
+
+#include <stdio.h>
+
+struct bfss;
+
+/* Runs a search for each configuration of the grid given with --sweep, e.g.
+   "smooth=0.1,0.5,1;measure=F1,accuracy", on the dataset loaded once, and
+   writes one report per configuration to "out", each on its own line and
+   preceded by a "config" field giving the swept options. Configurations that
+   share the same evaluation context (folds, smoothing, classification and
+   averaging modes, positive label) are run one after the other, and share
+   their confusion matrices, see search_share_memo().
+   The original columns must have been saved with save_columns(), and the
+   evaluator of "bfss" initialized; it is initialized again for each
+   configuration, and the options are left as in the last one.
+ */
+void sweep(struct bfss *, FILE *out);
+
+// Stops the current search and skips the remaining configurations.
+void sweep_stop(struct bfss *);
+
+#endif
@@ -0,0 +1,145 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "targets.h"
+#include "config.h"
+#include "dataset.h"
+#include "eval.h"
+#include "measure.h"
+#include "search.h"
+#include "bfss.h"
+#include "stats.h"
+#include "memory.h"
+#include "buffer.h"
+#include "common.h"
+#include "cmd.h"
+
+struct child {
+   pid_t pid;
+   int fd;              // Read end of the pipe the report is written to.
+};
+
+static void print_exit_memory(FILE *out, const struct bfss *bfss)
+{
+   memory_report(out, bfss, "exit");
+}
+
+/* Writes a JSON document produced by "print" to stderr, in one go, with the
+   target name of the child.
+ */
+static void print_diagnostic(const struct bfss *bfss,
+                             void (*print)(FILE *, const struct bfss *))
+{
+   char *doc;
+   size_t size;
+   FILE *out = open_memstream(&doc, &size);
+   if (!out)
+      die("can't allocate statistics: %s", strerror(errno));
+   print(out, bfss);
+   fclose(out);
+   
+   struct buffer buf = BUFFER_INIT;
+   buffer_set_json(&buf, bfss->data.targets[bfss->data.target_no].name);
+   fprintf(stderr, "{\"target\":%s,%s", buf.data, doc + 1);
+   buffer_fini(&buf);
+   free(doc);
+}
+
+noreturn static void run_child(struct bfss *bfss, size_t target_no, int fd)
+{
+   select_target(&bfss->data, target_no);
+   find_positive_label(bfss);
+   eval_fini(&bfss->eval);
+   eval_init(&bfss->eval, bfss);
+   measure_init(&bfss->measure, &bfss->config, bfss->data.num_labels);
+   
+   FILE *out = fdopen(fd, "w");
+   if (!out)
+      die("can't open pipe: %s", strerror(errno));
+   search(bfss, out);
+   if (fclose(out))
+      die("can't write report: %s", strerror(errno));
+   if (bfss->config.stats)
+      print_diagnostic(bfss, stats_print);
+   if (bfss->config.memory_report)
+      print_diagnostic(bfss, print_exit_memory);
+   exit(EXIT_SUCCESS);
+}
+
+static struct child fork_child(struct bfss *bfss, size_t target_no)
+{
+   int fds[2];
+   if (pipe(fds))
+      die("can't create pipe: %s", strerror(errno));
+   
+   fflush(stdout);
+   fflush(stderr);
+   pid_t pid = fork();
+   if (pid < 0)
+      die("can't fork: %s", strerror(errno));
+   if (!pid) {
+      close(fds[0]);
+      run_child(bfss, target_no, fds[1]);
+   }
+   close(fds[1]);
+   return (struct child){.pid = pid, .fd = fds[0]};
+}
+
+// Copies the report of a child to "out", with the target name inserted.
+static bool copy_report(FILE *out, const struct dataset *data, const struct child *child,
+                        size_t target_no)
+{
+   FILE *in = fdopen(child->fd, "r");
+   if (!in)
+      die("can't open pipe: %s", strerror(errno));
+   
+   char *report = NULL;
+   size_t report_alloc = 0;
+   ssize_t len = getline(&report, &report_alloc, in);
+   fclose(in);
+   
+   int status;
+   while (waitpid(child->pid, &status, 0) < 0)
+      if (errno != EINTR)
+         die("can't wait for child process: %s", strerror(errno));
+   
+   bool ok = len > 0 && WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS;
+   if (ok) {
+      struct buffer buf = BUFFER_INIT;
+      buffer_set_json(&buf, data->targets[target_no].name);
+      fprintf(out, "{\"target\":%s,%s", buf.data, report + 1);
+      fflush(out);
+      buffer_fini(&buf);
+   }
+   free(report);
+   return ok;
+}
+
+void targets_search(struct bfss *bfss, FILE *out)
+{
+   size_t num_targets = bfss->data.num_targets;
+   
+   // Check the positive label of all targets before starting.
+   for (size_t i = 1; i < num_targets; i++) {
+      select_target(&bfss->data, i);
+      find_positive_label(bfss);
+   }
+   
+   bfss->config.compact_json = true;
+   struct child *children = xmalloc(num_targets * sizeof *children);
+   for (size_t i = 1; i < num_targets; i++)
+      children[i] = fork_child(bfss, i);
+   
+   size_t num_failed = 0;
+   for (size_t i = 1; i < num_targets; i++)
+      num_failed += !copy_report(out, &bfss->data, &children[i], i);
+   free(children);
+   
+   if (num_failed)
+      die("the search failed for %zu target(s)", num_failed);
+}
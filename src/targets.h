@@ -0,0 +1,17 @@
+#ifndef BFSS_TARGETS_H
+#define BFSS_TARGETS_H
+
+#include <stdio.h>
+
+struct bfss;
+
+/* Runs a search for each target named with --targets, see struct target. Each
+   search runs in its own forked process, so that they run concurrently while
+   sharing the feature columns, which are only copied where a search modifies
+   them. One report per target is written to "out", each on its own line, in
+   the order of the targets, and preceded by a "target" field giving the target
+   name. "bfss" is the context of the main process; the options are modified.
+ */
+void targets_search(struct bfss *, FILE *out);
+
+#endif
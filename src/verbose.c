@@ -0,0 +1,268 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include "verbose.h"
+#include "buffer.h"
+#include "column.h"
+#include "dataset.h"
+#include "measure.h"
+#include "stats.h"
+#include "common.h"
+#include "cmd.h"
+
+/* Records are written at increasing positions of a ring, "head" and "tail"
+   counting the bytes reserved and consumed since the start. A record is:
+
+      uint32_t header;              // Size of the record, 0 until published.
+      uint32_t num_cols;
+      struct conf_mat mat;          // conf_mat_size bytes.
+      struct {
+         uint32_t origin, num_links;
+         uint32_t links[num_links];
+      } cols[num_cols];
+
+   rounded up to 8 bytes. Producers reserve room by advancing "head", then
+   publish the record by storing its header. A record that would wrap around
+   the end of the ring is preceded by a padding record filling the end. The
+   writer clears the bytes it consumed, so that headers not yet published
+   read as zero.
+ */
+#define PADDING 0x80000000u
+
+// Text buffered before it is written out.
+#define WRITE_SIZE (64 * 1024)
+
+// Polling interval of the writer when the ring is empty.
+#define IDLE_NSEC 1000000
+
+struct verbose {
+   unsigned char *ring;
+   size_t size;                  // Power of two.
+   atomic_size_t head, tail;
+   atomic_size_t written;        // Bytes consumed and written to "out".
+   atomic_bool quit;
+   pthread_t thread;
+
+   FILE *out;
+   const char *format;
+   const struct dataset *data;
+   const struct measure *measure;
+   size_t conf_mat_size;
+   struct buffer subset, text;
+};
+
+static _Atomic uint32_t *header_at(struct verbose *verbose, size_t pos)
+{
+   return (_Atomic uint32_t *)&verbose->ring[pos & (verbose->size - 1)];
+}
+
+static void pause_briefly(long nsec)
+{
+   nanosleep(&(struct timespec){.tv_nsec = nsec}, NULL);
+}
+
+static void cat_name(const struct dataset *data, struct buffer *buf, uint32_t feat_no)
+{
+   const struct buffer *name = &data->columns[feat_no].name;
+   buffer_cat(buf, name->data, name->size);
+}
+
+static void format_record(struct verbose *verbose, const unsigned char *rec)
+{
+   struct buffer *subset = &verbose->subset;
+   uint32_t num_cols = ((const uint32_t *)rec)[1];
+   const struct conf_mat *mat = (const struct conf_mat *)&rec[8];
+   const uint32_t *cols = (const uint32_t *)&rec[8 + verbose->conf_mat_size];
+
+   buffer_clear(subset);
+   buffer_catc(subset, '[');
+   for (uint32_t i = 0; i < num_cols; i++) {
+      uint32_t origin = *cols++;
+      uint32_t num_links = *cols++;
+      if (i)
+         buffer_catc(subset, ',');
+      if (num_links)
+         buffer_catc(subset, '[');
+      cat_name(verbose->data, subset, origin);
+      for (uint32_t j = 0; j < num_links; j++) {
+         buffer_catc(subset, ',');
+         cat_name(verbose->data, subset, *cols++);
+      }
+      if (num_links)
+         buffer_catc(subset, ']');
+   }
+   buffer_catc(subset, ']');
+
+   struct measures stats;
+   measure_full(verbose->measure, &stats, mat);
+
+   struct buffer *text = &verbose->text;
+   size_t room = subset->size + 256;
+   for (;;) {
+      buffer_ensure(text, text->size + room);
+      int len = snprintf(&text->data[text->size], room + 1, verbose->format,
+                         subset->data,
+                         stats.accuracy * 100.,
+                         stats.precision * 100.,
+                         stats.recall * 100.,
+                         stats.F1 * 100.);
+      if ((size_t)len <= room) {
+         text->size += len;
+         break;
+      }
+      room = len;
+   }
+}
+
+static void write_text(struct verbose *verbose, size_t tail)
+{
+   struct buffer *text = &verbose->text;
+   if (text->size) {
+      fwrite(text->data, 1, text->size, verbose->out);
+      buffer_clear(text);
+   }
+   atomic_store(&verbose->written, tail);
+}
+
+static void *writer_main(void *arg)
+{
+   struct verbose *verbose = arg;
+   size_t tail = atomic_load(&verbose->tail);
+
+   for (;;) {
+      double start = stats_start(STATS_OUTPUT);
+      uint64_t num_records = 0;
+      uint32_t header;
+      while ((header = atomic_load_explicit(header_at(verbose, tail), memory_order_acquire))) {
+         unsigned char *rec = (unsigned char *)header_at(verbose, tail);
+         size_t size = header & ~PADDING;
+         if (!(header & PADDING)) {
+            format_record(verbose, rec);
+            num_records++;
+         }
+         memset(rec, 0, size);
+         atomic_store_explicit(&verbose->tail, tail += size, memory_order_release);
+         if (verbose->text.size >= WRITE_SIZE)
+            write_text(verbose, tail);
+      }
+      write_text(verbose, tail);
+      stats_stop(STATS_OUTPUT, start, num_records);
+
+      if (atomic_load(&verbose->quit) && atomic_load(&verbose->head) == tail)
+         break;
+      pause_briefly(IDLE_NSEC);
+   }
+   return NULL;
+}
+
+struct verbose *verbose_start(FILE *out, const char *format, const struct dataset *data,
+                              const struct measure *measure, size_t conf_mat_size)
+{
+   // Largest record: every feature in its own column, or linked to another.
+   size_t max_record = 8 + conf_mat_size + 3 * data->num_features * sizeof(uint32_t);
+   size_t size = 1 << 20;
+   while (size < 8 * max_record)
+      size <<= 1;
+
+   struct verbose *verbose = xmalloc(sizeof *verbose);
+   *verbose = (struct verbose){
+      .ring = xcalloc(size, 1),
+      .size = size,
+      .out = out,
+      .format = format,
+      .data = data,
+      .measure = measure,
+      .conf_mat_size = conf_mat_size,
+      .subset = BUFFER_INIT,
+      .text = BUFFER_INIT,
+   };
+   atomic_init(&verbose->head, 0);
+   atomic_init(&verbose->tail, 0);
+   atomic_init(&verbose->written, 0);
+   atomic_init(&verbose->quit, false);
+
+   int ret = pthread_create(&verbose->thread, NULL, writer_main, verbose);
+   if (ret) {
+      free(verbose->ring);
+      free(verbose);
+      die("can't create thread: %s", strerror(ret));
+   }
+   return verbose;
+}
+
+void verbose_flush(struct verbose *verbose)
+{
+   if (!verbose)
+      return;
+
+   size_t head = atomic_load(&verbose->head);
+   while (atomic_load(&verbose->written) < head)
+      pause_briefly(IDLE_NSEC / 10);
+}
+
+void verbose_stop(struct verbose *verbose)
+{
+   if (!verbose)
+      return;
+
+   atomic_store(&verbose->quit, true);
+   pthread_join(verbose->thread, NULL);
+
+   free(verbose->ring);
+   buffer_fini(&verbose->subset);
+   buffer_fini(&verbose->text);
+   free(verbose);
+}
+
+static unsigned char *reserve(struct verbose *verbose, size_t size)
+{
+   size_t head = atomic_load(&verbose->head);
+   size_t pos, padding;
+
+   for (;;) {
+      pos = head & (verbose->size - 1);
+      padding = verbose->size - pos < size ? verbose->size - pos : 0;
+      if (head + padding + size - atomic_load_explicit(&verbose->tail, memory_order_acquire)
+          > verbose->size) {
+         // Full, wait for the writer.
+         pause_briefly(IDLE_NSEC / 10);
+         head = atomic_load(&verbose->head);
+      } else if (atomic_compare_exchange_weak(&verbose->head, &head, head + padding + size)) {
+         break;
+      }
+   }
+   if (padding)
+      atomic_store_explicit(header_at(verbose, head), PADDING | padding, memory_order_release);
+   return (unsigned char *)header_at(verbose, head + padding);
+}
+
+void verbose_record(struct verbose *verbose, const struct conf_mat *mat,
+                    const struct column *const *cols, size_t num_cols)
+{
+   size_t size = 8 + verbose->conf_mat_size;
+   for (size_t i = 0; i < num_cols; i++)
+      size += (2 + cols[i]->num_links) * sizeof(uint32_t);
+   size = (size + 7) & ~(size_t)7;
+
+   unsigned char *rec = reserve(verbose, size);
+   ((uint32_t *)rec)[1] = num_cols;
+   memcpy(&rec[8], mat, verbose->conf_mat_size);
+
+   uint32_t *out = (uint32_t *)&rec[8 + verbose->conf_mat_size];
+   for (size_t i = 0; i < num_cols; i++) {
+      const struct column *col = cols[i];
+      *out++ = col->origin;
+      *out++ = col->num_links;
+      for (size_t j = 0; col->num_links && j < verbose->data->links_size; j++) {
+         for (uint32_t word = col->links[j], k = 0; word; word >>= 1, k++)
+            if (word & 1)
+               *out++ = j * 32 + k;
+      }
+   }
+   atomic_store_explicit((_Atomic uint32_t *)rec, size, memory_order_release);
+}
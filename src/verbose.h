@@ -0,0 +1,38 @@
+#ifndef BFSS_VERBOSE_H
+#define BFSS_VERBOSE_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+struct column;
+struct conf_mat;
+
+/* Output of --verbose. Searching threads only copy the subset and confusion
+   matrix of each evaluation into a ring buffer, without locking; a background
+   thread formats the reports and writes them to the output in large chunks.
+   Reports are written in the order the evaluations were recorded.
+ */
+
+struct dataset;
+struct measure;
+struct verbose;
+
+/* Starts a writer thread, which names the features after the columns of "data"
+   and computes the measures with "measure". "format" is the report of an
+   evaluation, with the subset as a string and the four measures as doubles; it
+   must stay valid until verbose_stop().
+ */
+struct verbose *verbose_start(FILE *out, const char *format, const struct dataset *data,
+                              const struct measure *measure, size_t conf_mat_size);
+
+// Waits until all the evaluations recorded so far are written.
+void verbose_flush(struct verbose *);
+
+// Flushes, stops the writer thread and frees "verbose". Does nothing if it is NULL.
+void verbose_stop(struct verbose *);
+
+// Waits for room in the buffer if it is full.
+void verbose_record(struct verbose *, const struct conf_mat *mat,
+                    const struct column *const *cols, size_t num_cols);
+
+#endif
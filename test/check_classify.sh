@@ -0,0 +1,30 @@
+#!/usr/bin/env bash
+
+VG="valgrind --leak-check=no --error-exitcode=1"
+
+DATASET=data/cars.tsv
+MODEL=data/cars.model
+
+set -o errexit
+set -o pipefail
+
+# Save the model of the selected subset, trained on all samples.
+subset=$(../bayes_fss --compact --save-model=$MODEL $DATASET | \
+         python3 -c 'import sys, json; print(json.dumps(json.load(sys.stdin)["subset"]))')
+
+$VG ../bayes_fss classify --model=$MODEL --scores -j 1 $DATASET > data/classify.1
+$VG ../bayes_fss classify --model=$MODEL --scores -j 4 $DATASET > data/classify.4
+cmp data/classify.1 data/classify.4
+
+# Same predictions in Python.
+../scripts/mksubset.py "$subset" < $DATASET | ./eval_dataset.py --predict > data/classify.py
+./compare_predictions.py data/classify.1 data/classify.py
+
+# An input large enough to be split in several batches, without labels.
+(head -n 1 $DATASET; for i in $(seq 200); do tail -n +2 $DATASET; done) | cut -f 2- \
+   > data/classify.tsv
+../bayes_fss classify --model=$MODEL -j 1 data/classify.tsv > data/classify.1
+../bayes_fss classify --model=$MODEL -j 4 - < data/classify.tsv > data/classify.4
+cmp data/classify.1 data/classify.4
+
+rm $MODEL data/classify.1 data/classify.4 data/classify.py data/classify.tsv
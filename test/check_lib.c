@@ -0,0 +1,154 @@
+#define _DEFAULT_SOURCE
+
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include "libbayes_fss.h"
+
+/* Checks that library contexts are independent: searches run from two threads
+   at once must give the reports they give when run one after the other. Also
+   checks that an error raised by an evaluation thread of a search is returned
+   to the caller instead of terminating the program.
+ */
+
+#define NUM_ROUNDS 4
+
+struct job {
+   const char *options[4][2];    // Name and value pairs.
+   struct bfss *ctx;
+   char *expected;               // Report of the sequential run.
+   bool failed;
+};
+
+static struct job g_jobs[] = {
+   {.options = {{"search", "backward-join"}, {"threads", "2"}, {"measure", "F1"}}},
+   {.options = {{"search", "beam"}, {"measure", "accuracy"}, {"smooth", "0.5"}}},
+};
+
+#define NUM_JOBS (sizeof g_jobs / sizeof *g_jobs)
+
+static struct bfss *new_context(const char *const options[][2], size_t num_options,
+                                const char *dataset)
+{
+   struct bfss *ctx = bfss_new();
+   for (size_t i = 0; i < num_options && options[i][0]; i++) {
+      if (bfss_set_option(ctx, options[i][0], options[i][1])) {
+         fprintf(stderr, "can't set option %s: %s\n", options[i][0], bfss_error(ctx));
+         exit(EXIT_FAILURE);
+      }
+   }
+   if (bfss_load_file(ctx, dataset)) {
+      fprintf(stderr, "can't load %s: %s\n", dataset, bfss_error(ctx));
+      exit(EXIT_FAILURE);
+   }
+   return ctx;
+}
+
+static void *run_job(void *arg)
+{
+   struct job *job = arg;
+
+   for (size_t i = 0; i < NUM_ROUNDS && !job->failed; i++) {
+      char *report = bfss_search(job->ctx);
+      if (!report) {
+         fprintf(stderr, "search failed: %s\n", bfss_error(job->ctx));
+         job->failed = true;
+      } else if (strcmp(report, job->expected)) {
+         fprintf(stderr, "concurrent search gave:\n%sinstead of:\n%s", report, job->expected);
+         job->failed = true;
+      }
+      free(report);
+   }
+   return NULL;
+}
+
+static bool check_concurrent_searches(void)
+{
+   for (size_t i = 0; i < NUM_JOBS; i++) {
+      struct job *job = &g_jobs[i];
+      job->ctx = new_context(job->options, 4, "data/cars.tsv");
+      job->expected = bfss_search(job->ctx);
+      if (!job->expected) {
+         fprintf(stderr, "search failed: %s\n", bfss_error(job->ctx));
+         return false;
+      }
+   }
+
+   pthread_t threads[NUM_JOBS];
+   for (size_t i = 0; i < NUM_JOBS; i++) {
+      if (pthread_create(&threads[i], NULL, run_job, &g_jobs[i])) {
+         fputs("can't create thread\n", stderr);
+         return false;
+      }
+   }
+
+   bool ok = true;
+   for (size_t i = 0; i < NUM_JOBS; i++) {
+      pthread_join(threads[i], NULL);
+      ok &= !g_jobs[i].failed;
+      free(g_jobs[i].expected);
+      bfss_free(g_jobs[i].ctx);
+   }
+   return ok;
+}
+
+/* Makes the cache of a threaded search fail while the search appends records to
+   it, with a file size limit.
+ */
+static bool check_thread_error(void)
+{
+   char dir[] = "/tmp/check_lib.XXXXXX";
+   if (!mkdtemp(dir)) {
+      perror("can't create directory");
+      return false;
+   }
+
+   const char *const options[][2] = {
+      {"search", "forward-join"}, {"threads", "2"}, {"cache-dir", dir},
+   };
+   struct bfss *ctx = new_context(options, 3, "data/sbd.tsv");
+
+   struct rlimit limit, old_limit;
+   getrlimit(RLIMIT_FSIZE, &old_limit);
+   limit = (struct rlimit){.rlim_cur = 1024, .rlim_max = old_limit.rlim_max};
+   signal(SIGXFSZ, SIG_IGN);
+   setrlimit(RLIMIT_FSIZE, &limit);
+   char *report = bfss_search(ctx);
+   setrlimit(RLIMIT_FSIZE, &old_limit);
+
+   bool ok = !report && strstr(bfss_error(ctx), "can't write to");
+   if (!ok)
+      fprintf(stderr, "expected a write error, got: %s\n",
+              report ? report : bfss_error(ctx));
+   free(report);
+
+   // The context must still be usable.
+   report = bfss_search(ctx);
+   if (!report) {
+      fprintf(stderr, "search failed after an error: %s\n", bfss_error(ctx));
+      ok = false;
+   }
+   free(report);
+   bfss_free(ctx);
+
+   char cmd[sizeof dir + 16];
+   snprintf(cmd, sizeof cmd, "rm -rf %s", dir);
+   if (system(cmd))
+      fprintf(stderr, "can't remove %s\n", dir);
+   return ok;
+}
+
+int main(void)
+{
+   bool ok = check_concurrent_searches();
+   ok &= check_thread_error();
+   if (!ok)
+      return EXIT_FAILURE;
+   puts("library checks passed");
+   return EXIT_SUCCESS;
+}
@@ -0,0 +1,211 @@
+#!/usr/bin/env python3
+
+"""
+Runs fixed workloads and compares their cost with a committed baseline, so that
+performance regressions are caught like output changes are.
+
+Each workload is a search on test/data/sbd.tsv or on a generated dataset. For
+each one, the number of evaluations must match the baseline exactly: it only
+changes when the search itself changes. The cost is measured with the
+instructions retired, when --perf-counters works on this machine. Both are
+deterministic enough for make check.
+
+Times are too noisy for that, as they depend on the load of the machine: they
+are only compared with --timings (make perf-check), on the median of several
+runs. Costs are only compared when the baseline was made on the same machine,
+identified by its host name, processor and microcode, and fail when they
+exceed the baseline by more than the tolerance.
+
+After an intended change of the search or of its cost, or on a new machine,
+regenerate the baseline with --update (or make perf-baseline).
+"""
+
+import os, sys, json, shutil, hashlib, argparse, platform, statistics, subprocess, \
+   tempfile
+
+TEST_DIR = os.path.dirname(os.path.abspath(__file__))
+ROOT = os.path.dirname(TEST_DIR)
+
+SBD = os.path.join(TEST_DIR, "data", "sbd.tsv")
+GENERATED = ["--rows=20000", "--features=20", "--labels=2", "--cardinality=2-1000"]
+
+# Name, dataset (a path or gendata.py arguments), bayes_fss options.
+WORKLOADS = [
+   ("sbd-forward", SBD, ["--search=forward"]),
+   ("sbd-backward", SBD, ["--search=backward"]),
+   ("sbd-forward-join", SBD, ["--search=forward-join"]),
+   ("sbd-backward-join", SBD, ["--search=backward-join", "--max-evals=400"]),
+   ("sbd-beam", SBD, ["--search=beam"]),
+   ("gen-forward-join", GENERATED, ["--search=forward-join", "--max-evals=200"]),
+   ("gen-beam", GENERATED, ["--search=beam", "--max-evals=200"]),
+]
+
+parser = argparse.ArgumentParser(description=__doc__.strip().splitlines()[0])
+parser.add_argument("--binary", default=os.path.join(ROOT, "bayes_fss"))
+parser.add_argument("--baseline", default=os.path.join(TEST_DIR, "data", "perf_baseline.json"))
+parser.add_argument("--runs", type=int, default=5,
+                    help="runs per workload when timing, the median is kept")
+parser.add_argument("--timings", action="store_true",
+                    help="also compare the median times, which are noisy")
+parser.add_argument("--time-tolerance", type=float, default=25.,
+                    help="allowed increase of the median time, in percent")
+parser.add_argument("--instructions-tolerance", type=float, default=5.,
+                    help="allowed increase of the instructions retired, in percent")
+parser.add_argument("--update", action="store_true", help="rewrite the baseline")
+args = parser.parse_args()
+
+def machine():
+   """Identifies the machine, so that costs are only compared on the one that
+   made the baseline. Generic virtual machines share their processor model, so
+   the host name, processor flags and microcode are included."""
+   cpu = {}
+   try:
+      with open("/proc/cpuinfo") as f:
+         for line in f:
+            key, _, value = line.partition(":")
+            cpu.setdefault(key.strip(), value.strip())
+   except OSError:
+      pass
+   flags = cpu.get("flags", cpu.get("Features", ""))
+   return {
+      "system": platform.system(),
+      "host": platform.node(),
+      "cpu": cpu.get("model name", platform.processor() or platform.machine()),
+      "cpus": os.cpu_count(),
+      "flags": hashlib.sha1(flags.encode()).hexdigest()[:12],
+      "microcode": cpu.get("microcode", ""),
+   }
+
+def generate(directory, gen_args):
+   path = os.path.join(directory, "gen.tsv")
+   with open(path, "w") as out:
+      subprocess.run([os.path.join(ROOT, "scripts", "gendata.py")] + gen_args,
+                     stdout=out, check=True)
+   return path
+
+def run(dataset, options, counters):
+   cmd = [args.binary, "--compact", "--stats", "--threads=1"] + options + [dataset]
+   if counters:
+      cmd.insert(1, "--perf-counters")
+   proc = subprocess.run(cmd, stdout=subprocess.DEVNULL, stderr=subprocess.PIPE,
+                         universal_newlines=True, check=True)
+   stats = next(json.loads(line) for line in proc.stderr.splitlines()
+                if line.startswith("{") and '"phases"' in line)
+   phases = stats["phases"]
+   measures = {
+      "evaluations": stats["evaluations"],
+      "seconds": phases["load"]["seconds"] + phases["search"]["seconds"],
+   }
+   if counters and "error" not in stats["perf_counters"]:
+      measures["instructions"] = sum(phase.get("instructions", 0)
+                                     for phase in stats["perf_counters"].values())
+   return measures
+
+def measure(dataset, options, counters, timings):
+   first = run(dataset, options, counters)
+   if not timings:
+      return first
+   runs = [first] + [run(dataset, options, False) for _ in range(args.runs - 1)]
+   if len(set(r["evaluations"] for r in runs)) != 1:
+      sys.exit("%s: the number of evaluations changes from one run to the next"
+               % " ".join(options))
+   return dict(first, seconds=round(statistics.median(r["seconds"] for r in runs), 6))
+
+def change(before, after):
+   return (after - before) / before * 100. if before else 0.
+
+def compare(name, base, new, same_machine):
+   """Prints the delta report lines of a workload, returns false on regression."""
+   ok = True
+   notes = []
+   if base is None:
+      print("%-20s %9d %8s %12s %12s %8s  new workload" % (
+            name, new["evaluations"], "", "", "", ""))
+      return True
+   if new["evaluations"] != base["evaluations"]:
+      notes.append("evaluations changed from %d" % base["evaluations"])
+      ok = False
+
+   metrics = []
+   if "instructions" in new and "instructions" in base:
+      metrics.append(("instructions", args.instructions_tolerance, "%12d"))
+   if args.timings:
+      metrics.append(("seconds", args.time_tolerance, "%12.4f"))
+   if not metrics:
+      print("%-20s %9d %8s %12s %12s %8s  %s%s" % (
+            name, new["evaluations"], "", "", "", "", "ok" if ok else "FAIL",
+            "".join(", " + note for note in notes)))
+      return ok
+
+   for metric, tolerance, fmt in metrics:
+      metric_notes = list(notes)
+      metric_ok = ok
+      delta = change(base[metric], new[metric])
+      if not same_machine:
+         metric_notes.append("not compared, baseline from another machine")
+      elif delta > tolerance:
+         metric_notes.append("%s above tolerance (%g%%)" % (metric, tolerance))
+         metric_ok = False
+      print("%-20s %9d %8s %s %s %+7.1f%%  %s%s" % (
+            name, new["evaluations"], metric[:8], fmt % base[metric], fmt % new[metric],
+            delta, "ok" if metric_ok else "FAIL",
+            "".join(", " + note for note in metric_notes)))
+      ok &= metric_ok
+   return ok
+
+def main():
+   if not os.path.exists(args.binary):
+      sys.exit("no binary at %s, run make first" % args.binary)
+
+   baseline = None
+   if not args.update:
+      try:
+         with open(args.baseline) as f:
+            baseline = json.load(f)
+      except OSError as e:
+         sys.exit("can't read baseline: %s (create it with --update)" % e)
+
+   this_machine = machine()
+   same_machine = baseline is None or baseline["machine"] == this_machine
+   # Instructions are only comparable with a baseline that has them.
+   counters = baseline is None or all("instructions" in w
+                                      for w in baseline["workloads"].values())
+   # The baseline always records times, for make perf-check.
+   timings = args.update or args.timings
+
+   results = {}
+   directory = tempfile.mkdtemp(prefix="bfss-perf-")
+   try:
+      generated = None
+      for name, dataset, options in WORKLOADS:
+         if isinstance(dataset, list):
+            generated = generated or generate(directory, dataset)
+            dataset = generated
+         results[name] = measure(dataset, options, counters, timings)
+   finally:
+      shutil.rmtree(directory)
+
+   if args.update:
+      with open(args.baseline, "w") as f:
+         json.dump({"machine": this_machine, "workloads": results}, f, indent=3)
+         f.write("\n")
+      print("baseline written to %s" % args.baseline)
+      return
+
+   if not same_machine:
+      print("baseline made on: %s" % json.dumps(baseline["machine"], sort_keys=True))
+      print("this machine:     %s" % json.dumps(this_machine, sort_keys=True))
+      print("costs are reported but not checked, run make perf-baseline to check them")
+   print("%-20s %9s %8s %12s %12s %8s" % (
+         "workload", "evals", "metric", "baseline", "now", "change"))
+   ok = True
+   for name in results:
+      ok &= compare(name, baseline["workloads"].get(name), results[name], same_machine)
+   for name in baseline["workloads"]:
+      if name not in results:
+         print("%-20s  removed workload, update the baseline" % name)
+   if not ok:
+      sys.exit("performance check FAILED")
+   print("performance check passed")
+
+main()
@@ -0,0 +1,57 @@
+#include <setjmp.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bfss.h"
+#include "remote.h"
+#include "common.h"
+#include "cmd.h"
+
+/* Checks that a worker rejects a request for a sample larger than a fold,
+   instead of reading and writing past its buffers: it must close the
+   connection without replying. A forked worker stands for one reached with
+   --connect, since both serve requests the same way.
+ */
+
+static struct bfss g_bfss;
+
+int main(void)
+{
+   config_init(&g_bfss.config);
+   g_bfss.config.dataset_path = "data/cars.tsv";
+   load_dataset(&g_bfss);
+   measure_init(&g_bfss.measure, &g_bfss.config, g_bfss.data.num_labels);
+   eval_init(&g_bfss.eval, &g_bfss);
+
+   struct remote *remote = remote_new(&g_bfss.eval);
+   remote_connect(remote, 1, NULL);
+
+   const struct column *col = &g_bfss.data.columns[0];
+   struct conf_mat *mat = xmalloc(g_bfss.eval.conf_mat_size);
+
+   // A valid sample first, so that a failure isn't blamed on the check.
+   remote_eval(remote, 0, &col, 1, g_bfss.eval.fold_size, mat);
+
+   struct die_handler handler;
+   g_die_handler = &handler;
+   bool ok = false;
+   if (setjmp(handler.env)) {
+      ok = strstr(handler.msg, "lost worker");
+      if (!ok)
+         fprintf(stderr, "unexpected error: %s\n", handler.msg);
+   } else {
+      remote_eval(remote, 0, &col, 1, g_bfss.eval.fold_size + 1, mat);
+      fputs("the worker evaluated a sample larger than a fold\n", stderr);
+   }
+   g_die_handler = NULL;
+
+   remote_free(remote);
+   free(mat);
+   eval_fini(&g_bfss.eval);
+   free_dataset(&g_bfss.data);
+   if (!ok)
+      return EXIT_FAILURE;
+   puts("remote checks passed");
+   return EXIT_SUCCESS;
+}
@@ -10,14 +10,40 @@ AVERAGE=macro
 set -o errexit
 set -o pipefail
 
-for search_mode in forward backward forward-join backward-join; do
+for search_mode in forward backward forward-join backward-join beam; do
    $VG ../bayes_fss -v --measure=$MEASURE --smooth=$SMOOTH --compact \
       --search=$search_mode --average=$AVERAGE $DATASET | \
          ./extract_search_infos.py $MEASURE > data/$search_mode.search
 done
 
 # Floats are not stable, hope this still works.
-for search_mode in forward backward forward-join backward-join; do
+for search_mode in forward backward forward-join backward-join beam; do
    cmp data/$search_mode.expect data/$search_mode.search
    rm data/$search_mode.search
 done
+
+# Lazy search must find the subset the full one finds here, though the joins
+# it makes change the subsets its bounds were computed on.
+subset() {
+   $VG ../bayes_fss "$@" --measure=$MEASURE --smooth=$SMOOTH --average=$AVERAGE $DATASET | \
+      python3 -c 'import json, sys; print(json.load(sys.stdin)["subset"])'
+}
+[ "$(subset --search=forward-join --lazy)" = "$(subset --search=forward-join)" ]
+
+# The transposition table is on by default, and the summary reuses the matrix
+# of the best subset from it. Evaluations are counted alike without it.
+summary() {
+   $VG ../bayes_fss "$@" --measure=$MEASURE --smooth=$SMOOTH --average=$AVERAGE \
+      --compact --search=backward-join $DATASET
+}
+summary | python3 -c '
+import json, sys
+doc = json.load(sys.stdin)
+assert doc["memo_hits"] >= 1 and doc["memo_misses"] == doc["subsets_evaluated"]
+print(doc["subsets_evaluated"])' > data/memo.count
+summary --memo-entries=0 | python3 -c '
+import json, sys
+doc = json.load(sys.stdin)
+assert "memo_hits" not in doc and "memo_misses" not in doc
+print(doc["subsets_evaluated"])' | cmp data/memo.count -
+rm data/memo.count
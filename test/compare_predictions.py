@@ -0,0 +1,30 @@
+#!/usr/bin/env python3
+
+# Compares the output of "bayes_fss classify --scores" with the one of
+# "eval_dataset.py --predict". Sums are not made in the same order, so scores
+# may differ slightly, and labels whose scores are that close may be swapped.
+
+import sys
+
+TOLERANCE = 0.00001
+
+c_results = open(sys.argv[1])
+py_results = open(sys.argv[2])
+
+header = c_results.readline()
+assert header == py_results.readline(), "labels differ"
+labels = header.rstrip("\n").split("\t")[1:]
+
+for i, (line1, line2) in enumerate(zip(c_results, py_results)):
+   label1, *scores1 = line1.rstrip("\n").split("\t")
+   label2, *scores2 = line2.rstrip("\n").split("\t")
+   scores1, scores2 = list(map(float, scores1)), list(map(float, scores2))
+   assert len(scores1) == len(scores2), "error at %d (number of labels)" % (i + 2)
+   for score1, score2 in zip(scores1, scores2):
+      assert abs(score1 - score2) < TOLERANCE, "error at %d (scores)" % (i + 2)
+   if label1 != label2:
+      score1, score2 = scores2[labels.index(label1)], scores2[labels.index(label2)]
+      assert abs(score1 - score2) < TOLERANCE, "error at %d (label)" % (i + 2)
+
+assert not c_results.readline()
+assert not py_results.readline()
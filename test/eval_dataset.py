@@ -8,6 +8,10 @@ NUM_SPLITS = 5
 
 assert len(sys.argv) == 2
 
+# With --predict, train on all samples and output the label predicted for each
+# one, with the log2 probabilities of all labels, as "bayes_fss classify
+# --scores" does. Otherwise, cross-validate and output the measures.
+predict = sys.argv[1] == "--predict"
 positive_label = sys.argv[1]
 
 features = sys.stdin.readline().rstrip("\n")
@@ -25,12 +29,7 @@ for sample in sys.stdin:
       labels.append(label)
    dataset.append((label, fields))
 
-assert len(labels) == 2, "%r" % labels # Only support binary classification for now.
-assert positive_label in labels
-if positive_label == labels[0]:
-   labels.reverse()
-
-def classify(sample, columns, labels_freqs, types):
+def log_probs(sample, columns, labels_freqs, types):
    probs = {}
    for label, label_freq in labels_freqs.items():
       prob = (label_freq + SMOOTH) / (sum(labels_freqs.values()) + SMOOTH * len(labels))
@@ -40,8 +39,33 @@ def classify(sample, columns, labels_freqs, types):
       for label, label_freq in labels_freqs.items():
          prob = (feat_freqs[label] + SMOOTH) / (label_freq + SMOOTH * len(types[features[feat_no]]))
          probs[label] += math.log2(prob)
+   return probs
+
+def classify(sample, columns, labels_freqs, types):
+   probs = log_probs(sample, columns, labels_freqs, types)
    return max(probs, key=probs.get)
 
+if predict:
+   columns = [(feature, defaultdict(lambda: defaultdict(int))) for feature in features]
+   labels_freqs = defaultdict(int)
+   types = defaultdict(set)
+   for label, sample in dataset:
+      labels_freqs[label] += 1
+      for feat_no, (_, column) in enumerate(columns):
+         column[sample[feat_no]][label] += 1
+         types[features[feat_no]].add(sample[feat_no])
+   print("\t" + "\t".join(labels))
+   for _, sample in dataset:
+      probs = log_probs(sample, columns, labels_freqs, types)
+      print("%s\t%s" % (max(probs, key=probs.get),
+                        "\t".join("%.6f" % probs[label] for label in labels)))
+   sys.exit()
+
+assert len(labels) == 2, "%r" % labels # Only support binary classification for now.
+assert positive_label in labels
+if positive_label == labels[0]:
+   labels.reverse()
+
 conf_mat = {"tp": 0, "tn": 0, "fp": 0, "fn": 0}
 
 split_size = len(dataset) // NUM_SPLITS